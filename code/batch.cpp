@@ -0,0 +1,105 @@
+/**
+ * @file batch.cpp
+ * @author Letícia Freire Carvalho de Sousa
+ * @brief Batch runner, runs every job of a manifest file on all the cores
+ * @version 0.1
+ * @date 2026-10-19
+ *
+ * @copyright Copyright (c) 2024
+ *
+ * Usage: ./batch manifest [workers] [exemplar cache size in MB]
+ *
+ * The manifest has one job per line, a JSON object as described in synthesisjob.hpp, e.g.
+ *     {"input": ["../input_images/jeans_input0.png", "../input_images/jeans_input1.png"], "output": "../output_images/jeans.png", "width": 640, "height": 427, "iterations": 300}
+ *     {"input": "../input_images/areia_input0.png", "output": "../output_images/areia.png", "width": 256, "height": 256, "seconds": 5, "seed": 7}
+ *     {"kind": "video", "input": "../input_images/clip", "output": "../output_images/video", "width": 320, "height": 240, "frames": 120}
+ * Empty lines and lines starting with # are ignored. The largest jobs (area &times; iterations) start first,
+ * so a long job doesn't run alone at the end. Each exemplar is decoded once for all the jobs.
+ *
+ * A report line is printed for each finished job (its manifest line, time and memory), and a summary at the end.
+ * The exit status is 1 if any job failed.
+ */
+
+#include "synthesisjob.hpp"
+#include "threadpool.hpp"
+#include <iostream>
+#include <fstream>
+#include <algorithm>
+#include <thread>
+#include <sys/resource.h>
+
+namespace{
+
+struct ManifestJob{
+    int line;
+    SynthesisJob job;
+};
+
+// iterations of a job with only a time budget are unknown, they count as the default, a video counts its voxels
+double estimatedCost(const SynthesisJob &job){
+    if(job.video)
+        return (double) job.width * job.height * job.videoOptions.frames;
+    return (double) job.width * job.height * std::max(1, job.iterations);
+}
+
+} // namespace
+
+int main(int argc, char *argv[]){
+    if(argc < 2){
+        std::cerr<<"Usage: "<<argv[0]<<" manifest [workers] [exemplar cache size in MB]"<<std::endl;
+        return 2;
+    }
+    int workerCount = argc > 2 ? std::max(1, atoi(argv[2])) : (int) std::max(1u, std::thread::hardware_concurrency());
+    size_t cacheBytes = (size_t) (argc > 3 ? std::max(1, atoi(argv[3])) : 1024) << 20;
+
+    std::ifstream manifest(argv[1]);
+    if(!manifest){
+        std::cerr<<"Invalid name for manifest file"<<std::endl;
+        return 2;
+    }
+    std::vector<ManifestJob> jobs;
+    int invalid = 0;
+    std::string text;
+    for(int line = 1; std::getline(manifest, text); line++){
+        size_t first = text.find_first_not_of(" \t\r");
+        if(first == std::string::npos || text[first] == '#')
+            continue;
+        try{
+            jobs.push_back({line, parseSynthesisJob(parseJsonObject(text))});
+        } catch(const std::exception &e){
+            std::cout<<"{\"line\":"<<line<<",\"status\":\"error\",\"message\":"<<jsonQuote(e.what())<<"}"<<std::endl;
+            invalid++;
+        }
+    }
+    std::stable_sort(jobs.begin(), jobs.end(), [](const ManifestJob &a, const ManifestJob &b){
+        return estimatedCost(a.job) > estimatedCost(b.job);
+    });
+
+    const auto start = std::chrono::steady_clock::now();
+    ExemplarCache exemplars(cacheBytes);
+    EnginePool engines((size_t) workerCount);
+    int failed = invalid;
+    {
+        ThreadPool workers(workerCount);
+        std::mutex reportMutex;
+        std::vector<std::future<void>> done;
+        for(const ManifestJob &manifestJob : jobs){
+            done.push_back(workers.submit([&, manifestJob]{
+                std::string report = runSynthesisJob(manifestJob.job, exemplars, engines);
+                std::lock_guard<std::mutex> lock(reportMutex);
+                if(report.compare(0, 17, "{\"status\":\"error\"") == 0)
+                    failed++;
+                std::cout<<"{\"line\":"<<manifestJob.line<<","<<report.substr(1)<<std::endl;
+            }));
+        }
+        for(auto &job : done)
+            job.get();
+    }
+    rusage usage;
+    getrusage(RUSAGE_SELF, &usage);
+    std::cerr<<jobs.size() + invalid<<" jobs, "<<failed<<" failed, "
+        <<std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count()<<" s, "
+        <<workerCount<<" workers, "<<exemplars.misses()<<" exemplars decoded, "
+        <<"peak memory "<<usage.ru_maxrss / 1024<<" MB"<<std::endl;
+    return failed > 0 ? 1 : 0;
+}
@@ -0,0 +1,210 @@
+/**
+ * @file checkpoint.cpp
+ * @author Letícia Freire Carvalho de Sousa
+ * @brief Implementation of checkpoint.hpp
+ * @version 0.1
+ * @date 2026-10-19
+ *
+ * @copyright Copyright (c) 2024
+ *
+ */
+
+#include "checkpoint.hpp"
+#include <stdexcept>
+#include <cstring>
+#include <cerrno>
+#include <algorithm>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/wait.h>
+
+namespace{
+
+// deflate at the fastest level needs about 300 KiB with the default window and memory level
+constexpr size_t zlibMemory = 1 << 20;
+// compressed bytes written to the file at a time
+constexpr size_t outputBytes = 1 << 18;
+// zlib takes at most 2^32 - 1 bytes at a time
+constexpr size_t maxZlibBytes = 1u << 30;
+
+// memory of the arena not given to zlib yet, nothing is freed before the end of the checkpoint
+struct Arena{
+    char *next;
+    char *end;
+};
+voidpf arenaAlloc(voidpf opaque, uInt items, uInt size){
+    Arena *arena = static_cast<Arena *>(opaque);
+    const size_t bytes = (size_t(items) * size + 15) & ~size_t(15);
+    if(bytes > size_t(arena->end - arena->next))
+        return Z_NULL;
+    voidpf memory = arena->next;
+    arena->next += bytes;
+    return memory;
+}
+void arenaFree(voidpf, voidpf){}
+
+bool writeAll(int fd, const void *data, size_t size){
+    const char *bytes = static_cast<const char *>(data);
+    while(size > 0){
+        ssize_t written = write(fd, bytes, size);
+        if(written < 0){
+            if(errno == EINTR)
+                continue;
+            return false;
+        }
+        bytes += written;
+        size -= (size_t) written;
+    }
+    return true;
+}
+
+// only async-signal-safe calls, it runs in the forked child of a multithreaded process: zlib only gets memory of the arena
+bool writeChunks(const char *file_name, const char *tmp_name, const CheckpointHeader &header, const CheckpointChunks &chunks, char *arena){
+    int fd = open(tmp_name, O_WRONLY | O_CREAT | O_TRUNC, 0644);
+    if(fd < 0)
+        return false;
+    Arena memory{arena, arena + zlibMemory};
+    Bytef *out = reinterpret_cast<Bytef *>(arena + zlibMemory);
+    z_stream stream{};
+    stream.zalloc = arenaAlloc;
+    stream.zfree = arenaFree;
+    stream.opaque = &memory;
+    bool ok = writeAll(fd, &header, sizeof(header)) && deflateInit(&stream, Z_BEST_SPEED) == Z_OK;
+    // the chunk after the last one finishes the stream
+    for(size_t c = 0; ok && c <= chunks.size(); c++){
+        const bool last = c == chunks.size();
+        size_t remaining = last ? 0 : chunks[c].second;
+        stream.next_in = last ? Z_NULL : static_cast<Bytef *>(const_cast<void *>(chunks[c].first));
+        do{
+            const size_t part = std::min(remaining, maxZlibBytes);
+            stream.avail_in = (uInt) part;
+            remaining -= part;
+            do{
+                stream.next_out = out;
+                stream.avail_out = (uInt) outputBytes;
+                ok = deflate(&stream, last ? Z_FINISH : Z_NO_FLUSH) != Z_STREAM_ERROR && writeAll(fd, out, outputBytes - stream.avail_out);
+            } while(ok && stream.avail_out == 0);
+        } while(ok && remaining > 0);
+    }
+    deflateEnd(&stream);
+    ok = fsync(fd) == 0 && ok;
+    ok = close(fd) == 0 && ok;
+    return ok && rename(tmp_name, file_name) == 0;
+}
+
+} // namespace
+
+CheckpointWriter::~CheckpointWriter(){
+    wait();
+}
+
+bool CheckpointWriter::start(const std::string &file_name, const CheckpointHeader &header, const CheckpointChunks &chunks, bool async){
+    bool previous = wait();
+    // the names and the arena are allocated before the fork, the child doesn't allocate
+    std::string tmp_name = file_name + ".tmp";
+    if(arena.empty())
+        arena.resize(zlibMemory + outputBytes);
+    if(async){
+        pid_t pid = fork();
+        if(pid == 0)
+            _exit(writeChunks(file_name.c_str(), tmp_name.c_str(), header, chunks, arena.data()) ? 0 : 1);
+        if(pid > 0){
+            pending = pid;
+            return previous;
+        }
+        // no fork, the checkpoint is written synchronously
+    }
+    return writeChunks(file_name.c_str(), tmp_name.c_str(), header, chunks, arena.data()) && previous;
+}
+
+bool CheckpointWriter::wait(){
+    if(pending < 0)
+        return true;
+    int status;
+    pid_t pid;
+    while((pid = waitpid(pending, &status, 0)) < 0 && errno == EINTR);
+    pending = -1;
+    return pid >= 0 && WIFEXITED(status) && WEXITSTATUS(status) == 0;
+}
+
+CheckpointReader::CheckpointReader(const std::string &file_name)
+    :
+    fileName(file_name) {
+    fd = open(file_name.c_str(), O_RDONLY);
+    if(fd < 0)
+        throw std::runtime_error("Invalid name for checkpoint file " + file_name);
+    // the destructor doesn't run when the constructor throws
+    try{
+        readRaw(&head, sizeof(head));
+        if(std::memcmp(head.magic, checkpointMagic, sizeof(checkpointMagic) - 1) != 0)
+            throw std::runtime_error("Invalid checkpoint file " + file_name);
+        const uint32_t version = head.magic[7] == '\0' ? head.version : uint32_t(head.magic[7] - '0');
+        if(version != checkpointVersion)
+            throw std::runtime_error("Unsupported version " + std::to_string(version) + " of checkpoint file " + file_name);
+        stream = std::make_unique<z_stream>();
+        if(inflateInit(stream.get()) != Z_OK)
+            throw std::runtime_error("Can't initialize zlib");
+    } catch(...){
+        close(fd);
+        throw;
+    }
+    input.resize(1 << 16);
+}
+CheckpointReader::~CheckpointReader(){
+    inflateEnd(stream.get());
+    close(fd);
+}
+
+void CheckpointReader::readRaw(void *data, size_t size){
+    char *bytes = static_cast<char *>(data);
+    while(size > 0){
+        ssize_t got = ::read(fd, bytes, size);
+        if(got < 0 && errno == EINTR)
+            continue;
+        if(got <= 0)
+            throw std::runtime_error("Truncated checkpoint file " + fileName);
+        bytes += got;
+        size -= (size_t) got;
+    }
+}
+
+bool CheckpointReader::refill(){
+    ssize_t got;
+    while((got = ::read(fd, input.data(), input.size())) < 0 && errno == EINTR);
+    stream->next_in = input.data();
+    stream->avail_in = (uInt) std::max<ssize_t>(got, 0);
+    return got > 0;
+}
+
+void CheckpointReader::read(void *data, size_t size){
+    stream->next_out = static_cast<Bytef *>(data);
+    while(size > 0){
+        const size_t part = std::min(size, maxZlibBytes);
+        stream->avail_out = (uInt) part;
+        size -= part;
+        while(stream->avail_out > 0){
+            if(stream->avail_in == 0 && !refill())
+                throw std::runtime_error("Truncated checkpoint file " + fileName);
+            const int status = inflate(stream.get(), Z_NO_FLUSH);
+            if(status == Z_STREAM_END && stream->avail_out > 0)
+                throw std::runtime_error("Truncated checkpoint file " + fileName);
+            if(status != Z_OK && status != Z_STREAM_END)
+                throw std::runtime_error("Invalid checkpoint file " + fileName);
+        }
+    }
+}
+
+void CheckpointReader::finish(){
+    Bytef extra;
+    while(true){
+        stream->next_out = &extra;
+        stream->avail_out = 1;
+        if(stream->avail_in == 0)
+            refill();
+        const int status = inflate(stream.get(), Z_NO_FLUSH);
+        if(status == Z_STREAM_END && stream->avail_out == 1)
+            return;
+        if(status != Z_OK || stream->avail_out == 0)
+            throw std::runtime_error("Invalid checkpoint file " + fileName);
+    }
+}
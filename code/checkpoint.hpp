@@ -0,0 +1,155 @@
+/**
+ * @file checkpoint.hpp
+ * @author Letícia Freire Carvalho de Sousa
+ * @brief Header file of the checkpoint files of the synthesis state
+ * @version 0.1
+ * @date 2026-10-19
+ *
+ * @copyright Copyright (c) 2024
+ *
+ */
+#pragma once
+#include <string>
+#include <memory>
+#include <vector>
+#include <utility>
+#include <cstdint>
+#include <cstddef>
+#include <sys/types.h>
+#include <zlib.h>
+
+/// sections a checkpoint file may have, in the order they are written
+enum CheckpointSection : uint32_t{
+    rngStateSection, ///< text state of the random generator
+    pixelsSection, ///< output image
+    statusSection, ///< pixels status
+    seamsSection, ///< seam costs
+    sourcesSection, ///< source map
+    guideSection, ///< luminance of the target of the guided synthesis
+    layersSection, ///< layers of the material patches, one after the other
+    holeSection, ///< one byte per pixel of the bounding box of the hole, 1 for the pixels of the hole
+    checkpointSectionCount
+};
+
+/**
+ * @brief Header at the start of a checkpoint file, the integers are stored in the byte order of the host
+ *
+ * It is followed by a single zlib stream with the sections whose bit is set in sections, in the order of
+ * CheckpointSection, the grids in the tile layout of their MappedGrid. The pixels not colored are zero in every
+ * grid, so the stream of a partial texture is mostly runs of zeros.
+ */
+struct CheckpointHeader{
+    char magic[8];
+    uint32_t version;
+    uint32_t sections; // bit s is set when the section s is in the file
+    uint64_t sectionBytes[checkpointSectionCount]; // bytes of each section before compression, 0 when absent
+    uint32_t width;
+    uint32_t height;
+    uint64_t rngSeed;
+    uint64_t iterations;
+    uint64_t coveredPixels;
+    uint64_t case2Count;
+    long double seamEnergy;
+    uint32_t cutCost;
+    uint32_t layerCount;
+    uint64_t parallelCutVertices;
+    double guideWeight;
+    int32_t holeTop;
+    int32_t holeLeft;
+    int32_t holeBottom;
+    int32_t holeRight;
+};
+
+/// magic of the checkpoint files, the versions before 4 had their number in the last byte
+constexpr char checkpointMagic[8] = {'G', 'C', 'T', 'C', 'K', 'P', 'T', '\0'};
+
+/// version of the checkpoint files written, the only one that can be read
+constexpr uint32_t checkpointVersion = 4;
+
+/// pieces of memory compressed one after the other after the header of a checkpoint file
+using CheckpointChunks = std::vector<std::pair<const void *, size_t>>;
+
+/**
+ * @brief Writes checkpoint files, at most one at a time
+ *
+ * An asynchronous checkpoint forks the process: the child writes a copy-on-write snapshot of the
+ * memory while the parent goes on, only the pages changed meanwhile are copied by the kernel.
+ * The file is written as file_name + ".tmp" and renamed when complete, so a crash never leaves a
+ * partial checkpoint with the final name. The memory zlib needs is allocated before the fork, the child
+ * doesn't allocate.
+ */
+class CheckpointWriter{
+public:
+    CheckpointWriter() = default;
+    /**
+     * @brief Waits for the pending checkpoint
+     */
+    ~CheckpointWriter();
+    CheckpointWriter(const CheckpointWriter &) = delete;
+    CheckpointWriter &operator=(const CheckpointWriter &) = delete;
+
+    /**
+     * @brief Starts writing a checkpoint, after the pending one is finished
+     *
+     * Time Complexity: O(size of the page tables) when asynchronous, linear on the size of the chunks otherwise
+     *
+     * @param file_name file name of the checkpoint
+     * @param header header of the file, written as it is
+     * @param chunks memory of the sections, compressed with zlib, must not change until the call returns
+     * @param async when true the snapshot is written by a forked child, memory shared with other processes (MAP_SHARED) is not copied on write, so it needs a synchronous checkpoint
+     * @return true if the checkpoint was written (synchronous) or started (asynchronous)
+     */
+    bool start(const std::string &file_name, const CheckpointHeader &header, const CheckpointChunks &chunks, bool async = true);
+
+    /**
+     * @brief Waits for the pending checkpoint
+     *
+     * @return true if there is no pending checkpoint or if it was written
+     */
+    bool wait();
+private:
+    pid_t pending = -1;
+    // memory of the zlib state and the compressed output, reused by every checkpoint
+    std::vector<char> arena;
+};
+
+/**
+ * @brief Reads a checkpoint file chunk by chunk, throws std::runtime_error on invalid files and on other versions
+ */
+class CheckpointReader{
+public:
+    /**
+     * @brief Opens the checkpoint and reads its header
+     *
+     * @param file_name file name of the checkpoint
+     */
+    explicit CheckpointReader(const std::string &file_name);
+    ~CheckpointReader();
+    CheckpointReader(const CheckpointReader &) = delete;
+    CheckpointReader &operator=(const CheckpointReader &) = delete;
+
+    const CheckpointHeader &header() const { return head; }
+
+    /**
+     * @brief Reads and decompresses the next chunk of the file
+     *
+     * @param data memory where the chunk will be read
+     * @param size size of the chunk (in bytes)
+     */
+    void read(void *data, size_t size);
+
+    /**
+     * @brief Checks that the compressed stream ends after the last chunk and that its checksum matches
+     */
+    void finish();
+private:
+    void readRaw(void *data, size_t size);
+    // reads the next compressed bytes, false at the end of the file
+    bool refill();
+
+    std::string fileName;
+    int fd;
+    CheckpointHeader head;
+    std::unique_ptr<z_stream> stream;
+    std::vector<unsigned char> input;
+};
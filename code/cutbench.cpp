@@ -0,0 +1,152 @@
+/**
+ * @file cutbench.cpp
+ * @author Letícia Freire Carvalho de Sousa
+ * @brief Measures the shortest paths of the cuts by Dijkstra against the parallel delta-stepping
+ * @version 0.1
+ * @date 2026-10-19
+ *
+ * @copyright Copyright (c) 2024
+ *
+ * Usage: ./cutbench [threads] [largest side]
+ *
+ * Builds square dual graphs like the ones of the cuts (random finite costs, 1 edge in 20 with the infinite cost of
+ * the edges out of the intersection), from 64 vertices of side to the largest side (1024 by default), with the sources
+ * on the first row and the targets on the last one. For each side it prints the milliseconds of a Dijkstra that stops
+ * at the first target, as the sequential cuts do, and of deltaStepping on pools of 1, 2, 4... up to threads threads
+ * (one per hardware thread by default), the median of 5 runs each. The sides where deltaStepping is faster than
+ * Dijkstra are the ones where ImageTexture::setParallelCutThreshold pays off on this machine.
+ */
+
+#include "deltastepping.hpp"
+#include <iostream>
+#include <iomanip>
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <functional>
+#include <limits>
+#include <queue>
+#include <random>
+#include <thread>
+
+namespace{
+
+// cost of the edges out of the intersection, as inftyCost of imagetexture.cpp
+constexpr long double outsideCost = 10000000;
+
+FlatGraph squareGraph(int side, std::mt19937_64 &rng){
+    static constexpr int directions[4][2] = {{-1, 0}, {0, -1}, {1, 0}, {0, 1}};
+    const int n = side * side;
+    FlatGraph graph;
+    graph.next.assign(n, {-1, -1, -1, -1});
+    graph.cost.assign(n, {0, 0, 0, 0});
+    std::uniform_real_distribution<double> colorCost(0, 200);
+    std::uniform_int_distribution<int> outside(0, 19);
+    for(int i = 0; i < side; i++)
+        for(int j = 0; j < side; j++)
+            for(int d = 0; d < 4; d++){
+                const int a = i + directions[d][0], b = j + directions[d][1];
+                if(a < 0 || b < 0 || a >= side || b >= side)
+                    continue;
+                graph.next[i * side + j][d] = a * side + b;
+                graph.cost[i * side + j][d] = outside(rng) == 0 ? outsideCost : (long double) colorCost(rng);
+            }
+    return graph;
+}
+
+// distance of the closest target, Dijkstra with a binary heap that stops at the first target taken from it
+long double dijkstra(const FlatGraph &graph, const std::vector<int> &sources, const std::vector<char> &isTarget){
+    std::vector<long double> dist(graph.next.size(), std::numeric_limits<long double>::infinity());
+    std::priority_queue<std::pair<long double, int>, std::vector<std::pair<long double, int>>, std::greater<>> queue;
+    for(int s : sources){
+        dist[s] = 0;
+        queue.push({0, s});
+    }
+    while(!queue.empty()){
+        const auto [d, v] = queue.top();
+        queue.pop();
+        if(d > dist[v])
+            continue;
+        if(isTarget[v])
+            return d;
+        for(int k = 0; k < 4; k++){
+            const int w = graph.next[v][k];
+            if(w >= 0 && d + graph.cost[v][k] < dist[w]){
+                dist[w] = d + graph.cost[v][k];
+                queue.push({dist[w], w});
+            }
+        }
+    }
+    return std::numeric_limits<long double>::infinity();
+}
+
+// median of the milliseconds of 5 runs
+double medianMilliseconds(const std::function<void()> &run){
+    std::vector<double> times;
+    for(int k = 0; k < 5; k++){
+        const auto start = std::chrono::steady_clock::now();
+        run();
+        times.push_back(std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count());
+    }
+    std::sort(times.begin(), times.end());
+    return times[times.size() / 2];
+}
+
+} // namespace
+
+int main(int argc, char *argv[]){
+    const int threads = argc > 1 ? std::max(1, atoi(argv[1])) : (int) std::max(1u, std::thread::hardware_concurrency());
+    const int largest = argc > 2 ? std::max(64, atoi(argv[2])) : 1024;
+    std::vector<int> poolSizes;
+    for(int size = 1; size <= threads; size *= 2)
+        poolSizes.push_back(size);
+    if(poolSizes.back() != threads)
+        poolSizes.push_back(threads);
+    std::vector<std::unique_ptr<ThreadPool>> pools;
+    for(int size : poolSizes)
+        pools.push_back(std::make_unique<ThreadPool>(size));
+
+    std::cout<<"vertices     dijkstra";
+    for(int size : poolSizes)
+        std::cout<<std::setw(12)<<("delta x" + std::to_string(size));
+    std::cout<<"  (ms)"<<std::endl;
+    std::mt19937_64 rng(48);
+    for(int side = 64; side <= largest; side *= 2){
+        const FlatGraph graph = squareGraph(side, rng);
+        std::vector<int> sources, targets;
+        std::vector<char> isTarget(graph.next.size(), 0);
+        long double finiteCost = 0;
+        size_t finiteEdges = 0;
+        for(int j = 0; j < side; j++){
+            sources.push_back(j);
+            targets.push_back((side - 1) * side + j);
+            isTarget[targets.back()] = 1;
+        }
+        for(size_t v = 0; v < graph.next.size(); v++)
+            for(int d = 0; d < 4; d++)
+                if(graph.next[v][d] >= 0 && graph.cost[v][d] < outsideCost){
+                    finiteCost += graph.cost[v][d];
+                    finiteEdges++;
+                }
+        // the width of the buckets of ImageTexture::parallelSTPath
+        const long double delta = finiteCost / (long double) finiteEdges;
+        const long double expected = dijkstra(graph, sources, isTarget);
+        std::cout<<std::setw(8)<<graph.next.size()<<std::setw(13)<<std::fixed<<std::setprecision(2)
+            <<medianMilliseconds([&]{ dijkstra(graph, sources, isTarget); });
+        for(const auto &pool : pools){
+            long double found = 0;
+            const double milliseconds = medianMilliseconds([&]{
+                const ShortestPaths paths = deltaStepping(graph, sources, targets, delta, *pool);
+                found = std::numeric_limits<long double>::infinity();
+                for(int t : targets)
+                    found = std::min(found, paths.dist[t]);
+            });
+            std::cout<<std::setw(12)<<milliseconds;
+            if(std::abs(found - expected) > 1e-9L * expected){
+                std::cerr<<std::endl<<"deltaStepping found "<<(double) found<<" instead of "<<(double) expected<<std::endl;
+                return 1;
+            }
+        }
+        std::cout<<std::endl;
+    }
+}
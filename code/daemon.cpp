@@ -0,0 +1,226 @@
+/**
+ * @file daemon.cpp
+ * @author Letícia Freire Carvalho de Sousa
+ * @brief Local synthesis server, runs the jobs received on a Unix domain socket
+ * @version 0.1
+ * @date 2026-10-19
+ *
+ * @copyright Copyright (c) 2024
+ *
+ * Usage: ./daemon [socket file] [workers] [exemplar cache size in MB] [maximum clients]
+ *
+ * Clients send one JSON object per line and receive one JSON object per line, in the same order.
+ * A job is an object as described in synthesisjob.hpp, e.g.
+ *     {"input": "../input_images/areia_input0.png", "output": "../output_images/a.png", "width": 128, "height": 128, "iterations": 50}
+ * ("input" may also be an array of exemplars, and "kind": "video" synthesizes a video), and {"command": "stats"} returns the counters of the server. The jobs of a connection run one at
+ * a time, clients open one connection per concurrent stream of jobs. Each connection has a thread, past the maximum number
+ * of clients (64 by default) a new connection gets {"status":"error","message":"too many clients"} and is closed.
+ * SIGINT or SIGTERM stop the server.
+ */
+
+#include "synthesisjob.hpp"
+#include "threadpool.hpp"
+#include <iostream>
+#include <sstream>
+#include <thread>
+#include <list>
+#include <atomic>
+#include <cstring>
+#include <cerrno>
+#include <csignal>
+#include <poll.h>
+#include <unistd.h>
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <sys/un.h>
+
+namespace{
+
+int stopPipe[2];
+
+void requestStop(int){
+    char c = 0;
+    [[maybe_unused]] ssize_t written = write(stopPipe[1], &c, 1);
+}
+
+bool sendLine(int fd, const std::string &line){
+    std::string data = line + "\n";
+    size_t sent = 0;
+    while(sent < data.size()){
+        ssize_t n = send(fd, data.data() + sent, data.size() - sent, MSG_NOSIGNAL);
+        if(n < 0 && errno == EINTR)
+            continue;
+        if(n <= 0)
+            return false;
+        sent += (size_t) n;
+    }
+    return true;
+}
+
+/**
+ * @brief State shared by the connections: the caches, the pool of workers and the counters
+ */
+struct Server{
+    ExemplarCache exemplars;
+    EnginePool engines;
+    ThreadPool workers;
+    const int maxPending;
+    std::atomic<int> pending{0};
+    std::atomic<uint64_t> jobs{0}, failed{0}, rejected{0};
+
+    Server(int workerCount, size_t cacheBytes)
+        :
+        exemplars(cacheBytes),
+        engines((size_t) workerCount),
+        workers(workerCount),
+        maxPending(4 * workers.size()) {}
+
+    std::string handle(const std::string &line){
+        JsonObject object;
+        try{
+            object = parseJsonObject(line);
+        } catch(const std::exception &e){
+            return "{\"status\":\"error\",\"message\":" + jsonQuote(e.what()) + "}";
+        }
+        if(object.count("command")){
+            if(object["command"].text != "stats")
+                return "{\"status\":\"error\",\"message\":\"unknown command\"}";
+            std::ostringstream stats;
+            stats<<"{\"status\":\"ok\",\"jobs\":"<<jobs<<",\"failed\":"<<failed<<",\"rejected\":"<<rejected
+                <<",\"pending\":"<<pending<<",\"workers\":"<<workers.size()
+                <<",\"exemplarHits\":"<<exemplars.hits()<<",\"exemplarMisses\":"<<exemplars.misses()
+                <<",\"enginesReused\":"<<engines.reused()<<",\"enginesCreated\":"<<engines.created()<<"}";
+            return stats.str();
+        }
+        SynthesisJob job;
+        try{
+            job = parseSynthesisJob(object);
+        } catch(const std::exception &e){
+            failed++;
+            return "{\"status\":\"error\",\"message\":" + jsonQuote(e.what()) + "}";
+        }
+        // the queue is bounded, a client over the limit is told to retry
+        if(pending.fetch_add(1) >= maxPending){
+            pending--;
+            rejected++;
+            return "{\"status\":\"error\",\"message\":\"busy\"}";
+        }
+        std::string response = workers.submit([this, job]{ return runSynthesisJob(job, exemplars, engines); }).get();
+        pending--;
+        jobs++;
+        if(response.compare(0, 17, "{\"status\":\"error\"") == 0)
+            failed++;
+        return response;
+    }
+};
+
+void serveClient(Server &server, int fd){
+    std::string buffer;
+    char chunk[4096];
+    while(true){
+        ssize_t n = recv(fd, chunk, sizeof(chunk), 0);
+        if(n < 0 && errno == EINTR)
+            continue;
+        if(n <= 0)
+            break;
+        buffer.append(chunk, (size_t) n);
+        size_t end;
+        while((end = buffer.find('\n')) != std::string::npos){
+            std::string line = buffer.substr(0, end);
+            buffer.erase(0, end + 1);
+            if(line.find_first_not_of(" \t\r") == std::string::npos)
+                continue;
+            if(!sendLine(fd, server.handle(line)))
+                return;
+        }
+    }
+}
+
+} // namespace
+
+int main(int argc, char *argv[]){
+    std::string socketFile = argc > 1 ? argv[1] : "/tmp/graphcut.sock";
+    int workerCount = argc > 2 ? std::max(1, atoi(argv[2])) : (int) std::max(1u, std::thread::hardware_concurrency());
+    size_t cacheBytes = (size_t) (argc > 3 ? std::max(1, atoi(argv[3])) : 256) << 20;
+    size_t maxClients = (size_t) (argc > 4 ? std::max(1, atoi(argv[4])) : 64);
+
+    if(pipe(stopPipe) != 0){
+        std::cerr<<"Can't create pipe: "<<std::strerror(errno)<<std::endl;
+        return 1;
+    }
+    std::signal(SIGINT, requestStop);
+    std::signal(SIGTERM, requestStop);
+    std::signal(SIGPIPE, SIG_IGN);
+
+    int listener = socket(AF_UNIX, SOCK_STREAM, 0);
+    sockaddr_un address{};
+    address.sun_family = AF_UNIX;
+    if(socketFile.size() >= sizeof(address.sun_path)){
+        std::cerr<<"Socket file name too long"<<std::endl;
+        return 1;
+    }
+    std::strcpy(address.sun_path, socketFile.c_str());
+    struct stat info;
+    if(stat(socketFile.c_str(), &info) == 0 && S_ISSOCK(info.st_mode))
+        unlink(socketFile.c_str());
+    if(listener < 0 || bind(listener, (sockaddr *) &address, sizeof(address)) != 0 || listen(listener, 64) != 0){
+        std::cerr<<"Can't listen on "<<socketFile<<": "<<std::strerror(errno)<<std::endl;
+        return 1;
+    }
+    std::cerr<<"Listening on "<<socketFile<<" with "<<workerCount<<" workers"<<std::endl;
+
+    Server server(workerCount, cacheBytes);
+    // connections are only touched by the main thread, finished ones are joined at the next accept
+    struct Client{
+        int fd;
+        std::atomic<bool> done{false};
+        std::thread thread;
+    };
+    std::list<Client> clients;
+    pollfd fds[2] = {{listener, POLLIN, 0}, {stopPipe[0], POLLIN, 0}};
+    while(true){
+        if(poll(fds, 2, -1) < 0){
+            if(errno == EINTR)
+                continue;
+            break;
+        }
+        if(fds[1].revents)
+            break;
+        if(fds[0].revents & POLLIN){
+            int fd = accept(listener, nullptr, nullptr);
+            if(fd < 0)
+                continue;
+            for(auto it = clients.begin(); it != clients.end();){
+                if(it->done){
+                    it->thread.join();
+                    close(it->fd);
+                    it = clients.erase(it);
+                } else
+                    it++;
+            }
+            // the connection threads are bounded, the clients over the limit are told to come back later
+            if(clients.size() >= maxClients){
+                sendLine(fd, "{\"status\":\"error\",\"message\":\"too many clients\"}");
+                close(fd);
+                continue;
+            }
+            Client &client = clients.emplace_back();
+            client.fd = fd;
+            client.thread = std::thread([&server, &client]{
+                serveClient(server, client.fd);
+                client.done = true;
+            });
+        }
+    }
+
+    // the clients finish their running job and their connections are closed
+    close(listener);
+    unlink(socketFile.c_str());
+    for(auto &client : clients)
+        shutdown(client.fd, SHUT_RD);
+    for(auto &client : clients){
+        client.thread.join();
+        close(client.fd);
+    }
+    std::cerr<<"Stopped after "<<server.jobs<<" jobs"<<std::endl;
+}
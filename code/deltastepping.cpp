@@ -0,0 +1,176 @@
+/**
+ * @file deltastepping.cpp
+ * @author Letícia Freire Carvalho de Sousa
+ * @brief Implementation of deltastepping.hpp
+ * @version 0.1
+ * @date 2026-10-19
+ *
+ * @copyright Copyright (c) 2024
+ *
+ */
+
+#include "deltastepping.hpp"
+#include <algorithm>
+#include <cstdint>
+#include <functional>
+#include <limits>
+#include <utility>
+
+namespace{
+// relaxation of an edge, sent to the task that owns vertex
+struct Request{
+    int vertex;
+    int parent;
+    long double dist;
+};
+constexpr uint64_t notQueued = std::numeric_limits<uint64_t>::max();
+// buckets of the ring of each task, the window of buckets [current, current + ringSlots) that are vectors
+constexpr uint64_t ringSlots = 256;
+// buckets of the vertices of a task: the buckets of the window in a ring, the later ones in the overflow with their bucket
+struct Buckets{
+    std::vector<std::vector<int>> ring = std::vector<std::vector<int>>(ringSlots);
+    std::vector<std::pair<int, uint64_t>> overflow;
+    uint64_t overflowMin = notQueued;
+};
+}
+
+ShortestPaths deltaStepping(const FlatGraph &graph, const std::vector<int> &sources, const std::vector<int> &targets, long double delta, ThreadPool &pool){
+    const int n = (int) graph.next.size();
+    const int tasks = std::max(1, pool.size());
+    ShortestPaths paths{std::vector<long double>(n, std::numeric_limits<long double>::infinity()), std::vector<int>(n, -1)};
+    auto bucketOf = [delta](long double dist){ return (uint64_t) std::min<long double>(dist / delta, (long double) (notQueued / 2)); };
+    // each task owns a block of consecutive vertices, the vertices of the dual graphs are numbered by rows so its
+    // vertices are a band of the graph and most of its requests are to itself
+    const int block = std::max(1, (n + tasks - 1) / tasks);
+    auto owner = [block](int vertex){ return vertex / block; };
+
+    // the buckets of the vertices of each task, and the bucket of the live entry of each vertex (the others are stale)
+    std::vector<Buckets> buckets(tasks);
+    std::vector<uint64_t> queuedIn(n, notQueued);
+    uint64_t current = 0;
+    // requests[from][to] are the relaxations of the task from to the vertices of the task to
+    std::vector<std::vector<std::vector<Request>>> requests(tasks, std::vector<std::vector<Request>>(tasks));
+    // vertices of each task removed from the current bucket, their heavy edges are relaxed once it stays empty
+    std::vector<std::vector<int>> removed(tasks), frontier(tasks);
+
+    // the requests are never closer than the current bucket, the sources are in the bucket 0
+    auto improve = [&](int t, const Request &request){
+        if(!(request.dist < paths.dist[request.vertex]))
+            return;
+        paths.dist[request.vertex] = request.dist;
+        paths.parent[request.vertex] = request.parent;
+        const uint64_t bucket = bucketOf(request.dist);
+        if(queuedIn[request.vertex] != bucket){
+            queuedIn[request.vertex] = bucket;
+            if(bucket < current + ringSlots)
+                buckets[t].ring[bucket % ringSlots].push_back(request.vertex);
+            else{
+                buckets[t].overflow.emplace_back(request.vertex, bucket);
+                buckets[t].overflowMin = std::min(buckets[t].overflowMin, bucket);
+            }
+        }
+    };
+    // moves the live entries of the overflow that the window reached to the ring
+    auto refill = [&](int t){
+        Buckets &own = buckets[t];
+        if(own.overflowMin >= current + ringSlots)
+            return;
+        size_t kept = 0;
+        own.overflowMin = notQueued;
+        for(const auto &[vertex, bucket] : own.overflow){
+            if(queuedIn[vertex] != bucket)
+                continue;
+            if(bucket < current + ringSlots)
+                own.ring[bucket % ringSlots].push_back(vertex);
+            else{
+                own.overflow[kept++] = {vertex, bucket};
+                own.overflowMin = std::min(own.overflowMin, bucket);
+            }
+        }
+        own.overflow.resize(kept);
+    };
+    // runs task(t) for each task, the caller runs the task 0
+    auto parallel = [&pool, tasks](const std::function<void(int)> &task){
+        std::vector<std::future<void>> running;
+        for(int t = 1; t < tasks; t++)
+            running.push_back(pool.submit([&task, t]{ task(t); }));
+        task(0);
+        for(auto &other : running)
+            other.get();
+    };
+    auto relax = [&](int t, const std::vector<int> &vertices, bool light){
+        for(int v : vertices)
+            for(int d = 0; d < 4; d++){
+                const int w = graph.next[v][d];
+                if(w < 0 || (graph.cost[v][d] <= delta) != light)
+                    continue;
+                requests[t][owner(w)].push_back({w, v, paths.dist[v] + graph.cost[v][d]});
+            }
+    };
+    auto apply = [&](int t){
+        for(int from = 0; from < tasks; from++){
+            for(const Request &request : requests[from][t])
+                improve(t, request);
+            requests[from][t].clear();
+        }
+    };
+    auto queued = [&](uint64_t bucket){
+        for(const Buckets &own : buckets)
+            if(!own.ring[bucket % ringSlots].empty())
+                return true;
+        return false;
+    };
+
+    for(int s : sources)
+        improve(owner(s), {s, -1, 0});
+    while(true){
+        // the first bucket of the window with vertices, or the window jumps to the first bucket of the overflow
+        // (the overflow entries are past the window, so none is skipped)
+        const uint64_t windowEnd = current + ringSlots;
+        while(current < windowEnd && !queued(current))
+            current++;
+        if(current == windowEnd){
+            uint64_t first = notQueued;
+            for(const Buckets &own : buckets)
+                first = std::min(first, own.overflowMin);
+            if(first == notQueued)
+                break;
+            current = first;
+        }
+        for(int t = 0; t < tasks; t++)
+            refill(t);
+        if(!queued(current))
+            continue;
+        // the closest target is final once its bucket was emptied
+        long double closest = std::numeric_limits<long double>::infinity();
+        for(int target : targets)
+            closest = std::min(closest, paths.dist[target]);
+        if(closest < std::numeric_limits<long double>::infinity() && bucketOf(closest) < current)
+            break;
+
+        for(int t = 0; t < tasks; t++)
+            removed[t].clear();
+        while(queued(current)){
+            parallel([&](int t){
+                std::vector<int> &bucket = buckets[t].ring[current % ringSlots];
+                frontier[t].clear();
+                for(int v : bucket)
+                    if(queuedIn[v] == current){
+                        queuedIn[v] = notQueued;
+                        frontier[t].push_back(v);
+                    }
+                bucket.clear();
+                relax(t, frontier[t], true);
+                removed[t].insert(removed[t].end(), frontier[t].begin(), frontier[t].end());
+            });
+            parallel(apply);
+        }
+        parallel([&](int t){
+            std::sort(removed[t].begin(), removed[t].end());
+            removed[t].erase(std::unique(removed[t].begin(), removed[t].end()), removed[t].end());
+            relax(t, removed[t], false);
+        });
+        parallel(apply);
+    }
+    return paths;
+}
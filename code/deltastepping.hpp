@@ -0,0 +1,53 @@
+/**
+ * @file deltastepping.hpp
+ * @author Letícia Freire Carvalho de Sousa
+ * @brief Header file of the parallel shortest paths of the large dual graphs of the cuts
+ * @version 0.1
+ * @date 2026-10-19
+ *
+ * @copyright Copyright (c) 2024
+ *
+ */
+#pragma once
+#include "threadpool.hpp"
+#include <array>
+#include <vector>
+
+/**
+ * @brief Flat copy of a dual graph, its vertices are numbered 0 to n - 1 and have up to 4 neighbors
+ */
+struct FlatGraph{
+    std::vector<std::array<int, 4>> next; // neighbor of each vertex in each direction, -1 when there is none
+    std::vector<std::array<long double, 4>> cost; // cost of the edge to each neighbor
+};
+
+/**
+ * @brief Distance from the sources and previous vertex of a shortest path of each vertex
+ */
+struct ShortestPaths{
+    std::vector<long double> dist; // infinity for the vertices not reached
+    std::vector<int> parent; // -1 for the sources and the vertices not reached
+};
+
+/**
+ * @brief Shortest paths from a set of vertices to a set of targets by delta-stepping on all the threads of a pool
+ *
+ * The vertices are kept in buckets of width delta by distance, the buckets are emptied in order. Each vertex belongs to
+ * one task, which alone writes its distance and its buckets: the tasks own blocks of consecutive vertices, relax the
+ * edges of their vertices of the current bucket into requests to the owners of the neighbors, then each owner applies
+ * the requests to its vertices, so there is no lock. The buckets of a task are vectors, a ring of the 256 buckets from
+ * the current one and an overflow list of the later ones (the infinite edges out of the intersection) that is moved to
+ * the ring when the ring reaches it. The edges cheaper than delta are relaxed until the bucket stays empty, the others once.
+ * It stops when the closest target is final, the distances not larger than the one of that target are final, and they
+ * are the same Dijkstra finds, the parents may be other shortest paths.
+ *
+ * Time Complexity: O(n + m + buckets &times; tasks) work, for n vertices and m edges
+ *
+ * @param graph dual graph, the costs are not negative
+ * @param sources vertices at distance 0
+ * @param targets vertices whose distance is wanted
+ * @param delta width of the buckets (positive), around the mean cost of the edges
+ * @param pool pool that runs the tasks, the caller runs one of them
+ * @return ShortestPaths
+ */
+ShortestPaths deltaStepping(const FlatGraph &graph, const std::vector<int> &sources, const std::vector<int> &targets, long double delta, ThreadPool &pool);
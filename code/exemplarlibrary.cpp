@@ -0,0 +1,263 @@
+/**
+ * @file exemplarlibrary.cpp
+ * @author Letícia Freire Carvalho de Sousa
+ * @brief Implementation of exemplarlibrary.hpp
+ * @version 0.1
+ * @date 2026-10-19
+ *
+ * @copyright Copyright (c) 2024
+ *
+ */
+
+#include "exemplarlibrary.hpp"
+#include "sourcemap.hpp"
+#include "pixeltraits.hpp"
+#include <algorithm>
+#include <stdexcept>
+#include <cmath>
+
+namespace{
+
+using Image = png::image<png::rgb_pixel>;
+
+/// position in an image of height &times; width pixels of the pixel that the transform moves to (i, j)
+std::pair<int, int> dihedralSource(int i, int j, int height, int width, ExemplarLibrary::Transform transform){
+    // position in the mirrored image of the pixel that the clockwise rotation moves to (i, j)
+    int a, b;
+    switch(transform % 4){
+        case 0: a = i; b = j; break;
+        case 1: a = height - 1 - j; b = i; break;
+        case 2: a = height - 1 - i; b = width - 1 - j; break;
+        default: a = j; b = width - 1 - i; break;
+    }
+    return {a, transform >= ExemplarLibrary::Transform::mirror ? width - 1 - b : b};
+}
+
+/// the image transformed by one of the 8 symmetries of the square
+Image dihedral(const Image &img, ExemplarLibrary::Transform transform){
+    const int height = (int) img.get_height(), width = (int) img.get_width();
+    const bool swapped = transform % 2 == 1;
+    Image out(swapped ? height : width, swapped ? width : height);
+    for(int i = 0; i < (int) out.get_height(); i++)
+        for(int j = 0; j < (int) out.get_width(); j++){
+            const auto [a, b] = dihedralSource(i, j, height, width, transform);
+            out[i][j] = img[a][b];
+        }
+    return out;
+}
+
+/// position in an image of height &times; width pixels of the pixel (i, j) of its rotation by degrees, cropped to outHeight &times; outWidth
+std::pair<double, double> rotatedSource(double i, double j, int height, int width, int outHeight, int outWidth, double degrees){
+    const double angle = degrees * M_PI / 180.0;
+    const double s = std::sin(angle), c = std::cos(angle);
+    const double centerI = 0.5 * (height - 1), centerJ = 0.5 * (width - 1);
+    // rotating (x, y) counterclockwise finds the source of the pixel, y grows downwards
+    const double x = j - 0.5 * (outWidth - 1), y = i - 0.5 * (outHeight - 1);
+    return {std::clamp(centerI - s * x + c * y, 0.0, height - 1.0), std::clamp(centerJ + c * x + s * y, 0.0, width - 1.0)};
+}
+
+/// the image rotated clockwise by degrees, bilinearly resampled and cropped to the largest rectangle inside the rotated image
+Image rotated(const Image &img, double degrees){
+    const int height = (int) img.get_height(), width = (int) img.get_width();
+    const double angle = degrees * M_PI / 180.0;
+    const double sinA = std::abs(std::sin(angle)), cosA = std::abs(std::cos(angle));
+    const double longSide = std::max(width, height), shortSide = std::min(width, height);
+    double cropWidth, cropHeight;
+    if(shortSide <= 2.0 * sinA * cosA * longSide || std::abs(sinA - cosA) < 1e-10){
+        // the crop touches both long sides of the rotated image
+        double half = 0.5 * shortSide;
+        bool widthIsLonger = width >= height;
+        cropWidth = widthIsLonger ? half / sinA : half / cosA;
+        cropHeight = widthIsLonger ? half / cosA : half / sinA;
+    } else{
+        double cos2A = cosA * cosA - sinA * sinA;
+        cropWidth = (width * cosA - height * sinA) / cos2A;
+        cropHeight = (height * cosA - width * sinA) / cos2A;
+    }
+    Image out((size_t) std::max(1, (int) std::floor(cropWidth)), (size_t) std::max(1, (int) std::floor(cropHeight)));
+    for(int i = 0; i < (int) out.get_height(); i++)
+        for(int j = 0; j < (int) out.get_width(); j++){
+            const auto [srcI, srcJ] = rotatedSource(i, j, height, width, (int) out.get_height(), (int) out.get_width(), degrees);
+            int i0 = std::min((int) srcI, height - 1), j0 = std::min((int) srcJ, width - 1);
+            int i1 = std::min(i0 + 1, height - 1), j1 = std::min(j0 + 1, width - 1);
+            double di = srcI - i0, dj = srcJ - j0;
+            auto blend = [&](png::byte png::rgb_pixel::*channel){
+                double top = (1 - dj) * img[i0][j0].*channel + dj * img[i0][j1].*channel;
+                double bottom = (1 - dj) * img[i1][j0].*channel + dj * img[i1][j1].*channel;
+                return png::byte(std::lround((1 - di) * top + di * bottom));
+            };
+            out[i][j] = png::rgb_pixel(blend(&png::rgb_pixel::red), blend(&png::rgb_pixel::green), blend(&png::rgb_pixel::blue));
+        }
+    return out;
+}
+
+/// the image with the mean of each block of factor &times; factor pixels, the incomplete blocks of the border are dropped
+Image boxDownsampled(const Image &img, int factor){
+    const int height = std::max(1, (int) img.get_height() / factor), width = std::max(1, (int) img.get_width() / factor);
+    const int blockHeight = std::min(factor, (int) img.get_height()), blockWidth = std::min(factor, (int) img.get_width());
+    Image out(width, height);
+    for(int i = 0; i < height; i++)
+        for(int j = 0; j < width; j++){
+            int sum[3] = {0, 0, 0};
+            for(int di = 0; di < blockHeight; di++)
+                for(int dj = 0; dj < blockWidth; dj++){
+                    const png::rgb_pixel &p = img[factor * i + di][factor * j + dj];
+                    sum[0] += p.red;
+                    sum[1] += p.green;
+                    sum[2] += p.blue;
+                }
+            const int count = blockHeight * blockWidth;
+            out[i][j] = png::rgb_pixel(png::byte((sum[0] + count / 2) / count), png::byte((sum[1] + count / 2) / count), png::byte((sum[2] + count / 2) / count));
+        }
+    return out;
+}
+
+} // namespace
+
+ExemplarLibrary::ExemplarLibrary(const std::vector<const png::image<png::rgb_pixel> *> &exemplars, unsigned transforms, const std::vector<double> &angles){
+    for(const png::image<png::rgb_pixel> *exemplar : exemplars)
+        // not owned, the deleter does nothing
+        addVariants(std::shared_ptr<const png::image<png::rgb_pixel>>(exemplar, [](const png::image<png::rgb_pixel> *){}), transforms, angles);
+}
+ExemplarLibrary::ExemplarLibrary(const std::vector<std::string> &file_names, unsigned transforms, const std::vector<double> &angles){
+    for(const std::string &file_name : file_names)
+        addVariants(std::make_shared<const png::image<png::rgb_pixel>>(readImage(file_name)), transforms, angles);
+}
+ExemplarLibrary::ExemplarLibrary(const std::vector<const png::image<png::gray_pixel_16> *> &exemplars, unsigned transforms, const std::vector<double> &angles){
+    addGray(exemplars, transforms, angles);
+}
+ExemplarLibrary::ExemplarLibrary(const std::vector<const png::image<png::gray_pixel> *> &exemplars, unsigned transforms, const std::vector<double> &angles){
+    addGray(exemplars, transforms, angles);
+}
+
+/**
+ * @brief adds the variants of grayscale exemplars, their rgb pixels rounded to 8 bits and their 16 bit samples
+ *
+ * The samples of each variant are those of the positions of its pixels in the exemplar (see sourcePosition).
+ */
+template<typename Gray>
+void ExemplarLibrary::addGray(const std::vector<const png::image<Gray> *> &exemplars, unsigned transforms, const std::vector<double> &angles){
+    constexpr int unit = PixelTraits<Gray>::unit;
+    for(const png::image<Gray> *exemplar : exemplars){
+        const int height = (int) exemplar->get_height(), width = (int) exemplar->get_width();
+        auto rgb = std::make_shared<png::image<png::rgb_pixel>>(width, height);
+        for(int i = 0; i < height; i++)
+            for(int j = 0; j < width; j++){
+                const png::byte level = (png::byte) ((PixelTraits<Gray>::channel((*exemplar)[i][j], 0) + unit / 2) / unit);
+                (*rgb)[i][j] = png::rgb_pixel(level, level, level);
+            }
+        const size_t first = entries.size();
+        addVariants(rgb, transforms, angles);
+        // the image isn't kept by the caller, the entries of the identity own it
+        for(size_t e = first; e < entries.size(); e++){
+            std::vector<uint16_t> samples((size_t) entries[e].width * entries[e].height);
+            for(int i = 0; i < entries[e].height; i++)
+                for(int j = 0; j < entries[e].width; j++){
+                    const auto [row, col] = sourcePosition(e, i, j);
+                    samples[(size_t) i * entries[e].width + j] = (uint16_t) (unit * PixelTraits<Gray>::channel((*exemplar)[row][col], 0));
+                }
+            setSamples(entries[e], std::move(samples));
+        }
+    }
+}
+
+/// keeps the samples of the entry and their variance
+void ExemplarLibrary::setSamples(Entry &entry, std::vector<uint16_t> samples){
+    double sum = 0, sumSquares = 0;
+    for(uint16_t sample : samples){
+        const double level = sample / 257.0;
+        sum += level;
+        sumSquares += level * level;
+    }
+    const double count = std::max<double>(1, (double) samples.size());
+    const double mean = sum / count;
+    entry.sampleVariance = std::max(1.0, sumSquares / count - mean * mean);
+    entry.samples = std::move(samples);
+}
+
+std::pair<int, int> ExemplarLibrary::sourcePosition(size_t i, int row, int col, int scale) const{
+    const Entry &entry = entries[i];
+    const int height = entry.sourceHeight * scale, width = entry.sourceWidth * scale;
+    if(std::fpclassify(entry.angle) == FP_ZERO){
+        const auto [a, b] = dihedralSource(row, col, height, width, entry.transform);
+        return {std::clamp(a, 0, height - 1), std::clamp(b, 0, width - 1)};
+    }
+    // the rotation of the scaled exemplar is about the scaled center, the crop is scaled as well
+    const auto [a, b] = rotatedSource(row, col, height, width, entry.height * scale, entry.width * scale, entry.angle);
+    return {std::clamp((int) std::lround(a), 0, height - 1), std::clamp((int) std::lround(b), 0, width - 1)};
+}
+
+void ExemplarLibrary::addVariants(std::shared_ptr<const png::image<png::rgb_pixel>> image, unsigned transforms, const std::vector<double> &angles){
+    const size_t source = sources++;
+    const int sourceWidth = (int) image->get_width(), sourceHeight = (int) image->get_height();
+    for(int t = Transform::identity; t <= Transform::mirrorRotate270; t++){
+        if(!(transforms & (1u << t)))
+            continue;
+        const Transform transform = (Transform) t;
+        if(transform == Transform::identity)
+            add(image, source, transform, 0, sourceWidth, sourceHeight);
+        else
+            add(std::make_shared<const png::image<png::rgb_pixel>>(dihedral(*image, transform)), source, transform, 0, sourceWidth, sourceHeight);
+    }
+    for(double angle : angles)
+        add(std::make_shared<const png::image<png::rgb_pixel>>(rotated(*image, angle)), source, Transform::identity, angle, sourceWidth, sourceHeight);
+}
+
+void ExemplarLibrary::add(std::shared_ptr<const png::image<png::rgb_pixel>> image, size_t source, Transform transform, double angle, int sourceWidth, int sourceHeight){
+    // the source map keeps the rows and columns of the exemplars in 16 bits
+    if((int64_t) image->get_width() > maxExemplarSide || (int64_t) image->get_height() > maxExemplarSide)
+        throw std::runtime_error("The exemplars of a library can't be larger than " + std::to_string(maxExemplarSide) + " pixels on a side");
+    Entry entry;
+    entry.source = source;
+    entry.transform = transform;
+    entry.angle = angle;
+    entry.width = (int) image->get_width();
+    entry.height = (int) image->get_height();
+    entry.sourceWidth = sourceWidth;
+    entry.sourceHeight = sourceHeight;
+    entry.pixels.resize((size_t) entry.width * entry.height * 3);
+    double sum = 0, sumSquares = 0;
+    png::byte *out = entry.pixels.data();
+    for(int i = 0; i < entry.height; i++)
+        for(int j = 0; j < entry.width; j++){
+            const png::rgb_pixel &p = (*image)[i][j];
+            for(png::byte channel : {p.red, p.green, p.blue}){
+                *out++ = channel;
+                sum += channel;
+                sumSquares += (double) channel * channel;
+            }
+        }
+    double samples = std::max<double>(1, (double) entry.pixels.size());
+    double mean = sum / samples;
+    entry.variance = std::max(1.0, sumSquares / samples - mean * mean);
+    entry.gradients = GradientPlanes(*image);
+    entry.image = std::move(image);
+    entries.push_back(std::move(entry));
+}
+
+ExemplarLibrary ExemplarLibrary::downsampled(int factor) const{
+    ExemplarLibrary library;
+    library.sources = sources;
+    factor = std::max(1, factor);
+    for(const Entry &entry : entries){
+        library.add(std::make_shared<const png::image<png::rgb_pixel>>(boxDownsampled(*entry.image, factor)), entry.source, entry.transform, entry.angle,
+            std::max(1, entry.sourceWidth / factor), std::max(1, entry.sourceHeight / factor));
+        if(entry.samples.empty())
+            continue;
+        // the mean of the same blocks as boxDownsampled
+        Entry &small = library.entries.back();
+        const int blockHeight = std::min(factor, entry.height), blockWidth = std::min(factor, entry.width);
+        std::vector<uint16_t> samples((size_t) small.width * small.height);
+        for(int i = 0; i < small.height; i++)
+            for(int j = 0; j < small.width; j++){
+                uint64_t sum = 0;
+                for(int di = 0; di < blockHeight; di++)
+                    for(int dj = 0; dj < blockWidth; dj++)
+                        sum += entry.samples[(size_t) (factor * i + di) * entry.width + factor * j + dj];
+                const uint64_t count = (uint64_t) blockHeight * blockWidth;
+                samples[(size_t) i * small.width + j] = (uint16_t) ((sum + count / 2) / count);
+            }
+        library.setSamples(small, std::move(samples));
+    }
+    return library;
+}
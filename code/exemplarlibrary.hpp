@@ -0,0 +1,201 @@
+/**
+ * @file exemplarlibrary.hpp
+ * @author Letícia Freire Carvalho de Sousa
+ * @brief Header file of the library of exemplars from which the patch fitting chooses each patch
+ * @version 0.1
+ * @date 2026-10-19
+ *
+ * @copyright Copyright (c) 2024
+ *
+ */
+#pragma once
+#include <png++/png.hpp>
+#include "imagecodec.hpp"
+#include "gradientplanes.hpp"
+#include <string>
+#include <vector>
+#include <memory>
+#include <utility>
+#include <cstdint>
+
+/**
+ * @brief Exemplars of a texture with the data used by the matching, computed once when they are added
+ *
+ * Each exemplar keeps its pixels packed in rgb bytes (row after row), so the matching cost of a position
+ * reads contiguous memory, the variance of its colors, which normalizes the cost so exemplars of
+ * different contrast can be compared, and its gradient planes. The library never changes after it is constructed, so it can be
+ * shared by concurrent patch fittings.
+ *
+ * Rotated and mirrored variants of the exemplars can be added as exemplars of their own. They are
+ * transformed once, with their packed pixels and variance, when the library is constructed.
+ *
+ * A library of grayscale exemplars (8 or 16 bit) also keeps their samples at 16 bits, an 8 bit sample v as 257 v.
+ * The matching and the cuts of ImageTexture read them instead of the rgb pixels, which are the samples rounded to 8
+ * bits, so the costs of 16 bit height maps don't go through 8 bits.
+ */
+class ExemplarLibrary{
+public:
+    /// The 8 symmetries of the square, the rotations are clockwise and the mirrored ones flip the columns before rotating
+    enum Transform : uint8_t{
+        identity,
+        rotate90,
+        rotate180,
+        rotate270,
+        mirror,
+        mirrorRotate90,
+        mirrorRotate180,
+        mirrorRotate270
+    };
+    /// mask of the transforms with only the exemplars as given
+    static constexpr unsigned identityOnly = 1u << Transform::identity;
+    /// mask of all the 8 transforms
+    static constexpr unsigned allTransforms = 0xffu;
+
+    /**
+     * @brief Construct a new Exemplar Library object from decoded images
+     *
+     * The images are not copied, they must outlive the library. Throws std::runtime_error if an exemplar or one of
+     * its variants has more than maxExemplarSide rows or columns (the source map keeps them in 16 bits).
+     *
+     * Time Complexity: linear on the number of pixels of the exemplars
+     *
+     * @param exemplars images of the exemplars
+     * @param transforms mask of the transforms (1 &lt;&lt; Transform) whose variants of each exemplar are in the library
+     * @param angles other rotations (clockwise, in degrees) of each exemplar, resampled bilinearly and cropped to the largest rectangle with no border
+     */
+    explicit ExemplarLibrary(const std::vector<const png::image<png::rgb_pixel> *> &exemplars, unsigned transforms = identityOnly, const std::vector<double> &angles = {});
+
+    /**
+     * @brief Construct a new Exemplar Library object from image files
+     *
+     * Time Complexity: linear on the number of pixels of the exemplars
+     *
+     * @param file_names file names of the exemplars (png, ppm, qoi or raw), throws png::error if one can't be read and
+     * std::runtime_error if one is larger than maxExemplarSide
+     * @param transforms mask of the transforms (1 &lt;&lt; Transform) whose variants of each exemplar are in the library
+     * @param angles other rotations (clockwise, in degrees) of each exemplar
+     */
+    explicit ExemplarLibrary(const std::vector<std::string> &file_names, unsigned transforms = identityOnly, const std::vector<double> &angles = {});
+
+    /**
+     * @brief Construct a new Exemplar Library object from 16 bit grayscale images, with their samples
+     *
+     * The rgb pixels of each exemplar are its samples rounded to 8 bits. The images are not kept.
+     *
+     * Time Complexity: linear on the number of pixels of the exemplars
+     *
+     * @param exemplars images of the exemplars
+     * @param transforms mask of the transforms (1 &lt;&lt; Transform) whose variants of each exemplar are in the library
+     * @param angles other rotations (clockwise, in degrees) of each exemplar, their samples are the nearest ones
+     */
+    explicit ExemplarLibrary(const std::vector<const png::image<png::gray_pixel_16> *> &exemplars, unsigned transforms = identityOnly, const std::vector<double> &angles = {});
+
+    /**
+     * @brief Construct a new Exemplar Library object from 8 bit grayscale images, with their samples
+     *
+     * Time Complexity: linear on the number of pixels of the exemplars
+     *
+     * @param exemplars images of the exemplars
+     * @param transforms mask of the transforms (1 &lt;&lt; Transform) whose variants of each exemplar are in the library
+     * @param angles other rotations (clockwise, in degrees) of each exemplar, their samples are the nearest ones
+     */
+    explicit ExemplarLibrary(const std::vector<const png::image<png::gray_pixel> *> &exemplars, unsigned transforms = identityOnly, const std::vector<double> &angles = {});
+
+    /// number of exemplars, including the transformed variants
+    size_t size() const { return entries.size(); }
+
+    /// number of exemplars given to the constructor
+    size_t sourceCount() const { return sources; }
+
+    /// index of the exemplar, as given to the constructor, from which the exemplar i was transformed
+    size_t source(size_t i) const { return entries[i].source; }
+
+    /// transform of the source exemplar that gives the exemplar i (identity for the rotations by angles)
+    Transform transform(size_t i) const { return entries[i].transform; }
+
+    /// rotation angle of the source exemplar that gives the exemplar i, zero for the 8 transforms
+    double angle(size_t i) const { return entries[i].angle; }
+
+    /// image of the exemplar i
+    const png::image<png::rgb_pixel> &image(size_t i) const { return *entries[i].image; }
+
+    /// width of the exemplar i
+    int width(size_t i) const { return entries[i].width; }
+
+    /// height of the exemplar i
+    int height(size_t i) const { return entries[i].height; }
+
+    /// rgb bytes of the exemplar i, row after row
+    const png::byte *pixels(size_t i) const { return entries[i].pixels.data(); }
+
+    /// variance of the color channels of the exemplar i (at least 1, so flat exemplars can be compared)
+    double variance(size_t i) const { return entries[i].variance; }
+
+    /// gradients of the pixels of the exemplar i, read by the gradient normalized cut cost
+    const GradientPlanes &gradients(size_t i) const { return entries[i].gradients; }
+
+    /// the exemplars are grayscale and have their 16 bit samples
+    bool hasSamples() const { return !entries.empty() && !entries[0].samples.empty(); }
+
+    /// 16 bit samples of the exemplar i, row after row (only if hasSamples)
+    const uint16_t *samples(size_t i) const { return entries[i].samples.data(); }
+
+    /// variance of the samples of the exemplar i in steps of 8 bits (at least 1, only if hasSamples)
+    double sampleVariance(size_t i) const { return entries[i].sampleVariance; }
+
+    /**
+     * @brief Position in the exemplar given to the constructor of a pixel of the exemplar i
+     *
+     * The positions can be of versions of the exemplars scale times larger (other channels of a material at a higher
+     * resolution), the pixel (row, col) is then of the exemplar i scaled. The pixels of the rotations by angles get the
+     * nearest pixel of the rotated position.
+     *
+     * Time Complexity: O(1)
+     *
+     * @param i index of the exemplar
+     * @param row row of the pixel in the exemplar i (scaled)
+     * @param col column of the pixel in the exemplar i (scaled)
+     * @param scale scale of the exemplars whose positions are computed
+     * @return std::pair<int, int> row and column of the pixel in the exemplar source(i) (scaled), clamped to it
+     */
+    std::pair<int, int> sourcePosition(size_t i, int row, int col, int scale = 1) const;
+
+    /**
+     * @brief Library with the exemplars downsampled by a factor, in the same order
+     *
+     * A pixel of a downsampled exemplar is the mean of a block of factor &times; factor pixels, so the pixel (i, j)
+     * covers the pixels (factor &times; i + di, factor &times; j + dj) of the exemplar, for 0 &le; di, dj &lt; factor
+     *
+     * Time Complexity: linear on the number of pixels of the exemplars
+     *
+     * @param factor downsampling factor of both dimensions
+     * @return ExemplarLibrary the downsampled library, its exemplars have at least one pixel (and their samples)
+     */
+    ExemplarLibrary downsampled(int factor) const;
+private:
+    struct Entry{
+        std::shared_ptr<const png::image<png::rgb_pixel>> image;
+        size_t source;
+        Transform transform;
+        double angle;
+        int width;
+        int height;
+        int sourceWidth;
+        int sourceHeight;
+        std::vector<png::byte> pixels;
+        double variance;
+        GradientPlanes gradients;
+        std::vector<uint16_t> samples;
+        double sampleVariance = 1;
+    };
+    std::vector<Entry> entries;
+    size_t sources = 0;
+
+    ExemplarLibrary() = default;
+
+    void addVariants(std::shared_ptr<const png::image<png::rgb_pixel>> image, unsigned transforms, const std::vector<double> &angles);
+    void add(std::shared_ptr<const png::image<png::rgb_pixel>> image, size_t source, Transform transform, double angle, int sourceWidth, int sourceHeight);
+    template<typename Gray>
+    void addGray(const std::vector<const png::image<Gray> *> &exemplars, unsigned transforms, const std::vector<double> &angles);
+    void setSamples(Entry &entry, std::vector<uint16_t> samples);
+};
@@ -0,0 +1,28 @@
+/**
+ * @file gradientplanes.cpp
+ * @author Letícia Freire Carvalho de Sousa
+ * @brief Implementation of gradientplanes.hpp
+ * @version 0.1
+ * @date 2026-10-19
+ *
+ * @copyright Copyright (c) 2024
+ *
+ */
+
+#include "gradientplanes.hpp"
+#include "pixeltraits.hpp"
+
+GradientPlanes::GradientPlanes(const png::image<png::rgb_pixel> &img)
+    :
+    imgWidth((int) img.get_width()),
+    imgHeight((int) img.get_height()),
+    values((size_t) imgWidth * imgHeight, {0, 0}) {
+    for(int i = 0; i < imgHeight; i++)
+        for(int j = 0; j < imgWidth; j++){
+            std::array<float, 2> &gradient = values[(size_t) i * imgWidth + j];
+            if(imgWidth > 1)
+                gradient[0] = (float) (j + 1 < imgWidth ? colorDistance(img[i][j], img[i][j + 1]) : colorDistance(img[i][j - 1], img[i][j]));
+            if(imgHeight > 1)
+                gradient[1] = (float) (i + 1 < imgHeight ? colorDistance(img[i][j], img[i + 1][j]) : colorDistance(img[i - 1][j], img[i][j]));
+        }
+}
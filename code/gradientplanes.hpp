@@ -0,0 +1,48 @@
+/**
+ * @file gradientplanes.hpp
+ * @author Letícia Freire Carvalho de Sousa
+ * @brief Header file of the gradient planes of an image, used by the gradient normalized cut cost
+ * @version 0.1
+ * @date 2026-10-19
+ *
+ * @copyright Copyright (c) 2024
+ *
+ */
+#pragma once
+#include <png++/png.hpp>
+#include <vector>
+#include <array>
+
+/**
+ * @brief Magnitude of the gradient of each pixel of an image along the rows and along the columns
+ *
+ * The gradient of a pixel along a direction is the color distance to its next pixel in that direction
+ * (to its previous pixel on the last column or row), so the gradients of a cut edge are read, not computed.
+ */
+class GradientPlanes{
+public:
+    /// empty planes
+    GradientPlanes() = default;
+
+    /**
+     * @brief Construct the gradient planes of an image
+     *
+     * Time Complexity: linear on the number of pixels of the image
+     *
+     * @param img image whose gradients are computed
+     */
+    explicit GradientPlanes(const png::image<png::rgb_pixel> &img);
+
+    /// width of the image
+    int width() const { return imgWidth; }
+
+    /// height of the image
+    int height() const { return imgHeight; }
+
+    /// gradients of the pixel (i, j), [0] along the row (to the right neighbor) and [1] along the column (to the lower neighbor)
+    const std::array<float, 2> &at(int i, int j) const { return values[(size_t) i * imgWidth + j]; }
+private:
+    int imgWidth = 0;
+    int imgHeight = 0;
+    std::vector<std::array<float, 2>> values;
+};
@@ -0,0 +1,413 @@
+/**
+ * @file imagecodec.cpp
+ * @author Letícia Freire Carvalho de Sousa
+ * @brief Implementation of imagecodec.hpp
+ * @version 0.1
+ * @date 2026-10-19
+ *
+ * @copyright Copyright (c) 2024
+ *
+ */
+
+#include "imagecodec.hpp"
+#include "pngstream.hpp"
+#include <map>
+#include <memory>
+#include <mutex>
+#include <vector>
+#include <cstdio>
+#include <cstring>
+#include <cstdint>
+#include <limits>
+#include <cctype>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+namespace{
+
+/// closes the FILE when leaving the scope
+struct FileCloser{
+    void operator()(FILE *file) const { fclose(file); }
+};
+using FilePtr = std::unique_ptr<FILE, FileCloser>;
+
+FilePtr openFile(const std::string &file_name, const char *mode){
+    FilePtr file(fopen(file_name.c_str(), mode));
+    if(!file)
+        throw png::error("Invalid name for image file " + file_name);
+    return file;
+}
+
+void writeBytes(FILE *file, const void *data, size_t size, const std::string &file_name){
+    if(fwrite(data, 1, size, file) != size)
+        throw png::error("Can't write image file " + file_name);
+}
+
+void closeWritten(FilePtr &file, const std::string &file_name){
+    if(fclose(file.release()) != 0)
+        throw png::error("Can't write image file " + file_name);
+}
+
+// bytes of the pixels of a width x height image read from a file, throws if the image is empty, if the size
+// overflows or if the file has less than available bytes of pixels
+size_t pixelBytes(uint64_t width, uint64_t height, size_t bytesPerPixel, uint64_t available, const std::string &file_name){
+    if(width == 0 || height == 0 || width > std::numeric_limits<uint32_t>::max() || height > std::numeric_limits<uint32_t>::max())
+        throw png::error("Invalid image size in " + file_name);
+    if(width > SIZE_MAX / bytesPerPixel / height)
+        throw png::error("Image too large in " + file_name);
+    const size_t bytes = size_t(width) * height * bytesPerPixel;
+    if(bytes > available)
+        throw png::error("Truncated image file " + file_name);
+    return bytes;
+}
+
+// bytes of a file after its current position
+uint64_t remainingBytes(FILE *file, const std::string &file_name){
+    struct stat info;
+    long position = ftell(file);
+    if(position < 0 || fstat(fileno(file), &info) != 0 || info.st_size < position)
+        throw png::error("Can't read image file " + file_name);
+    return uint64_t(info.st_size - position);
+}
+
+// ---------------------------------------------------------------- png
+
+png::image<png::rgb_pixel> readPng(const std::string &file_name){
+    return png::image<png::rgb_pixel>(file_name);
+}
+
+void writePng(const std::string &file_name, int width, int height, const RowReader &getRow, int compressionLevel){
+    writePngParallel(file_name, width, height, getRow, compressionLevel);
+}
+
+// ---------------------------------------------------------------- ppm
+
+// skips whitespaces and # comments of a PPM header, then reads a decimal number
+int readPpmNumber(FILE *file, const std::string &file_name){
+    int c = fgetc(file);
+    while(c != EOF && (isspace(c) || c == '#')){
+        if(c == '#')
+            while(c != EOF && c != '\n')
+                c = fgetc(file);
+        c = fgetc(file);
+    }
+    if(c == EOF || !isdigit(c))
+        throw png::error("Invalid PPM header in " + file_name);
+    long long value = 0;
+    while(c != EOF && isdigit(c)){
+        value = value * 10 + (c - '0');
+        if(value > (1 << 30))
+            throw png::error("Invalid PPM header in " + file_name);
+        c = fgetc(file);
+    }
+    // a single whitespace separates the header from the pixels
+    if(c != EOF && !isspace(c))
+        ungetc(c, file);
+    return (int) value;
+}
+
+png::image<png::rgb_pixel> readPpm(const std::string &file_name){
+    FilePtr file = openFile(file_name, "rb");
+    if(fgetc(file.get()) != 'P' || fgetc(file.get()) != '6')
+        throw png::error("Only binary PPM (P6) files are supported: " + file_name);
+    int width = readPpmNumber(file.get(), file_name);
+    int height = readPpmNumber(file.get(), file_name);
+    int maxValue = readPpmNumber(file.get(), file_name);
+    if(maxValue <= 0 || maxValue > 65535)
+        throw png::error("Invalid PPM maximum value in " + file_name);
+    int bytesPerSample = maxValue > 255 ? 2 : 1;
+    pixelBytes(width, height, 3 * bytesPerSample, remainingBytes(file.get(), file_name), file_name);
+    png::image<png::rgb_pixel> img(width, height);
+    std::vector<png::byte> row(size_t(width) * 3 * bytesPerSample);
+    for(int i = 0; i < height; i++){
+        if(fread(row.data(), 1, row.size(), file.get()) != row.size())
+            throw png::error("Truncated PPM file " + file_name);
+        for(int j = 0; j < width; j++){
+            png::byte rgb[3];
+            for(int c = 0; c < 3; c++){
+                unsigned value = bytesPerSample == 1 ? row[j * 3 + c] : (unsigned(row[(j * 3 + c) * 2]) << 8) | row[(j * 3 + c) * 2 + 1];
+                rgb[c] = (png::byte) ((value * 255 + maxValue / 2) / maxValue);
+            }
+            img[i][j] = png::rgb_pixel(rgb[0], rgb[1], rgb[2]);
+        }
+    }
+    return img;
+}
+
+void writePpm(const std::string &file_name, int width, int height, const RowReader &getRow, int){
+    static_assert(sizeof(png::rgb_pixel) == 3, "rows are written as packed rgb bytes");
+    FilePtr file = openFile(file_name, "wb");
+    std::string header = "P6\n" + std::to_string(width) + " " + std::to_string(height) + "\n255\n";
+    writeBytes(file.get(), header.data(), header.size(), file_name);
+    std::vector<png::rgb_pixel> row(width);
+    for(int i = 0; i < height; i++){
+        getRow(i, row.data());
+        writeBytes(file.get(), row.data(), row.size() * 3, file_name);
+    }
+    closeWritten(file, file_name);
+}
+
+// ---------------------------------------------------------------- qoi
+
+// "Quite OK Image" format, see https://qoiformat.org/qoi-specification.pdf
+constexpr png::byte qoiOpIndex = 0x00;
+constexpr png::byte qoiOpDiff = 0x40;
+constexpr png::byte qoiOpLuma = 0x80;
+constexpr png::byte qoiOpRun = 0xc0;
+constexpr png::byte qoiOpRgb = 0xfe;
+constexpr png::byte qoiOpRgba = 0xff;
+constexpr png::byte qoiMask = 0xc0;
+constexpr png::byte qoiEnd[8] = {0, 0, 0, 0, 0, 0, 0, 1};
+
+struct QoiPixel{
+    png::byte r = 0, g = 0, b = 0, a = 255;
+    bool operator==(const QoiPixel &o) const { return r == o.r && g == o.g && b == o.b && a == o.a; }
+    int hash() const { return (r * 3 + g * 5 + b * 7 + a * 11) & 63; }
+};
+
+void putBigEndian(std::vector<png::byte> &out, uint32_t value){
+    for(int shift = 24; shift >= 0; shift -= 8)
+        out.push_back(png::byte(value >> shift));
+}
+uint32_t getBigEndian(const png::byte *data){
+    return (uint32_t(data[0]) << 24) | (uint32_t(data[1]) << 16) | (uint32_t(data[2]) << 8) | uint32_t(data[3]);
+}
+
+png::image<png::rgb_pixel> readQoi(const std::string &file_name){
+    FilePtr file = openFile(file_name, "rb");
+    std::vector<png::byte> data;
+    png::byte buffer[1 << 16];
+    size_t read;
+    while((read = fread(buffer, 1, sizeof(buffer), file.get())) > 0)
+        data.insert(data.end(), buffer, buffer + read);
+    if(data.size() < 14 + sizeof(qoiEnd) || std::memcmp(data.data(), "qoif", 4) != 0)
+        throw png::error("Invalid QOI file " + file_name);
+    uint32_t width = getBigEndian(&data[4]);
+    uint32_t height = getBigEndian(&data[8]);
+    if(width == 0 || height == 0 || width > (1u << 30) / height)
+        throw png::error("Invalid QOI size in " + file_name);
+    png::image<png::rgb_pixel> img(width, height);
+    QoiPixel index[64];
+    QoiPixel px;
+    size_t pos = 14, end = data.size() - sizeof(qoiEnd);
+    int run = 0;
+    for(uint32_t i = 0; i < height; i++){
+        for(uint32_t j = 0; j < width; j++){
+            if(run > 0){
+                run--;
+            } else if(pos < end){
+                png::byte op = data[pos++];
+                if(op == qoiOpRgb){
+                    px.r = data[pos]; px.g = data[pos + 1]; px.b = data[pos + 2];
+                    pos += 3;
+                } else if(op == qoiOpRgba){
+                    px.r = data[pos]; px.g = data[pos + 1]; px.b = data[pos + 2]; px.a = data[pos + 3];
+                    pos += 4;
+                } else if((op & qoiMask) == qoiOpIndex){
+                    px = index[op];
+                } else if((op & qoiMask) == qoiOpDiff){
+                    px.r = png::byte(px.r + ((op >> 4) & 3) - 2);
+                    px.g = png::byte(px.g + ((op >> 2) & 3) - 2);
+                    px.b = png::byte(px.b + (op & 3) - 2);
+                } else if((op & qoiMask) == qoiOpLuma){
+                    png::byte second = data[pos++];
+                    int dg = (op & 0x3f) - 32;
+                    px.r = png::byte(px.r + dg - 8 + ((second >> 4) & 0x0f));
+                    px.g = png::byte(px.g + dg);
+                    px.b = png::byte(px.b + dg - 8 + (second & 0x0f));
+                } else{
+                    run = op & 0x3f;
+                }
+                index[px.hash()] = px;
+            }
+            img[i][j] = png::rgb_pixel(px.r, px.g, px.b);
+        }
+    }
+    return img;
+}
+
+void writeQoi(const std::string &file_name, int width, int height, const RowReader &getRow, int){
+    std::vector<png::byte> out;
+    out.reserve(size_t(width) * 4 + 64);
+    out.insert(out.end(), {'q', 'o', 'i', 'f'});
+    putBigEndian(out, (uint32_t) width);
+    putBigEndian(out, (uint32_t) height);
+    out.push_back(3); // rgb
+    out.push_back(0); // sRGB with linear alpha
+    FilePtr file = openFile(file_name, "wb");
+    QoiPixel index[64];
+    QoiPixel prev;
+    int run = 0;
+    std::vector<png::rgb_pixel> row(width);
+    for(int i = 0; i < height; i++){
+        getRow(i, row.data());
+        for(int j = 0; j < width; j++){
+            QoiPixel px;
+            px.r = row[j].red; px.g = row[j].green; px.b = row[j].blue;
+            bool last = i == height - 1 && j == width - 1;
+            if(px == prev){
+                run++;
+                if(run == 62 || last){
+                    out.push_back(png::byte(qoiOpRun | (run - 1)));
+                    run = 0;
+                }
+                continue;
+            }
+            if(run > 0){
+                out.push_back(png::byte(qoiOpRun | (run - 1)));
+                run = 0;
+            }
+            int hash = px.hash();
+            if(index[hash] == px){
+                out.push_back(png::byte(qoiOpIndex | hash));
+            } else{
+                index[hash] = px;
+                // differences wrap around as bytes, as in the specification
+                int dr = (signed char) (px.r - prev.r);
+                int dg = (signed char) (px.g - prev.g);
+                int db = (signed char) (px.b - prev.b);
+                int drg = dr - dg, dbg = db - dg;
+                if(dr >= -2 && dr <= 1 && dg >= -2 && dg <= 1 && db >= -2 && db <= 1){
+                    out.push_back(png::byte(qoiOpDiff | ((dr + 2) << 4) | ((dg + 2) << 2) | (db + 2)));
+                } else if(dg >= -32 && dg <= 31 && drg >= -8 && drg <= 7 && dbg >= -8 && dbg <= 7){
+                    out.push_back(png::byte(qoiOpLuma | (dg + 32)));
+                    out.push_back(png::byte(((drg + 8) << 4) | (dbg + 8)));
+                } else{
+                    out.insert(out.end(), {qoiOpRgb, px.r, px.g, px.b});
+                }
+            }
+            prev = px;
+        }
+        writeBytes(file.get(), out.data(), out.size(), file_name);
+        out.clear();
+    }
+    writeBytes(file.get(), qoiEnd, sizeof(qoiEnd), file_name);
+    closeWritten(file, file_name);
+}
+
+// ---------------------------------------------------------------- raw
+
+// 8 byte magic, little endian uint32 width and height, then the rows of packed rgb bytes
+constexpr char rawMagic[8] = {'G', 'C', 'T', 'R', 'A', 'W', '0', '1'};
+constexpr size_t rawHeaderSize = 16;
+
+png::image<png::rgb_pixel> readRaw(const std::string &file_name){
+    int fd = open(file_name.c_str(), O_RDONLY);
+    if(fd < 0)
+        throw png::error("Invalid name for image file " + file_name);
+    struct stat info;
+    if(fstat(fd, &info) != 0 || size_t(info.st_size) < rawHeaderSize){
+        close(fd);
+        throw png::error("Invalid raw image file " + file_name);
+    }
+    size_t size = (size_t) info.st_size;
+    void *mapping = mmap(nullptr, size, PROT_READ, MAP_PRIVATE, fd, 0);
+    close(fd);
+    if(mapping == MAP_FAILED)
+        throw png::error("Can't map raw image file " + file_name);
+    const png::byte *data = static_cast<const png::byte *>(mapping);
+    uint32_t width = 0, height = 0;
+    for(int b = 3; b >= 0; b--){
+        width = (width << 8) | data[8 + b];
+        height = (height << 8) | data[12 + b];
+    }
+    if(std::memcmp(data, rawMagic, sizeof(rawMagic)) != 0){
+        munmap(mapping, size);
+        throw png::error("Invalid raw image file " + file_name);
+    }
+    try{
+        pixelBytes(width, height, 3, size - rawHeaderSize, file_name);
+    } catch(const png::error &){
+        munmap(mapping, size);
+        throw;
+    }
+    // the pixels are read straight from the page cache, row by row
+    madvise(mapping, size, MADV_SEQUENTIAL);
+    png::image<png::rgb_pixel> img(width, height);
+    for(uint32_t i = 0; i < height; i++)
+        std::memcpy(&img[i][0], data + rawHeaderSize + size_t(i) * width * 3, size_t(width) * 3);
+    munmap(mapping, size);
+    return img;
+}
+
+void writeRaw(const std::string &file_name, int width, int height, const RowReader &getRow, int){
+    static_assert(sizeof(png::rgb_pixel) == 3, "rows are written as packed rgb bytes");
+    FilePtr file = openFile(file_name, "wb");
+    png::byte header[rawHeaderSize];
+    std::memcpy(header, rawMagic, sizeof(rawMagic));
+    for(int b = 0; b < 4; b++){
+        header[8 + b] = png::byte(uint32_t(width) >> (8 * b));
+        header[12 + b] = png::byte(uint32_t(height) >> (8 * b));
+    }
+    writeBytes(file.get(), header, sizeof(header), file_name);
+    std::vector<png::rgb_pixel> row(width);
+    for(int i = 0; i < height; i++){
+        getRow(i, row.data());
+        writeBytes(file.get(), row.data(), row.size() * 3, file_name);
+    }
+    closeWritten(file, file_name);
+}
+
+// ---------------------------------------------------------------- registry
+
+std::string lowercase(std::string s){
+    for(char &c : s)
+        c = (char) tolower((unsigned char) c);
+    return s;
+}
+
+std::mutex registryMutex;
+std::map<std::string, ImageCodec> &registry(){
+    static std::map<std::string, ImageCodec> codecs = {
+        {"png", {readPng, writePng}},
+        {"ppm", {readPpm, writePpm}},
+        {"qoi", {readQoi, writeQoi}},
+        {"raw", {readRaw, writeRaw}},
+    };
+    return codecs;
+}
+
+// lowercase extension of the file name, empty if it has none
+std::string extensionOf(const std::string &file_name){
+    size_t dot = file_name.find_last_of('.');
+    size_t slash = file_name.find_last_of('/');
+    if(dot == std::string::npos || (slash != std::string::npos && dot < slash))
+        return "";
+    return lowercase(file_name.substr(dot + 1));
+}
+
+} // namespace
+
+void registerImageCodec(const std::string &extension, const ImageCodec &codec){
+    std::lock_guard<std::mutex> lock(registryMutex);
+    registry()[lowercase(extension)] = codec;
+}
+
+const ImageCodec &imageCodecFor(const std::string &file_name){
+    std::lock_guard<std::mutex> lock(registryMutex);
+    auto &codecs = registry();
+    auto it = codecs.find(extensionOf(file_name));
+    return it != codecs.end() ? it->second : codecs.at("png");
+}
+
+bool hasImageCodec(const std::string &file_name){
+    std::lock_guard<std::mutex> lock(registryMutex);
+    return registry().count(extensionOf(file_name)) > 0;
+}
+
+png::image<png::rgb_pixel> readImage(const std::string &file_name){
+    return imageCodecFor(file_name).read(file_name);
+}
+
+void writeImage(const std::string &file_name, int width, int height, const RowReader &getRow, int compressionLevel){
+    imageCodecFor(file_name).write(file_name, width, height, getRow, compressionLevel);
+}
+
+void writeImage(const std::string &file_name, const png::image<png::rgb_pixel> &img){
+    writeImage(file_name, img.get_width(), img.get_height(), [&img](int i, png::rgb_pixel *row){
+        for(size_t j = 0; j < img.get_width(); j++)
+            row[j] = img[i][j];
+    });
+}
@@ -0,0 +1,88 @@
+/**
+ * @file imagecodec.hpp
+ * @author Letícia Freire Carvalho de Sousa
+ * @brief Header file of the image codecs chosen by the file extension
+ * @version 0.1
+ * @date 2026-10-19
+ *
+ * @copyright Copyright (c) 2024
+ *
+ */
+#pragma once
+#include <png++/png.hpp>
+#include <string>
+#include <functional>
+
+/// copies the row i of the image to the buffer, may be called concurrently
+using RowReader = std::function<void(int, png::rgb_pixel *)>;
+
+/**
+ * @brief Reader and writer of an image file format
+ *
+ * Codecs are chosen by the extension of the file name. The built in codecs are
+ * png (the default), ppm (binary PPM), qoi and raw (a 16 byte header followed
+ * by the rgb bytes, so the pixels can be memory mapped with no decoding).
+ */
+struct ImageCodec{
+    /// reads the image file
+    std::function<png::image<png::rgb_pixel>(const std::string &file_name)> read;
+    /// writes an image of width &times; height pixels, compressionLevel is ignored by formats without compression
+    std::function<void(const std::string &file_name, int width, int height, const RowReader &getRow, int compressionLevel)> write;
+};
+
+/**
+ * @brief Registers the codec of an extension, replacing the previous one
+ *
+ * @param extension extension of the file names, without the dot (case insensitive)
+ * @param codec reader and writer of the format
+ */
+void registerImageCodec(const std::string &extension, const ImageCodec &codec);
+
+/**
+ * @brief Codec of the extension of the file name, png when the extension has no codec
+ *
+ * @param file_name file name of the image
+ * @return const ImageCodec&
+ */
+const ImageCodec &imageCodecFor(const std::string &file_name);
+
+/**
+ * @brief If the extension of the file name has a codec (imageCodecFor falls back to png for the others)
+ *
+ * @param file_name file name of the image
+ * @return bool
+ */
+bool hasImageCodec(const std::string &file_name);
+
+/**
+ * @brief Reads an image with the codec of its extension
+ *
+ * Time Complexity: linear on the number of pixels of the image
+ *
+ * @param file_name file name of the image
+ * @return png::image<png::rgb_pixel>
+ */
+png::image<png::rgb_pixel> readImage(const std::string &file_name);
+
+/**
+ * @brief Writes an image row by row with the codec of its extension
+ *
+ * Time Complexity: linear on the number of pixels of the image
+ *
+ * @param file_name file name of the image
+ * @param width width of the image (in pixels)
+ * @param height height of the image (in pixels)
+ * @param getRow copies the row i of the image to the buffer
+ * @param compressionLevel compression level of the formats with compression (zlib levels for png)
+ */
+void writeImage(const std::string &file_name, int width, int height, const RowReader &getRow, int compressionLevel = 6);
+
+/**
+ * @brief Writes a png::image object with the codec of its extension
+ *
+ * Time Complexity: linear on the number of pixels of the image
+ *
+ * @param file_name file name of the image
+ * @param img image that will be written
+ */
+void writeImage(const std::string &file_name, const png::image<png::rgb_pixel> &img);
@@ -10,115 +10,590 @@
  */
 
 #include "imagetexture.hpp"
-#define M_ASSERT(msg, expr) assert(( (void)(msg), (expr) ))
+#include "threadpool.hpp"
+#include "deltastepping.hpp"
+#include <limits>
 
 /*
 Constructors
 */
 ImageTexture::ImageTexture(const png::image<png::rgb_pixel> & _img) 
     : 
-    rngSeed(std::chrono::steady_clock::now().time_since_epoch().count()),
-    rng(rngSeed),
-    outputImg(_img), 
-    imgWidth(_img.get_width()),
-    imgHeight(_img.get_height()),
-    pixelColorStatus(_img.get_height(), std::vector<PixelStatusEnum>(_img.get_width(), PixelStatusEnum::notcolored)),
-    inSubgraph(imgHeight + 1, std::vector<bool>(imgWidth + 1)),
-    edgesCosts(imgHeight + 1, std::vector<std::array<long double, 4>>(imgWidth + 1)),    
-    dist(imgHeight + 1, std::vector<long double>(imgWidth + 1)),
-    vis(imgHeight + 1, std::vector<bool>(imgWidth + 1)),
-    parent(imgHeight + 1, std::vector<int>(imgWidth + 1, -1)),
-    isT(imgHeight + 1, std::vector<bool>(imgWidth+1, false)),
-    isS(imgHeight + 1, std::vector<bool>(imgWidth+1, false)),
-    inS(imgHeight + 1, std::vector<bool>(imgWidth + 1)),
-    inStPath(imgHeight + 1, std::vector<int>(imgWidth + 1, -1)),
-    edgeTo({
-        std::vector<std::vector<std::array<int, 4>>>(imgHeight + 1, std::vector<std::array<int, 4>>(imgWidth + 1, edgesToOriginalGraph)),
-         std::vector<std::vector<std::array<int, 4>>>(imgHeight + 1, std::vector<std::array<int, 4>>(imgWidth + 1, edgesToOriginalGraph))
-    }),
-    distCase2({
-        std::vector<std::vector<long double>>(imgHeight + 1, std::vector<long double>(imgWidth + 1, 0)),
-        std::vector<std::vector<long double>>(imgHeight + 1, std::vector<long double>(imgWidth + 1, 0))
-    }),
-    visCase2({
-        std::vector<std::vector<int>>(imgHeight + 1, std::vector<int>(imgWidth + 1, 0)),
-        std::vector<std::vector<int>>(imgHeight + 1, std::vector<int>(imgWidth + 1, 0))
-    }),
-    seenCase2({
-        std::vector<std::vector<int>>(imgHeight + 1, std::vector<int>(imgWidth + 1, 0)),
-        std::vector<std::vector<int>>(imgHeight + 1, std::vector<int>(imgWidth + 1, 0))
-    }),    
-    parentCase2({
-        std::vector<std::vector<int>>(imgHeight + 1, std::vector<int>(imgWidth + 1, -1)),
-        std::vector<std::vector<int>>(imgHeight + 1, std::vector<int>(imgWidth + 1, -1))
-    } )  
+    ImageTexture(_img.get_width(), _img.get_height())
+    {
+    for(int i = 0; i < imgHeight; i++)
+        for(int j = 0; j < imgWidth; j++)
+            outputImg[i][j] = _img[i][j];
+}
+ImageTexture::ImageTexture(const std::string &file_name)
+    :
+    ImageTexture(readImage(file_name))
     {
 }
-ImageTexture::ImageTexture(int width, int height) 
+ImageTexture::ImageTexture(int width, int height, const std::string &backing_file) 
     :  
     rngSeed(std::chrono::steady_clock::now().time_since_epoch().count()),
     rng(rngSeed),
-    outputImg(width, height), 
+    outputImg(height, width, backing_file), 
     imgWidth(width),
     imgHeight(height), 
-    pixelColorStatus(height, std::vector<PixelStatusEnum>(width, PixelStatusEnum::notcolored)),
-    inSubgraph(imgHeight + 1, std::vector<bool>(imgWidth + 1)),
-    edgesCosts(imgHeight + 1, std::vector<std::array<long double, 4>>(imgWidth + 1)),    
-    dist(imgHeight + 1, std::vector<long double>(imgWidth + 1)),
-    vis(imgHeight + 1, std::vector<bool>(imgWidth + 1)),
-    parent(imgHeight + 1, std::vector<int>(imgWidth + 1, -1)),
-    validEdge(imgHeight + 1, std::vector<std::array<bool, 4>>(imgWidth + 1, {true,true,true,true})),
-    isT(imgHeight + 1, std::vector<bool>(imgWidth+1, false)),
-    isS(imgHeight + 1, std::vector<bool>(imgWidth+1, false)),
-    inS(imgHeight + 1, std::vector<bool>(imgWidth + 1)),
-    inStPath(imgHeight + 1, std::vector<int>(imgWidth + 1, -1)),
+    pixelColorStatus(height, width, backing_file.empty() ? "" : backing_file + ".status"),
+    seamCost(height, width, backing_file.empty() ? "" : backing_file + ".seams"),
+    sourceMap(height, width, backing_file.empty() ? "" : backing_file + ".source"),
+    backingFile(backing_file),
+    inHole(height, width, false),
+    wasColored(imgHeight, imgWidth, false),
+    fixedInPatch(imgHeight, imgWidth, false),
+    intersectionOf(imgHeight, imgWidth, -1),
+    inS(imgHeight + 1, imgWidth + 1, false),
+    inStPath(imgHeight + 1, imgWidth + 1, -1),
     edgeTo({
-        std::vector<std::vector<std::array<int, 4>>>(imgHeight + 1, std::vector<std::array<int, 4>>(imgWidth + 1, edgesToOriginalGraph)),
-        std::vector<std::vector<std::array<int, 4>>>(imgHeight + 1, std::vector<std::array<int, 4>>(imgWidth + 1, edgesToOriginalGraph))
+        TiledGrid<std::array<int, 4>>(imgHeight + 1, imgWidth + 1, edgesToOriginalGraph),
+        TiledGrid<std::array<int, 4>>(imgHeight + 1, imgWidth + 1, edgesToOriginalGraph)
     }),
     distCase2({
-        std::vector<std::vector<long double>>(imgHeight + 1, std::vector<long double>(imgWidth + 1, 0)),
-        std::vector<std::vector<long double>>(imgHeight + 1, std::vector<long double>(imgWidth + 1, 0))
+        TiledGrid<long double>(imgHeight + 1, imgWidth + 1, 0),
+        TiledGrid<long double>(imgHeight + 1, imgWidth + 1, 0)
     }),
     visCase2({
-        std::vector<std::vector<int>>(imgHeight + 1, std::vector<int>(imgWidth + 1, 0)),
-        std::vector<std::vector<int>>(imgHeight + 1, std::vector<int>(imgWidth + 1, 0))
+        TiledGrid<int>(imgHeight + 1, imgWidth + 1, 0),
+        TiledGrid<int>(imgHeight + 1, imgWidth + 1, 0)
     }),
     seenCase2({
-        std::vector<std::vector<int>>(imgHeight + 1, std::vector<int>(imgWidth + 1, 0)),
-        std::vector<std::vector<int>>(imgHeight + 1, std::vector<int>(imgWidth + 1, 0))
+        TiledGrid<int>(imgHeight + 1, imgWidth + 1, 0),
+        TiledGrid<int>(imgHeight + 1, imgWidth + 1, 0)
     }),    
     parentCase2({
-        std::vector<std::vector<int>>(imgHeight + 1, std::vector<int>(imgWidth + 1, -1)),
-        std::vector<std::vector<int>>(imgHeight + 1, std::vector<int>(imgWidth + 1, -1))
-    } )
-        {
+        TiledGrid<int>(imgHeight + 1, imgWidth + 1, -1),
+        TiledGrid<int>(imgHeight + 1, imgWidth + 1, -1)
+    }),
+    inCutCycle(imgHeight + 1, imgWidth + 1, 0)
+    {
+    cutScratch.push_back(std::make_unique<CutScratch>(imgHeight, imgWidth));
 }
 
 /*
 Public Functions 
 */
-void ImageTexture::render(const std::string &file_name){
-    outputImg.write(file_name);
+void ImageTexture::render(const std::string &file_name, int compressionLevel){
+    writeImage(file_name, imgWidth, imgHeight, [this](int i, png::rgb_pixel *row){
+        for(int j = 0; j < imgWidth; j++)
+            row[j] = outputImg[i][j];
+    }, compressionLevel);
+}
+void ImageTexture::setCutCost(CutCost cost){
+    cutCost = cost;
+    if(cost == CutCost::gradient && !outputGradients)
+        outputGradients = std::make_unique<MappedGrid<std::array<float, 2>>>(imgHeight, imgWidth);
+    outputGradientsStale = true;
+}
+void ImageTexture::setGuide(const png::image<png::rgb_pixel> &target, double weight){
+    M_ASSERT("the target must have the size of the texture", (int) target.get_width() == imgWidth && (int) target.get_height() == imgHeight);
+    guideLuma = std::make_unique<MappedGrid<png::byte>>(imgHeight, imgWidth);
+    guideWeight = std::clamp(weight, 0.0, 1.0);
+    for(int i = 0; i < imgHeight; i++)
+        for(int j = 0; j < imgWidth; j++)
+            (*guideLuma)[i][j] = luma(target[i][j].red, target[i][j].green, target[i][j].blue);
+}
+void ImageTexture::clearGuide(){
+    guideLuma.reset();
+    guideWeight = 0;
+}
+/**
+ * @brief the guide of a texture factor times larger, averaged over the blocks of factor &times; factor pixels
+ * 
+ * @param fine texture with a guide
+ * @param factor side of the blocks of fine of each pixel
+ */
+void ImageTexture::guideFrom(const ImageTexture &fine, int factor){
+    guideLuma = std::make_unique<MappedGrid<png::byte>>(imgHeight, imgWidth);
+    guideWeight = fine.guideWeight;
+    for(int i = 0; i < imgHeight; i++)
+        for(int j = 0; j < imgWidth; j++){
+            int sum = 0, count = 0;
+            for(int a = i * factor; a < std::min(fine.imgHeight, (i + 1) * factor); a++)
+                for(int b = j * factor; b < std::min(fine.imgWidth, (j + 1) * factor); b++, count++)
+                    sum += (*fine.guideLuma)[a][b];
+            (*guideLuma)[i][j] = (png::byte) (count == 0 ? 0 : (sum + count / 2) / count);
+        }
+}
+void ImageTexture::renderLayer(size_t layer, const std::string &file_name, int compressionLevel){
+    M_ASSERT("the layer must have been created by a material", layer < layerImgs.size());
+    const MappedGrid<png::rgb_pixel> &layerImg = *layerImgs[layer];
+    writeImage(file_name, imgWidth, imgHeight, [this, &layerImg](int i, png::rgb_pixel *row){
+        for(int j = 0; j < imgWidth; j++)
+            row[j] = layerImg[i][j];
+    }, compressionLevel);
+}
+void ImageTexture::startPreview(const std::string &file_name, PreviewStream::PreviewFormat format, int maxFramesPerSecond){
+    preview = std::make_unique<PreviewStream>(file_name, imgWidth, imgHeight, format, maxFramesPerSecond);
+    preview->publish(0, 0, imgHeight, imgWidth, outputImg);
+}
+void ImageTexture::stopPreview(){
+    preview.reset();
+}
+bool ImageTexture::checkpoint(const std::string &file_name){
+    std::ostringstream rngState;
+    rngState<<rng;
+    const std::string state = rngState.str();
+    CheckpointHeader header{};
+    std::copy(std::begin(checkpointMagic), std::end(checkpointMagic), header.magic);
+    header.version = checkpointVersion;
+    header.width = (uint32_t) imgWidth;
+    header.height = (uint32_t) imgHeight;
+    header.rngSeed = rngSeed;
+    header.iterations = iterations;
+    header.coveredPixels = coveredPixels;
+    header.case2Count = case2Count;
+    header.seamEnergy = seamEnergy;
+    header.cutCost = (uint32_t) cutCost;
+    header.layerCount = (uint32_t) layerImgs.size();
+    header.parallelCutVertices = parallelCutVertices;
+    header.guideWeight = guideWeight;
+    header.holeTop = holeTop;
+    header.holeLeft = holeLeft;
+    header.holeBottom = holeBottom;
+    header.holeRight = holeRight;
+    // the hole is stored as a byte per pixel of its bounding box
+    std::vector<uint8_t> hole;
+    if(holeSet){
+        hole.reserve(size_t(holeBottom - holeTop) * (holeRight - holeLeft));
+        for(int i = holeTop; i < holeBottom; i++)
+            for(int j = holeLeft; j < holeRight; j++)
+                hole.push_back(inHole[i][j]);
+    }
+    CheckpointChunks chunks;
+    auto addSection = [&header, &chunks](CheckpointSection section, const void *data, size_t bytes){
+        header.sections |= 1u << section;
+        header.sectionBytes[section] += bytes;
+        chunks.push_back({data, bytes});
+    };
+    addSection(rngStateSection, state.data(), state.size());
+    addSection(pixelsSection, outputImg.data(), outputImg.byteSize());
+    addSection(statusSection, pixelColorStatus.data(), pixelColorStatus.byteSize());
+    addSection(seamsSection, seamCost.data(), seamCost.byteSize());
+    addSection(sourcesSection, sourceMap.data(), sourceMap.byteSize());
+    if(guideLuma)
+        addSection(guideSection, guideLuma->data(), guideLuma->byteSize());
+    for(const auto &layerImg : layerImgs)
+        addSection(layersSection, layerImg->data(), layerImg->byteSize());
+    if(holeSet)
+        addSection(holeSection, hole.data(), hole.size());
+    // a file backed mapping is shared with the child, it would not be a snapshot
+    bool async = !outputImg.shared() && !pixelColorStatus.shared() && !seamCost.shared() && !sourceMap.shared();
+    for(const auto &layerImg : layerImgs)
+        async = async && !layerImg->shared();
+    return checkpointWriter.start(file_name, header, chunks, async);
+}
+void ImageTexture::setCheckpoint(const std::string &file_name, int everyIterations){
+    checkpointFile = file_name;
+    checkpointInterval = everyIterations;
+}
+bool ImageTexture::waitCheckpoint(){
+    return checkpointWriter.wait();
+}
+std::unique_ptr<ImageTexture> ImageTexture::resume(const std::string &checkpoint_file, const std::string &backing_file){
+    CheckpointReader reader(checkpoint_file);
+    const CheckpointHeader &header = reader.header();
+    auto has = [&header](CheckpointSection section){ return (header.sections >> section & 1) != 0; };
+    auto texture = std::make_unique<ImageTexture>((int) header.width, (int) header.height, backing_file);
+    const int64_t holeHeight = int64_t(header.holeBottom) - header.holeTop, holeWidth = int64_t(header.holeRight) - header.holeLeft;
+    const bool valid = has(rngStateSection) && has(pixelsSection) && has(statusSection) && has(seamsSection) && has(sourcesSection)
+        && header.sectionBytes[pixelsSection] == texture->outputImg.byteSize() && header.sectionBytes[statusSection] == texture->pixelColorStatus.byteSize()
+        && header.sectionBytes[seamsSection] == texture->seamCost.byteSize() && header.sectionBytes[sourcesSection] == texture->sourceMap.byteSize()
+        && header.cutCost <= CutCost::gradient && header.guideWeight >= 0 && header.guideWeight <= 1
+        && header.sectionBytes[layersSection] % texture->outputImg.byteSize() == 0 && header.sectionBytes[layersSection] / texture->outputImg.byteSize() == header.layerCount
+        && (!has(holeSection) || (header.holeTop >= 0 && header.holeLeft >= 0 && holeHeight > 0 && holeWidth > 0
+            && header.holeBottom <= (int64_t) header.height && header.holeRight <= (int64_t) header.width
+            && header.sectionBytes[holeSection] == uint64_t(holeHeight * holeWidth)));
+    if(!valid)
+        throw std::runtime_error("Invalid checkpoint file " + checkpoint_file);
+    std::string state(header.sectionBytes[rngStateSection], '\0');
+    reader.read(state.data(), state.size());
+    reader.read(texture->outputImg.data(), texture->outputImg.byteSize());
+    reader.read(texture->pixelColorStatus.data(), texture->pixelColorStatus.byteSize());
+    reader.read(texture->seamCost.data(), texture->seamCost.byteSize());
+    reader.read(texture->sourceMap.data(), texture->sourceMap.byteSize());
+    if(has(guideSection)){
+        texture->guideLuma = std::make_unique<MappedGrid<png::byte>>(texture->imgHeight, texture->imgWidth);
+        texture->guideWeight = header.guideWeight;
+        if(header.sectionBytes[guideSection] != texture->guideLuma->byteSize())
+            throw std::runtime_error("Invalid checkpoint file " + checkpoint_file);
+        reader.read(texture->guideLuma->data(), texture->guideLuma->byteSize());
+    }
+    for(uint32_t k = 0; k < header.layerCount; k++){
+        texture->layerImgs.push_back(std::make_unique<MappedGrid<png::rgb_pixel>>(texture->imgHeight, texture->imgWidth, backing_file.empty() ? "" : backing_file + ".layer" + std::to_string(k)));
+        reader.read(texture->layerImgs.back()->data(), texture->layerImgs.back()->byteSize());
+    }
+    if(has(holeSection)){
+        std::vector<uint8_t> hole(header.sectionBytes[holeSection]);
+        reader.read(hole.data(), hole.size());
+        texture->holeSet = true;
+        texture->holeTop = header.holeTop, texture->holeLeft = header.holeLeft;
+        texture->holeBottom = header.holeBottom, texture->holeRight = header.holeRight;
+        const uint8_t *inHole = hole.data();
+        for(int i = texture->holeTop; i < texture->holeBottom; i++)
+            for(int j = texture->holeLeft; j < texture->holeRight; j++, inHole++)
+                if(*inHole)
+                    texture->inHole[i][j] = true;
+    }
+    reader.finish();
+    std::istringstream(state)>>texture->rng;
+    texture->rngSeed = header.rngSeed;
+    texture->iterations = header.iterations;
+    texture->coveredPixels = header.coveredPixels;
+    texture->case2Count = header.case2Count;
+    texture->seamEnergy = header.seamEnergy;
+    texture->setCutCost((CutCost) header.cutCost);
+    texture->parallelCutVertices = header.parallelCutVertices;
+    return texture;
+}
+SourcePixel ImageTexture::getSource(int i, int j) const{
+    if(pixelColorStatus[i][j] != PixelStatusEnum::colored)
+        return {unknownExemplar, 0, 0};
+    return sourceMap[i][j];
+}
+void ImageTexture::renderSources(const std::string &file_name, const ExemplarLibrary &library, int scale, int compressionLevel){
+    scale = std::max(1, scale);
+    writeImage(file_name, imgWidth * scale, imgHeight * scale, [this, &library, scale](int i, png::rgb_pixel *row){
+        const int a = i / scale;
+        for(int j = 0; j < imgWidth * scale; j++){
+            const int b = j / scale;
+            const SourcePixel source = getSource(a, b);
+            if(source.exemplar == unknownExemplar || source.exemplar >= library.size()){
+                row[j] = outputImg[a][b];
+                continue;
+            }
+            const int exemplarRow = std::min(scale * source.row + i % scale, library.height(source.exemplar) - 1);
+            const int exemplarCol = std::min(scale * source.col + j % scale, library.width(source.exemplar) - 1);
+            row[j] = library.image(source.exemplar)[exemplarRow][exemplarCol];
+        }
+    }, compressionLevel);
+}
+size_t ImageTexture::saveSourceMap(const std::string &file_name){
+    return writeSourceMap(file_name, imgWidth, imgHeight, [this](int i, SourcePixel *row){
+        for(int j = 0; j < imgWidth; j++)
+            row[j] = getSource(i, j);
+    });
+}
+std::unique_ptr<ImageTexture> ImageTexture::fromSourceMap(const std::string &file_name, const ExemplarLibrary &library, const std::string &backing_file){
+    const SourceMap map = readSourceMap(file_name);
+    auto texture = std::make_unique<ImageTexture>(map.width, map.height, backing_file);
+    const SourcePixel *source = map.pixels.data();
+    for(int i = 0; i < map.height; i++)
+        for(int j = 0; j < map.width; j++, source++){
+            if(source->exemplar == unknownExemplar)
+                continue;
+            if(source->exemplar >= library.size() || source->row >= library.height(source->exemplar) || source->col >= library.width(source->exemplar))
+                throw std::runtime_error("The source map " + file_name + " doesn't match the library");
+            texture->outputImg[i][j] = library.image(source->exemplar)[source->row][source->col];
+            texture->pixelColorStatus[i][j] = PixelStatusEnum::colored;
+            texture->sourceMap[i][j] = *source;
+            texture->coveredPixels++;
+        }
+    texture->computeSeams(library);
+    return texture;
+}
+size_t ImageTexture::memoryUsage() const{
+    size_t bytes = outputImg.byteSize() + pixelColorStatus.byteSize() + seamCost.byteSize() + sourceMap.byteSize();
+    for(const auto &layerImg : layerImgs)
+        bytes += layerImg->byteSize();
+    if(outputGradients)
+        bytes += outputGradients->byteSize();
+    bytes += inHole.residentBytes() + wasColored.residentBytes() + fixedInPatch.residentBytes() + intersectionOf.residentBytes() + inS.residentBytes() + inStPath.residentBytes() + inCutCycle.residentBytes();
+    for(const auto &scratch : cutScratch)
+        bytes += scratch->residentBytes();
+    for(int k = 0; k < 2; k++)
+        bytes += edgeTo[k].residentBytes() + distCase2[k].residentBytes() + visCase2[k].residentBytes() + seenCase2[k].residentBytes() + parentCase2[k].residentBytes();
+    return bytes;
+}
+void ImageTexture::reset(uint64_t seed){
+    waitCheckpoint();
+    stopPreview();
+    checkpointFile.clear();
+    checkpointInterval = 0;
+    // the pages are dropped instead of written, the next texture only faults the pages it touches
+    outputImg.clear();
+    pixelColorStatus.clear();
+    seamCost.clear();
+    sourceMap.clear();
+    for(const auto &layerImg : layerImgs)
+        layerImg->clear();
+    outputGradientsStale = true;
+    clearHole();
+    clearGuide();
+    rngSeed = seed;
+    rng.seed(seed);
+    iterations = 0;
+    seamEnergy = 0;
+    coveredPixels = 0;
+    case2Count = 0;
+    lastCutCost = 0;
+    lastChangedPixels = 0;
 }
 void ImageTexture::patchFitting(const png::image<png::rgb_pixel> &inputImg, int CntIterations){
     for(int i = 0 ; i < CntIterations; i++)
         patchFittingIteration(inputImg);
 }
 void ImageTexture::patchFitting(const std::string &file_name, int CntIterations){
-    ImageTexture::patchFitting(png::image<png::rgb_pixel>(file_name), CntIterations);
+    ImageTexture::patchFitting(readImage(file_name), CntIterations);
+}
+ImageTexture::Progress ImageTexture::patchFitting(const png::image<png::rgb_pixel> &inputImg, const FittingLimits &limits){
+    return patchFitting(std::vector<const png::image<png::rgb_pixel> *>{&inputImg}, limits);
+}
+ImageTexture::Progress ImageTexture::patchFitting(const std::vector<const png::image<png::rgb_pixel> *> &inputImgs, const FittingLimits &limits){
+    M_ASSERT("there must be an input image", !inputImgs.empty());
+    uint64_t done = 0;
+    return fitPatches(limits, [&](){
+        const size_t image = done++ % inputImgs.size();
+        const auto [heightOffset, widthOffset] = matching(*inputImgs[image]);
+        return std::make_pair(inputImgs[image], Candidate{unknownExemplar, heightOffset, widthOffset, image});
+    });
+}
+ImageTexture::Progress ImageTexture::patchFitting(const ExemplarLibrary &library, const FittingLimits &limits, int candidates){
+    M_ASSERT("there must be an exemplar", library.size() > 0);
+    return fitPatches(limits, [&](){
+        const Candidate chosen = matching(library, candidates);
+        return std::make_pair(&library.image(chosen.exemplar), chosen);
+    }, &library);
+}
+ImageTexture::Progress ImageTexture::patchFitting(const MaterialSet &material, const FittingLimits &limits){
+    return fitPatches(limits, [&](){
+        const auto [heightOffset, widthOffset] = matching(material.guide());
+        return std::make_pair(&material.guide(), Candidate{0, heightOffset, widthOffset});
+    }, nullptr, &material);
+}
+ImageTexture::Progress ImageTexture::patchFittingPyramid(const ExemplarLibrary &library, const FittingLimits &limits, int levels, int candidates, int refineIterations, int refinePatchSize){
+    M_ASSERT("there must be an exemplar", library.size() > 0);
+    const auto start = std::chrono::steady_clock::now();
+    auto cancelRequested = [&limits]{ return limits.cancel != nullptr && limits.cancel->load(std::memory_order_relaxed); };
+    // the coarsest level keeps at least 2 pixels on each side
+    levels = std::max(1, levels);
+    while(levels > 1 && (std::min(imgWidth, imgHeight) >> (levels - 1)) < 2)
+        levels--;
+    // downsampled[level - 1] and sizes[level] are the library and the output size of the level, the level 0 is the full size
+    std::vector<ExemplarLibrary> downsampled;
+    std::vector<std::pair<int, int>> sizes = {{imgWidth, imgHeight}};
+    for(int level = 1; level < levels; level++){
+        downsampled.push_back((level == 1 ? library : downsampled.back()).downsampled(2));
+        sizes.push_back({(sizes.back().first + 1) / 2, (sizes.back().second + 1) / 2});
+    }
+    uint64_t done = 0;
+    StopReason reason = StopReason::iterationLimit;
+    std::unique_ptr<ImageTexture> coarser;
+    for(int level = levels - 1; level >= 0; level--){
+        const ExemplarLibrary &levelLibrary = level == 0 ? library : downsampled[level - 1];
+        std::unique_ptr<ImageTexture> owned;
+        ImageTexture *texture = this;
+        if(level > 0){
+            owned = std::make_unique<ImageTexture>(sizes[level].first, sizes[level].second);
+            owned->reset(rng());
+            owned->setCutCost(cutCost);
+            owned->setParallelCutThreshold(parallelCutVertices);
+            if(guideLuma)
+                owned->guideFrom(*this, 1 << level);
+            texture = owned.get();
+        }
+        if(level == levels - 1){
+            Progress coarsest = texture->patchFitting(levelLibrary, limits, candidates);
+            reason = coarsest.stopReason;
+            done += coarsest.iterations;
+            // the finer levels copy every pixel from this one, so it is covered even past the limits
+            const uint64_t pixels = (uint64_t) sizes[level].first * sizes[level].second;
+            while(texture->coveredPixels < pixels && !cancelRequested()){
+                texture->patchFittingIteration(levelLibrary, candidates);
+                done++;
+            }
+        } else{
+            texture->upsampleFrom(*coarser, levelLibrary);
+            const int count = refineIterations >= 0 ? refineIterations : sizes[level].first * sizes[level].second / std::max(1, refinePatchSize * refinePatchSize);
+            done += (uint64_t) texture->refineSeams(levelLibrary, count, refinePatchSize, limits.cancel);
+        }
+        if(cancelRequested()){
+            reason = StopReason::cancelled;
+            break;
+        }
+        coarser = std::move(owned);
+    }
+    fittingGradients.clear();
+    Progress result = currentProgress(done, start);
+    result.stopReason = reason;
+    return result;
+}
+ImageTexture::Progress ImageTexture::fitPatches(const FittingLimits &limits, const PatchChooser &nextPatch, const ExemplarLibrary *library, const MaterialSet *material, const std::function<bool(uint64_t)> &finished){
+    const auto start = std::chrono::steady_clock::now();
+    const uint64_t pixels = (uint64_t) imgWidth * imgHeight;
+    // the patches only change the placement region, the changed pixels of the convergence test are relative to it
+    const uint64_t regionPixels = (uint64_t) (placeBottom - placeTop) * (placeRight - placeLeft);
+    auto cancelRequested = [&limits]{ return limits.cancel != nullptr && limits.cancel->load(std::memory_order_relaxed); };
+    uint64_t done = 0;
+    StopReason reason;
+    // seam energy and pixels changed after each iteration of the sliding window, filled once the image is covered
+    std::deque<std::pair<long double, uint64_t>> window;
+    uint64_t windowChangedPixels = 0;
+    while(true){
+        if(limits.maxIterations >= 0 && done >= (uint64_t) limits.maxIterations){
+            reason = StopReason::iterationLimit;
+            break;
+        }
+        if(finished && finished(done)){
+            reason = StopReason::iterationLimit;
+            break;
+        }
+        if(limits.targetSeamEnergy >= 0 && coveredPixels == pixels && seamEnergy <= limits.targetSeamEnergy){
+            reason = StopReason::seamEnergyReached;
+            break;
+        }
+        if(limits.convergenceWindow > 0 && (int) window.size() > limits.convergenceWindow){
+            long double decrease = window.front().first - window.back().first;
+            if(decrease <= limits.convergenceTolerance * window.front().first || (double) windowChangedPixels < limits.changedPixelsTolerance * (double) regionPixels){
+                reason = StopReason::converged;
+                break;
+            }
+        }
+        if(limits.timeBudget > std::chrono::nanoseconds::zero()){
+            // the next iteration is expected to take as long as the mean of the previous ones
+            auto elapsed = std::chrono::steady_clock::now() - start;
+            auto expected = done == 0 ? elapsed : elapsed + elapsed / (long) done;
+            if(expected > limits.timeBudget){
+                reason = StopReason::deadline;
+                break;
+            }
+        }
+        if(cancelRequested()){
+            reason = StopReason::cancelled;
+            break;
+        }
+        const auto [inputImg, chosen] = nextPatch();
+        int heightOffset = chosen.heightOffset, widthOffset = chosen.widthOffset;
+        if(cancelRequested()){
+            reason = StopReason::cancelled;
+            break;
+        }
+        // the images outlive the patch fitting, their gradients are computed once (a library keeps its own)
+        const GradientPlanes *imageGradients = nullptr;
+        if(cutCost == CutCost::gradient && library == nullptr){
+            if(chosen.image >= fittingGradients.size())
+                fittingGradients.resize(chosen.image + 1);
+            if(fittingGradients[chosen.image].width() == 0)
+                fittingGradients[chosen.image] = GradientPlanes(*inputImg);
+            imageGradients = &fittingGradients[chosen.image];
+        }
+        // a resynthesized rectangle only takes the part of the patch inside its edit rectangle, so the cut and the
+        // scratch grids don't cover the fixed pixels around it
+        const png::image<png::rgb_pixel> *patchImg = inputImg;
+        png::image<png::rgb_pixel> cropped;
+        SourcePixel origin = {(uint32_t) chosen.exemplar, 0, 0};
+        if(editSet){
+            const int firstRow = std::max(0, editTop - heightOffset), lastRow = std::min((int) inputImg->get_height(), editBottom - heightOffset);
+            const int firstCol = std::max(0, editLeft - widthOffset), lastCol = std::min((int) inputImg->get_width(), editRight - widthOffset);
+            M_ASSERT("the patch must overlap the edit rectangle", firstRow < lastRow && firstCol < lastCol);
+            if(firstRow > 0 || firstCol > 0 || lastRow < (int) inputImg->get_height() || lastCol < (int) inputImg->get_width()){
+                cropped.resize(lastCol - firstCol, lastRow - firstRow);
+                for(int i = firstRow; i < lastRow; i++)
+                    for(int j = firstCol; j < lastCol; j++)
+                        cropped[i - firstRow][j - firstCol] = (*inputImg)[i][j];
+                patchImg = &cropped;
+                heightOffset += firstRow, widthOffset += firstCol;
+                origin.row = (uint16_t) firstRow, origin.col = (uint16_t) firstCol;
+                // the planes of the whole image don't line up with the crop, placePatch computes its own
+                imageGradients = nullptr;
+            }
+        }
+        placePatch(heightOffset, widthOffset, *patchImg, origin, library, material, imageGradients);
+        done++;
+        if(limits.convergenceWindow > 0 && coveredPixels == pixels){
+            // the window holds the state before its first iteration and after each of its iterations
+            if(!window.empty())
+                windowChangedPixels += lastChangedPixels;
+            window.emplace_back(seamEnergy, lastChangedPixels);
+            if((int) window.size() > limits.convergenceWindow + 1){
+                window.pop_front();
+                windowChangedPixels -= window.front().second;
+            }
+        }
+        if(limits.progress && limits.progressEvery > 0 && done % limits.progressEvery == 0)
+            limits.progress(currentProgress(done, start));
+    }
+    // the indices of the images are those of this patch fitting
+    fittingGradients.clear();
+    Progress result = currentProgress(done, start);
+    result.stopReason = reason;
+    return result;
+}
+ImageTexture::Progress ImageTexture::patchFitting(const std::string &file_name, const FittingLimits &limits){
+    png::image<png::rgb_pixel> input_file;
+    try{
+        input_file = readImage(file_name);
+    } catch(...){
+        std::cerr<<"Invalid name for input file"<<std::endl;
+        Progress result = currentProgress(0, std::chrono::steady_clock::now());
+        result.stopReason = StopReason::cancelled;
+        return result;
+    }
+    return patchFitting(input_file, limits);
+}
+void ImageTexture::patchFittingScanline(const png::image<png::rgb_pixel> &inputImg, const std::string &file_name, int overlap){
+    const int inputHeight = inputImg.get_height(), inputWidth = inputImg.get_width();
+    // neighbor patches share at least a row and step at least a row, so the input needs two of each
+    if(inputHeight < 2 || inputWidth < 2)
+        throw std::runtime_error("The input image of the scanline synthesis must be at least 2x2");
+    overlap = std::clamp(overlap, 1, std::min(inputHeight, inputWidth) - 1);
+    const int heightStep = inputHeight - overlap, widthStep = inputWidth - overlap;
+    // horizontal jitter of the patches, so the seams don't line up in columns
+    std::uniform_int_distribution<int> jitter(-overlap / 4, overlap / 4);
+    PngStreamWriter writer(file_name, imgWidth, imgHeight);
+    std::vector<png::rgb_pixel> row(imgWidth);
+    for(int heightOffset = 0; writer.rowsWritten() < imgHeight; heightOffset += heightStep){
+        for(int widthOffset = 0; widthOffset < imgWidth; widthOffset += widthStep){
+            int jitteredOffset = widthOffset == 0 ? 0 : widthOffset + jitter(rng);
+            if(isFirstPatch(heightOffset, jitteredOffset, inputImg))
+                copyFirstPatch(heightOffset, jitteredOffset, inputImg);
+            else
+                blending(heightOffset, jitteredOffset, inputImg);
+        }
+        // later patches start at the next band, the rows above it are final
+        int finalRows = heightOffset + inputHeight >= imgHeight ? imgHeight : std::min(imgHeight, heightOffset + heightStep);
+        int firstRow = writer.rowsWritten();
+        for(int i = firstRow; i < finalRows; i++){
+            for(int j = 0; j < imgWidth; j++)
+                row[j] = outputImg[i][j];
+            writer.writeRow(row.data());
+        }
+        writer.flush();
+        // one row is kept above the next band, its status is still read by the cuts
+        outputImg.releaseRows(0, finalRows - 1);
+        pixelColorStatus.releaseRows(0, finalRows - 1);
+        releaseScratch(true);
+    }
+}
+void ImageTexture::patchFittingScanline(const std::string &input_file_name, const std::string &file_name, int overlap){
+    png::image<png::rgb_pixel> input_file;
+    try{
+        input_file = readImage(input_file_name);
+    } catch(...){
+        std::cerr<<"Invalid name for input file"<<std::endl;
+        return;
+    }
+    patchFittingScanline(input_file, file_name, overlap);
 }
 void ImageTexture::patchFittingIteration(const png::image<png::rgb_pixel> &inputImg){
     const auto [heightOffset, widthOffset] = matching(inputImg);
-    if(isFirstPatch(heightOffset, widthOffset, inputImg)){
-        copyFirstPatch(heightOffset, widthOffset, inputImg);
-    }else
-        blending(heightOffset, widthOffset, inputImg);
+    placePatch(heightOffset, widthOffset, inputImg);
+}
+void ImageTexture::patchFittingIteration(const ExemplarLibrary &library, int candidates){
+    M_ASSERT("there must be an exemplar", library.size() > 0);
+    const Candidate chosen = matching(library, candidates);
+    placePatch(chosen.heightOffset, chosen.widthOffset, library.image(chosen.exemplar), {(uint32_t) chosen.exemplar, 0, 0}, &library);
+}
+void ImageTexture::patchFittingIteration(const MaterialSet &material){
+    const auto [heightOffset, widthOffset] = matching(material.guide());
+    placePatch(heightOffset, widthOffset, material.guide(), {0, 0, 0}, nullptr, &material);
 }
 void ImageTexture::patchFittingIteration(const std::string &file_name){
     png::image<png::rgb_pixel> input_file;
     try{
-        input_file = png::image<png::rgb_pixel>(file_name);
+        input_file = readImage(file_name);
     } catch(...){
         std::cerr<<"Invalid name for input file"<<std::endl;
         return;
@@ -128,17 +603,47 @@ void ImageTexture::patchFittingIteration(const std::string &file_name){
 void ImageTexture::blending(int heightOffset, int widthOffset, const png::image<png::rgb_pixel> &inputImg){
     M_ASSERT("the new rectangle can't be all outside the output image",-(int) inputImg.get_height() + 1 <= heightOffset && heightOffset <= imgHeight-1);
     M_ASSERT("the new rectangle can't be all outside the output image",-(int) inputImg.get_width() + 1 <= widthOffset && widthOffset <= imgWidth-1);
+    // the stale output gradients are computed while every old pixel is still colored, the cut changes their status
+    if(cutCost == CutCost::gradient && outputGradientsStale){
+        updateOutputGradients(0, 0, imgHeight, imgWidth);
+        outputGradientsStale = false;
+    }
+    // the seams need to know which pixels of the new patch had a color before, and the cuts which ones are fixed
+    // (written for every pixel of the patch, so the concurrent cuts only read allocated tiles)
+    const bool constrained = holeSet || editSet;
+    for(int i = 0, a = i + heightOffset; i < (int) inputImg.get_height() && a < this->imgHeight; i++, a++)
+        for(int j = 0, b = j + widthOffset; j < (int) inputImg.get_width() && b < this->imgWidth; j++, b++){
+            if(a < 0 || b < 0)
+                continue;
+            if(pixelColorStatus[a][b] == PixelStatusEnum::colored)
+                wasColored[a][b] = true;
+            if(constrained)
+                fixedInPatch[a][b] = isFixed(a, b);
+        }
     if(this->stPlanarGraph(heightOffset, widthOffset, inputImg)){
         this->blendingCase1(heightOffset, widthOffset, inputImg);
     }
     else{
         this->blendingCase2(heightOffset, widthOffset, inputImg);
+        case2Count++;
     }
+    for(int i = 0, a = i + heightOffset; i < (int) inputImg.get_height() && a < this->imgHeight; i++, a++)
+        for(int j = 0, b = j + widthOffset; j < (int) inputImg.get_width() && b < this->imgWidth; j++, b++){
+            if(a < 0 || b < 0)
+                continue;
+            // the intersections were colored pixels
+            if(wasColored[a][b])
+                intersectionOf[a][b] = -1;
+            wasColored[a][b] = false;
+            if(constrained)
+                fixedInPatch[a][b] = false;
+        }
+    releaseScratch();
 }
 void ImageTexture::blending(int heightOffset, int widthOffset, const std::string &file_name){
     png::image<png::rgb_pixel> input_file;
     try{
-        input_file = png::image<png::rgb_pixel>(file_name);
+        input_file = readImage(file_name);
     } catch(...){
         return;
     }
@@ -158,11 +663,730 @@ Private Functions
  * @return std::pair<int, int> 
  */
 std::pair<int, int> ImageTexture::matching(const png::image<png::rgb_pixel> &inputImg){
-    static std::uniform_int_distribution<int> nextHeight(-(int) inputImg.get_height() + 1, imgHeight-1);
-    static std::uniform_int_distribution<int> nextWidth(-(int) inputImg.get_width() + 1, imgWidth-1);
+    // the distributions keep no state, so the positions depend only on the state of rng
+    // the patch overlaps the placement region (the whole image unless a hole is being filled)
+    std::uniform_int_distribution<int> nextHeight(placeTop - (int) inputImg.get_height() + 1, placeBottom-1);
+    std::uniform_int_distribution<int> nextWidth(placeLeft - (int) inputImg.get_width() + 1, placeRight-1);
     return {nextHeight(rng), nextWidth(rng)};
 }
 
+/**
+ * @brief chooses the exemplar and position with the lowest matching cost among random candidates
+ * 
+ * The positions are drawn sequentially from rng, so the choice depends only on the state of rng and of the
+ * output image, then their costs are computed in parallel. Ties are broken by the drawing order.
+ * 
+ * @param library exemplars from which the patch will be copied
+ * @param candidates number of positions drawn, shared by the exemplars of the library
+ * @return Candidate 
+ */
+ImageTexture::Candidate ImageTexture::matching(const ExemplarLibrary &library, int candidates){
+    candidates = std::max(1, candidates);
+    std::vector<Candidate> drawn;
+    drawn.reserve((size_t) candidates);
+    // the exemplars take turns from a random one, so the cost doesn't grow with the variants of the library and
+    // no exemplar is favored by the ties or by a budget smaller than the library
+    std::uniform_int_distribution<size_t> firstExemplar(0, library.size() - 1);
+    const size_t firstTurn = firstExemplar(rng);
+    for(int k = 0; k < candidates; k++){
+        const size_t e = (firstTurn + (size_t) k) % library.size();
+        std::uniform_int_distribution<int> nextHeight(placeTop - library.height(e) + 1, placeBottom-1);
+        std::uniform_int_distribution<int> nextWidth(placeLeft - library.width(e) + 1, placeRight-1);
+        int heightOffset = nextHeight(rng);
+        drawn.push_back({e, heightOffset, nextWidth(rng)});
+    }
+    std::vector<MatchingCost> cost(drawn.size());
+    auto evaluate = [&](size_t first, size_t step){
+        for(size_t c = first; c < drawn.size(); c += step)
+            cost[c] = matchingCost(library, drawn[c]);
+    };
+    ThreadPool &pool = ThreadPool::shared();
+    const size_t tasks = std::min(drawn.size(), (size_t) pool.size());
+    std::vector<std::future<void>> running;
+    for(size_t t = 1; t < tasks; t++)
+        running.push_back(pool.submit([&evaluate, t, tasks]{ evaluate(t, tasks); }));
+    evaluate(0, std::max<size_t>(1, tasks));
+    for(auto &task : running)
+        task.get();
+    // while the output isn't covered positions that color new pixels come first, then positions that overlap colored pixels
+    auto rank = [&](size_t c){ return std::make_tuple(cost[c].uncolored == 0, !cost[c].overlaps, cost[c].cost); };
+    size_t best = 0;
+    for(size_t c = 1; c < drawn.size(); c++)
+        if(rank(c) < rank(best))
+            best = c;
+    return drawn[best];
+}
+/**
+ * @brief mean squared difference between the candidate patch and the colored pixels under it, divided by the variance of its exemplar
+ * 
+ * With a guide the mean squared difference between the luminance of the patch and of the target under it (divided by
+ * the same variance) is summed in the same pass and weighted with the overlap cost. The samples of a grayscale library
+ * are compared at 16 bits (see outputSample), with the variance of the samples.
+ * 
+ * Time complexity: linear on the number of pixels of the exemplar
+ * 
+ * @param library exemplars from which the patch will be copied
+ * @param candidate exemplar and position of the patch
+ * @return MatchingCost the cost, the number of pixels it would color for the first time and if it has a colored pixel under it
+ */
+ImageTexture::MatchingCost ImageTexture::matchingCost(const ExemplarLibrary &library, const Candidate &candidate) const{
+    const int height = library.height(candidate.exemplar), width = library.width(candidate.exemplar);
+    const png::byte *pixels = library.pixels(candidate.exemplar);
+    // a resynthesized rectangle only takes the part of the patch inside its edit rectangle (see fitPatches)
+    const int top = editSet ? editTop : 0, bottom = editSet ? editBottom : imgHeight;
+    const int left = editSet ? editLeft : 0, right = editSet ? editRight : imgWidth;
+    const int firstRow = std::max(0, top - candidate.heightOffset), lastRow = std::min(height, bottom - candidate.heightOffset);
+    const int firstCol = std::max(0, left - candidate.widthOffset), lastCol = std::min(width, right - candidate.widthOffset);
+    const uint16_t *samples = library.hasSamples() ? library.samples(candidate.exemplar) : nullptr;
+    uint64_t sum = 0, overlap = 0, uncolored = 0, guideSum = 0;
+    long double sampleSum = 0;
+    for(int i = firstRow; i < lastRow; i++){
+        const auto status = pixelColorStatus[i + candidate.heightOffset];
+        const auto output = outputImg[i + candidate.heightOffset];
+        const png::byte *row = pixels + ((size_t) i * width) * 3;
+        if(guideLuma){
+            const auto guide = (*guideLuma)[i + candidate.heightOffset];
+            for(int j = firstCol; j < lastCol; j++){
+                const int d = luma(row[3 * j], row[3 * j + 1], row[3 * j + 2]) - guide[j + candidate.widthOffset];
+                guideSum += (uint64_t) (d * d);
+            }
+        }
+        if(samples != nullptr){
+            const uint16_t *sampleRow = samples + (size_t) i * width;
+            for(int j = firstCol; j < lastCol; j++){
+                const int b = j + candidate.widthOffset;
+                if(status[b] != PixelStatusEnum::colored){
+                    uncolored++;
+                    continue;
+                }
+                sampleSum += squaredColorDistance(png::gray_pixel_16(outputSample(i + candidate.heightOffset, b, library)), png::gray_pixel_16(sampleRow[j]));
+                overlap++;
+            }
+            continue;
+        }
+        for(int j = firstCol; j < lastCol; j++){
+            const int b = j + candidate.widthOffset;
+            if(status[b] != PixelStatusEnum::colored){
+                uncolored++;
+                continue;
+            }
+            const png::rgb_pixel &p = output[b];
+            const int dr = p.red - row[3 * j], dg = p.green - row[3 * j + 1], db = p.blue - row[3 * j + 2];
+            sum += (uint64_t) (dr * dr + dg * dg + db * db);
+            overlap++;
+        }
+    }
+    const double variance = samples != nullptr ? library.sampleVariance(candidate.exemplar) : library.variance(candidate.exemplar);
+    double cost = overlap == 0 ? 0 : samples != nullptr ? (double) (sampleSum / overlap) / variance : (double) sum / (3.0 * (double) overlap * variance);
+    if(guideLuma){
+        const uint64_t pixelsUnder = (uint64_t) std::max(0, lastRow - firstRow) * std::max(0, lastCol - firstCol);
+        cost = (1 - guideWeight) * cost + guideWeight * (pixelsUnder == 0 ? 0 : (double) guideSum / ((double) pixelsUnder * variance));
+    }
+    return {cost, uncolored, overlap > 0};
+}
+png::byte ImageTexture::luma(png::byte red, png::byte green, png::byte blue){
+    return (png::byte) ((299 * red + 587 * green + 114 * blue + 500) / 1000);
+}
+/**
+ * @brief 16 bit sample of the colored pixel (i, j) of a texture synthesized from a grayscale library
+ * 
+ * It is the sample of its source in the library, or its 8 bit luminance for the pixels that didn't come from it.
+ */
+uint16_t ImageTexture::outputSample(int i, int j, const ExemplarLibrary &library) const{
+    const SourcePixel &source = sourceMap[i][j];
+    if(source.exemplar < library.size() && source.row < library.height(source.exemplar) && source.col < library.width(source.exemplar))
+        return library.samples(source.exemplar)[(size_t) source.row * library.width(source.exemplar) + source.col];
+    const png::rgb_pixel &p = outputImg[i][j];
+    return (uint16_t) (257 * luma(p.red, p.green, p.blue));
+}
+/**
+ * @brief places the new patch at this position, copying it if it is the first patch there and blending it otherwise
+ * 
+ * @param heightOffset height position of the upper left corner of the input image on the output image
+ * @param widthOffset width position of the upper left corner of the input image on the output image
+ * @param inputImg png::image object from which the patch will be copied
+ * @param origin exemplar pixel of the upper left pixel of inputImg, unknownExemplar if it isn't from a library
+ * @param library library of the exemplar of origin (null if it isn't from a library)
+ * @param material material of the layers of the patch (null if it isn't from a material)
+ * @param gradients gradients of inputImg when it isn't from a library (null to compute them for this patch with the gradient cost)
+ */
+void ImageTexture::placePatch(int heightOffset, int widthOffset, const png::image<png::rgb_pixel> &inputImg, SourcePixel origin, const ExemplarLibrary *library, const MaterialSet *material, const GradientPlanes *gradients){
+    putPatch(heightOffset, widthOffset, inputImg, origin, library, material, gradients);
+    countIteration();
+}
+/**
+ * @brief places the new patch like placePatch, without counting the iteration, so a trial patch can be undone
+ */
+void ImageTexture::putPatch(int heightOffset, int widthOffset, const png::image<png::rgb_pixel> &inputImg, SourcePixel origin, const ExemplarLibrary *library, const MaterialSet *material, const GradientPlanes *gradients){
+    patchOrigin = origin;
+    patchLibrary = library;
+    patchMaterial = material;
+    if(cutCost == CutCost::gradient){
+        if(library != nullptr && origin.exemplar != unknownExemplar){
+            patchGradients = &library->gradients(origin.exemplar);
+            patchGradientRow = origin.row;
+            patchGradientCol = origin.col;
+        } else if(gradients != nullptr){
+            patchGradients = gradients;
+            patchGradientRow = patchGradientCol = 0;
+        }
+    }
+    for(size_t k = layerImgs.size(); material != nullptr && k < material->size(); k++)
+        layerImgs.push_back(std::make_unique<MappedGrid<png::rgb_pixel>>(imgHeight, imgWidth, backingFile.empty() ? "" : backingFile + ".layer" + std::to_string(k)));
+    lastCutCost = 0;
+    lastChangedPixels = 0;
+    if(isFirstPatch(heightOffset, widthOffset, inputImg)){
+        copyFirstPatch(heightOffset, widthOffset, inputImg);
+    }else
+        blending(heightOffset, widthOffset, inputImg);
+    // blending and the scanline fitting copy patches without placePatch, they have no source
+    patchOrigin = {unknownExemplar, 0, 0};
+    patchLibrary = nullptr;
+    patchMaterial = nullptr;
+    patchGradients = nullptr;
+    releaseScratch();
+}
+/**
+ * @brief counts a placed patch, and writes the checkpoint every checkpointInterval patches
+ */
+void ImageTexture::countIteration(){
+    iterations++;
+    if(checkpointInterval > 0 && iterations % checkpointInterval == 0)
+        checkpoint(checkpointFile);
+}
+uint64_t ImageTexture::setHole(const png::image<png::rgb_pixel> &img, const png::image<png::rgb_pixel> &mask){
+    M_ASSERT("the image must have the size of the texture", (int) img.get_width() == imgWidth && (int) img.get_height() == imgHeight);
+    M_ASSERT("the mask must have the size of the texture", (int) mask.get_width() == imgWidth && (int) mask.get_height() == imgHeight);
+    waitCheckpoint();
+    clearHole();
+    holeTop = imgHeight, holeLeft = imgWidth, holeBottom = 0, holeRight = 0;
+    uint64_t holePixels = 0;
+    for(int i = 0; i < imgHeight; i++)
+        for(int j = 0; j < imgWidth; j++){
+            const bool hole = mask[i][j].red > 127;
+            outputImg[i][j] = hole ? png::rgb_pixel(0, 0, 0) : img[i][j];
+            pixelColorStatus[i][j] = hole ? PixelStatusEnum::notcolored : PixelStatusEnum::colored;
+            seamCost[i][j] = {0, 0};
+            sourceMap[i][j] = {unknownExemplar, 0, 0};
+            if(hole){
+                inHole[i][j] = true;
+                holePixels++;
+                holeTop = std::min(holeTop, i), holeBottom = std::max(holeBottom, i + 1);
+                holeLeft = std::min(holeLeft, j), holeRight = std::max(holeRight, j + 1);
+            }
+        }
+    holeSet = holePixels > 0;
+    if(!holeSet)
+        holeTop = holeLeft = 0;
+    outputGradientsStale = true;
+    seamEnergy = 0;
+    coveredPixels = (uint64_t) imgWidth * imgHeight - holePixels;
+    lastCutCost = 0;
+    lastChangedPixels = 0;
+    return holePixels;
+}
+ImageTexture::Progress ImageTexture::fillHole(const ExemplarLibrary &library, const FittingLimits &limits, int candidates){
+    M_ASSERT("there must be an exemplar", library.size() > 0);
+    return fitHole(limits, [&](){
+        const Candidate chosen = matching(library, candidates);
+        return std::make_pair(&library.image(chosen.exemplar), chosen);
+    }, &library);
+}
+ImageTexture::Progress ImageTexture::fillHole(const png::image<png::rgb_pixel> &inputImg, const FittingLimits &limits){
+    return fitHole(limits, [&](){
+        const auto [heightOffset, widthOffset] = matching(inputImg);
+        return std::make_pair(&inputImg, Candidate{unknownExemplar, heightOffset, widthOffset});
+    }, nullptr);
+}
+void ImageTexture::clearHole(){
+    inHole.release();
+    holeSet = false;
+    holeTop = holeLeft = holeBottom = holeRight = 0;
+}
+/**
+ * @brief patch fitting with the placement region on the bounding box of the hole
+ * 
+ * @param limits limits of the synthesis
+ * @param nextPatch chooses the exemplar and position of the next patch
+ * @param library library of the exemplars (null if they aren't from a library)
+ * @return Progress 
+ */
+ImageTexture::Progress ImageTexture::fitHole(const FittingLimits &limits, const PatchChooser &nextPatch, const ExemplarLibrary *library){
+    M_ASSERT("there must be a hole, see setHole", holeSet);
+    placeTop = holeTop, placeLeft = holeLeft, placeBottom = holeBottom, placeRight = holeRight;
+    Progress result;
+    try{
+        result = fitPatches(limits, nextPatch, library);
+    } catch(...){
+        placeTop = placeLeft = 0, placeBottom = imgHeight, placeRight = imgWidth;
+        throw;
+    }
+    placeTop = placeLeft = 0, placeBottom = imgHeight, placeRight = imgWidth;
+    return result;
+}
+ImageTexture::Progress ImageTexture::resynthesize(const ExemplarLibrary &library, int top, int left, int bottom, int right, int count, int candidates, int margin){
+    M_ASSERT("there must be an exemplar", library.size() > 0);
+    return resynthesizeRect(top, left, bottom, right, count, margin, [&](){
+        const Candidate chosen = matching(library, candidates);
+        return std::make_pair(&library.image(chosen.exemplar), chosen);
+    }, &library);
+}
+ImageTexture::Progress ImageTexture::resynthesize(const png::image<png::rgb_pixel> &inputImg, int top, int left, int bottom, int right, int count, int margin){
+    return resynthesizeRect(top, left, bottom, right, count, margin, [&](){
+        const auto [heightOffset, widthOffset] = matching(inputImg);
+        return std::make_pair(&inputImg, Candidate{unknownExemplar, heightOffset, widthOffset});
+    }, nullptr);
+}
+/**
+ * @brief uncolors the rectangle and places patches over it until it is covered, changing only the pixels up to margin pixels around it
+ * 
+ * @param top first row of the rectangle
+ * @param left first column of the rectangle
+ * @param bottom row after the last row of the rectangle
+ * @param right column after the last column of the rectangle
+ * @param count number of patches placed before testing if the rectangle is covered
+ * @param margin pixels around the rectangle that the cuts can change
+ * @param nextPatch chooses the exemplar and position of the next patch
+ * @param library library of the exemplars (null if they aren't from a library)
+ * @return Progress 
+ */
+ImageTexture::Progress ImageTexture::resynthesizeRect(int top, int left, int bottom, int right, int count, int margin, const PatchChooser &nextPatch, const ExemplarLibrary *library){
+    const auto start = std::chrono::steady_clock::now();
+    top = std::clamp(top, 0, imgHeight), bottom = std::clamp(bottom, top, imgHeight);
+    left = std::clamp(left, 0, imgWidth), right = std::clamp(right, left, imgWidth);
+    if(top == bottom || left == right)
+        return currentProgress(0, start);
+    waitCheckpoint();
+    // the patches must replace every pixel of the rectangle, its seams go away with its colors
+    for(int a = top; a < bottom; a++)
+        for(int b = left; b < right; b++){
+            if(pixelColorStatus[a][b] == PixelStatusEnum::colored){
+                pixelColorStatus[a][b] = PixelStatusEnum::notcolored;
+                coveredPixels--;
+            }
+            for(int dir = 0; dir < 4; dir++){
+                const int nA = a + directions[dir].first, nB = b + directions[dir].second;
+                if(!insidePrimal(nA, nB))
+                    continue;
+                float &edge = dir == 0 ? seamCost[nA][nB][1] : dir == 1 ? seamCost[nA][nB][0] : dir == 2 ? seamCost[a][b][1] : seamCost[a][b][0];
+                seamEnergy -= edge;
+                edge = 0;
+            }
+        }
+    if(cutCost == CutCost::gradient && !outputGradientsStale)
+        updateOutputGradients(top - 1, left - 1, bottom + 1, right + 1);
+    margin = std::max(0, margin);
+    placeTop = top, placeLeft = left, placeBottom = bottom, placeRight = right;
+    editSet = true;
+    editTop = std::max(0, top - margin), editLeft = std::max(0, left - margin);
+    editBottom = std::min(imgHeight, bottom + margin), editRight = std::min(imgWidth, right + margin);
+    auto restore = [this]{
+        placeTop = placeLeft = 0, placeBottom = imgHeight, placeRight = imgWidth;
+        editSet = false;
+    };
+    auto covered = [&]{
+        for(int a = top; a < bottom; a++)
+            for(int b = left; b < right; b++)
+                if(pixelColorStatus[a][b] != PixelStatusEnum::colored)
+                    return false;
+        return true;
+    };
+    uint64_t done = 0;
+    try{
+        // past count patches it goes on until no pixel of the rectangle is left without color, the patches prefer
+        // uncolored pixels (see matching) and the area of the rectangle bounds the ones added to cover it
+        FittingLimits limits;
+        count = std::max(0, count);
+        limits.maxIterations = (int) std::min<int64_t>(std::numeric_limits<int>::max(), (int64_t) count + (int64_t) (bottom - top) * (right - left));
+        done = fitPatches(limits, nextPatch, library, nullptr, [&](uint64_t placed){ return placed >= (uint64_t) count && covered(); }).iterations;
+    } catch(...){
+        restore();
+        throw;
+    }
+    restore();
+    return currentProgress(done, start);
+}
+int ImageTexture::makeTileable(const png::image<png::rgb_pixel> &inputImg, int candidates, int patchSize){
+    return makeTileable(ExemplarLibrary(std::vector<const png::image<png::rgb_pixel> *>{&inputImg}), candidates, patchSize);
+}
+int ImageTexture::makeTileable(const ExemplarLibrary &library, int candidates, int patchSize){
+    M_ASSERT("there must be an exemplar", library.size() > 0);
+    waitCheckpoint();
+    // the roll would move the hole away from its mask
+    clearHole();
+    const int down = imgHeight / 2, right = imgWidth / 2;
+    rollOutput(down, right, library);
+    // the patches stay one pixel inside the borders, which already wrap
+    int maxSide = std::min(imgHeight, imgWidth) - 2;
+    for(size_t e = 0; e < library.size(); e++)
+        maxSide = std::min({maxSide, library.height(e), library.width(e)});
+    patchSize = std::min(patchSize, maxSide);
+    if(patchSize < 4)
+        return 0;
+    // upper left corners of the patches centered on the cross, half a patch apart, and if they are on its vertical line
+    std::vector<std::tuple<int, int, bool>> corners;
+    const int step = std::max(1, patchSize / 2);
+    const int centerTop = std::clamp(down - patchSize / 2, 1, imgHeight - 1 - patchSize);
+    const int centerLeft = std::clamp(right - patchSize / 2, 1, imgWidth - 1 - patchSize);
+    for(int top = 1; ; top += step){
+        top = std::min(top, imgHeight - 1 - patchSize);
+        corners.emplace_back(top, centerLeft, true);
+        if(top == imgHeight - 1 - patchSize)
+            break;
+    }
+    for(int left = 1; ; left += step){
+        left = std::min(left, imgWidth - 1 - patchSize);
+        corners.emplace_back(centerTop, left, false);
+        if(left == imgWidth - 1 - patchSize)
+            break;
+    }
+    std::uniform_int_distribution<size_t> nextExemplar(0, library.size() - 1);
+    int placed = 0;
+    // blends a patch at (top, left) over the band of the vertical or horizontal line of the cross
+    auto repair = [&](int top, int left, bool vertical){
+        // the band of the pixels on both sides of the line across the patch
+        auto inBand = [&](int i, int j){
+            return vertical ? (left + j == right - 1 || left + j == right) : (top + i == down - 1 || top + i == down);
+        };
+        // the window of the exemplars with the lowest mean squared difference over the colored pixels, normalized by the variance
+        Candidate best = {0, 0, 0};
+        double bestCost = std::numeric_limits<double>::infinity();
+        for(int k = 0; k < std::max(1, candidates); k++){
+            const size_t e = nextExemplar(rng);
+            const int row = std::uniform_int_distribution<int>(0, library.height(e) - patchSize)(rng);
+            const int col = std::uniform_int_distribution<int>(0, library.width(e) - patchSize)(rng);
+            const png::byte *pixels = library.pixels(e);
+            double sum = 0;
+            uint64_t overlap = 0;
+            for(int i = 0; i < patchSize; i++){
+                const png::byte *exemplarRow = pixels + ((size_t) (row + i) * library.width(e) + col) * 3;
+                for(int j = 0; j < patchSize; j++){
+                    if(pixelColorStatus[top + i][left + j] != PixelStatusEnum::colored || inBand(i, j))
+                        continue;
+                    const png::rgb_pixel &p = outputImg[top + i][left + j];
+                    const double dr = (double) p.red - exemplarRow[3 * j], dg = (double) p.green - exemplarRow[3 * j + 1], db = (double) p.blue - exemplarRow[3 * j + 2];
+                    sum += dr * dr + dg * dg + db * db;
+                    overlap++;
+                }
+            }
+            const double cost = overlap == 0 ? 0 : sum / (3.0 * (double) overlap * library.variance(e));
+            if(cost < bestCost){
+                bestCost = cost;
+                best = {e, row, col};
+            }
+        }
+        const png::image<png::rgb_pixel> &exemplar = library.image(best.exemplar);
+        png::image<png::rgb_pixel> window(patchSize, patchSize);
+        for(int i = 0; i < patchSize; i++)
+            for(int j = 0; j < patchSize; j++)
+                window[i][j] = exemplar[best.heightOffset + i][best.widthOffset + j];
+        // the band is uncolored, it reaches two sides of the patch so the patch is blended with the cuts of case 1,
+        // which replace the band with the patch and put new seams on both sides of it
+        for(int i = 0; i < patchSize; i++)
+            for(int j = 0; j < patchSize; j++)
+                if(inBand(i, j) && pixelColorStatus[top + i][left + j] == PixelStatusEnum::colored){
+                    pixelColorStatus[top + i][left + j] = PixelStatusEnum::notcolored;
+                    coveredPixels--;
+                }
+        placePatch(top, left, window, {(uint32_t) best.exemplar, (uint16_t) best.heightOffset, (uint16_t) best.widthOffset}, &library);
+        placed++;
+    };
+    for(auto [top, left, vertical] : corners)
+        repair(top, left, vertical);
+    // the ends of the lines, in the border rows and columns, are out of the patches. Rolled down by half the height,
+    // the ends of the vertical line meet in its middle, where a patch cuts them, and rolled right by half the width,
+    // the ends of the horizontal line too. The last roll puts the texture back
+    rollOutput(down, 0, library);
+    repair(centerTop, centerLeft, true);
+    rollOutput(imgHeight - down, right, library);
+    repair(centerTop, centerLeft, false);
+    rollOutput(0, imgWidth - right, library);
+    return placed;
+}
+/**
+ * @brief shifts the rows of a grid of the output image down and its columns right, the cells wrap around
+ * 
+ * Time complexity: linear on the number of cells of the grid
+ * 
+ * @param grid grid with the size of the output image
+ * @param down rows shifted, 0 &le; down &lt; height
+ * @param right columns shifted, 0 &le; right &lt; width
+ */
+template<typename T>
+void ImageTexture::rollGrid(MappedGrid<T> &grid, int down, int right){
+    std::vector<T> row(imgWidth), saved(imgWidth);
+    for(int i = 0; i < imgHeight; i++){
+        for(int j = 0; j < imgWidth; j++)
+            row[j] = grid[i][j];
+        for(int j = 0; j < imgWidth; j++)
+            grid[i][(j + right) % imgWidth] = row[j];
+    }
+    // the rows move along the cycles of the rotation, with one row saved per cycle
+    for(int start = 0, moved = 0; moved < imgHeight; start++){
+        for(int j = 0; j < imgWidth; j++)
+            saved[j] = grid[start][j];
+        int current = start;
+        while(true){
+            const int previous = (current - down + imgHeight) % imgHeight;
+            moved++;
+            if(previous == start)
+                break;
+            for(int j = 0; j < imgWidth; j++)
+                grid[current][j] = grid[previous][j];
+            current = previous;
+        }
+        for(int j = 0; j < imgWidth; j++)
+            grid[current][j] = saved[j];
+    }
+}
+/**
+ * @brief shifts the output image down and right with its pixels wrapping around, and adds the costs of the seams where
+ * its borders meet
+ * 
+ * The layers and the guide are shifted with it.
+ * 
+ * The seams of the pixels of the old last column and row with their new neighbors cost calcCost(p, q, p, q), or
+ * sourceSeamCost when both pixels come from the library.
+ * 
+ * Time complexity: linear on the number of pixels of the output image
+ * 
+ * @param down rows shifted
+ * @param right columns shifted
+ * @param library exemplars of the sources of the pixels
+ */
+void ImageTexture::rollOutput(int down, int right, const ExemplarLibrary &library){
+    rollGrid(outputImg, down, right);
+    rollGrid(pixelColorStatus, down, right);
+    rollGrid(seamCost, down, right);
+    rollGrid(sourceMap, down, right);
+    for(const auto &layerImg : layerImgs)
+        rollGrid(*layerImg, down, right);
+    // the target of each pixel moves with it
+    if(guideLuma)
+        rollGrid(*guideLuma, down, right);
+    outputGradientsStale = true;
+    auto crossCost = [this, &library](int i, int j, int di, int dj){
+        const int nI = i + di, nJ = j + dj;
+        if(pixelColorStatus[i][j] != PixelStatusEnum::colored || pixelColorStatus[nI][nJ] != PixelStatusEnum::colored)
+            return 0.0f;
+        const SourcePixel &sourceP = sourceMap[i][j], &sourceQ = sourceMap[nI][nJ];
+        if(sourceP.exemplar < library.size() && sourceQ.exemplar < library.size())
+            return sourceSeamCost(library, sourceP, outputImg[i][j], sourceQ, outputImg[nI][nJ], di, dj);
+        return (float) calcCost(outputImg[i][j], outputImg[nI][nJ], outputImg[i][j], outputImg[nI][nJ]);
+    };
+    // the old borders had no neighbors, their seams were zero unless the texture was already rolled and they wrapped
+    for(int i = 0; right > 0 && i < imgHeight; i++){
+        seamEnergy -= seamCost[i][right - 1][0];
+        seamCost[i][right - 1][0] = crossCost(i, right - 1, 0, 1);
+        seamEnergy += seamCost[i][right - 1][0];
+    }
+    for(int j = 0; down > 0 && j < imgWidth; j++){
+        seamEnergy -= seamCost[down - 1][j][1];
+        seamCost[down - 1][j][1] = crossCost(down - 1, j, 1, 0);
+        seamEnergy += seamCost[down - 1][j][1];
+    }
+    if(preview)
+        preview->publish(0, 0, imgHeight, imgWidth, outputImg);
+}
+/**
+ * @brief copies the coarse texture, with half the size of this one, to this texture with the exemplars of the library
+ * 
+ * Every pixel gets the exemplar pixel that the source of its coarse pixel covers in the finer exemplar, so the patches
+ * and the seams of the coarse texture are kept. The pixels whose coarse pixel isn't colored by a library stay not colored.
+ * 
+ * Time complexity: linear on the number of pixels of the output image
+ * 
+ * @param coarse texture with the size of this one divided by 2 (rounded up), synthesized with library.downsampled(2)
+ * @param library exemplars of this texture
+ */
+void ImageTexture::upsampleFrom(const ImageTexture &coarse, const ExemplarLibrary &library){
+    coveredPixels = 0;
+    for(int i = 0; i < imgHeight; i++)
+        for(int j = 0; j < imgWidth; j++){
+            const SourcePixel &source = coarse.sourceMap[i / 2][j / 2];
+            if(coarse.pixelColorStatus[i / 2][j / 2] != PixelStatusEnum::colored || source.exemplar == unknownExemplar){
+                pixelColorStatus[i][j] = PixelStatusEnum::notcolored;
+                continue;
+            }
+            const SourcePixel fine = {
+                source.exemplar,
+                (uint16_t) std::min(2 * source.row + i % 2, library.height(source.exemplar) - 1),
+                (uint16_t) std::min(2 * source.col + j % 2, library.width(source.exemplar) - 1)
+            };
+            sourceMap[i][j] = fine;
+            outputImg[i][j] = library.image(fine.exemplar)[fine.row][fine.col];
+            pixelColorStatus[i][j] = PixelStatusEnum::colored;
+            coveredPixels++;
+        }
+    outputGradientsStale = true;
+    computeSeams(library);
+    if(preview)
+        preview->publish(0, 0, imgHeight, imgWidth, outputImg);
+}
+/**
+ * @brief computes the seam costs of the whole output image from the source of each pixel
+ * 
+ * Time complexity: linear on the number of pixels of the output image
+ * 
+ * @param library exemplars of the sources of the pixels
+ */
+void ImageTexture::computeSeams(const ExemplarLibrary &library){
+    seamEnergy = 0;
+    for(int i = 0; i < imgHeight; i++)
+        for(int j = 0; j < imgWidth; j++)
+            for(int k = 0; k < 2; k++){
+                // right neighbor for k = 0, lower neighbor for k = 1
+                const int nA = i + k, nB = j + 1 - k;
+                float cost = 0;
+                if(insidePrimal(nA, nB) && pixelColorStatus[i][j] == PixelStatusEnum::colored && pixelColorStatus[nA][nB] == PixelStatusEnum::colored)
+                    cost = sourceSeamCost(library, sourceMap[i][j], outputImg[i][j], sourceMap[nA][nB], outputImg[nA][nB], k, 1 - k);
+                seamCost[i][j][k] = cost;
+                seamEnergy += cost;
+            }
+}
+/**
+ * @brief cost of the seam between the neighbors p and q = p + (di, dj) from their sources
+ * 
+ * It is calcCost(p, exemplar of q at p, exemplar of p at q, q), so it is zero when both pixels come from the same
+ * position of the same exemplar. A pixel outside the exemplar of the other side uses its own color.
+ * 
+ * @param library exemplars of the sources
+ * @param sourceP source of p (a known exemplar)
+ * @param p color of p
+ * @param sourceQ source of q (a known exemplar)
+ * @param q color of q
+ * @param di height offset from p to q
+ * @param dj width offset from p to q
+ * @return float 
+ */
+float ImageTexture::sourceSeamCost(const ExemplarLibrary &library, const SourcePixel &sourceP, const png::rgb_pixel &p, const SourcePixel &sourceQ, const png::rgb_pixel &q, int di, int dj){
+    // color of the exemplar of the source at (dI, dJ) from it, or fallback outside the exemplar
+    auto shifted = [&library](const SourcePixel &source, int dI, int dJ, const png::rgb_pixel &fallback){
+        const int row = source.row + dI, col = source.col + dJ;
+        if(row < 0 || col < 0 || row >= library.height(source.exemplar) || col >= library.width(source.exemplar))
+            return fallback;
+        return library.image(source.exemplar)[row][col];
+    };
+    return (float) calcCost(p, shifted(sourceQ, -di, -dj, p), shifted(sourceP, di, dj, q), q);
+}
+/**
+ * @brief blends local patches over the costliest seams
+ * 
+ * Each local cut takes the costliest seam of a few random pixels and blends a patchSize &times; patchSize window of the
+ * exemplar of one side of the seam, aligned with that side and centered on the other side, so the cut moves the seam. A cut
+ * that increases the seam energy is undone.
+ * 
+ * Time complexity: O(count &times; patchSize<sup>2</sup> &times; log<sup>2</sup>(patchSize))
+ * 
+ * @param library exemplars of the sources of the pixels
+ * @param count number of local cuts
+ * @param patchSize side of the windows
+ * @param cancel stops before the next local cut when set to true (may be null)
+ * @return int number of local cuts kept
+ */
+int ImageTexture::refineSeams(const ExemplarLibrary &library, int count, int patchSize, const std::atomic<bool> *cancel){
+    patchSize = std::max(2, patchSize);
+    std::uniform_int_distribution<int> nextRow(0, imgHeight - 1), nextCol(0, imgWidth - 1), nextSide(0, 1);
+    int placed = 0;
+    for(int iteration = 0; iteration < count; iteration++){
+        if(cancel != nullptr && cancel->load(std::memory_order_relaxed))
+            break;
+        int a = -1, b = -1, dir = 0;
+        float worst = 0;
+        for(int sample = 0; sample < 8; sample++){
+            const int i = nextRow(rng), j = nextCol(rng);
+            for(int k = 0; k < 2; k++)
+                if(seamCost[i][j][k] > worst){
+                    worst = seamCost[i][j][k];
+                    a = i;
+                    b = j;
+                    dir = k;
+                }
+        }
+        if(a < 0)
+            continue;
+        // the pixel on one side of the seam, its exemplar is extended over the pixel q on the other side
+        const int side = nextSide(rng);
+        const int pA = a + side * dir, pB = b + side * (1 - dir);
+        const int qA = a + (1 - side) * dir, qB = b + (1 - side) * (1 - dir);
+        const SourcePixel source = sourceMap[pA][pB];
+        if(source.exemplar == unknownExemplar)
+            continue;
+        const png::image<png::rgb_pixel> &exemplar = library.image(source.exemplar);
+        const int exemplarHeight = library.height(source.exemplar), exemplarWidth = library.width(source.exemplar);
+        // the window is centered at q, the cut of a window inside the colored pixels always takes its center
+        const int top = std::clamp(source.row + qA - pA - patchSize / 2, 0, std::max(0, exemplarHeight - patchSize));
+        const int left = std::clamp(source.col + qB - pB - patchSize / 2, 0, std::max(0, exemplarWidth - patchSize));
+        const int height = std::min(patchSize, exemplarHeight), width = std::min(patchSize, exemplarWidth);
+        if(height < 2 || width < 2)
+            continue;
+        png::image<png::rgb_pixel> window(width, height);
+        for(int i = 0; i < height; i++)
+            for(int j = 0; j < width; j++)
+                window[i][j] = exemplar[top + i][left + j];
+        const int heightOffset = pA - (source.row - top), widthOffset = pB - (source.col - left);
+        // the cut must take the center of the window, so it can make the seams worse, then the pixels are restored
+        // (the seams above and left of the window are stored in the pixels around it). The cut is only counted as an
+        // iteration, and checkpointed, once it is kept
+        const int firstRow = std::max(0, heightOffset - 1), lastRow = std::min(imgHeight, heightOffset + height);
+        const int firstCol = std::max(0, widthOffset - 1), lastCol = std::min(imgWidth, widthOffset + width);
+        struct SavedPixel{
+            png::rgb_pixel color;
+            PixelStatusEnum status;
+            SourcePixel source;
+            std::array<float, 2> seams;
+        };
+        std::vector<SavedPixel> saved;
+        saved.reserve((size_t) (lastRow - firstRow) * (lastCol - firstCol));
+        for(int i = firstRow; i < lastRow; i++)
+            for(int j = firstCol; j < lastCol; j++)
+                saved.push_back({outputImg[i][j], pixelColorStatus[i][j], sourceMap[i][j], seamCost[i][j]});
+        const long double energyBefore = seamEnergy;
+        const uint64_t coveredBefore = coveredPixels, case2Before = case2Count, iterationsBefore = iterations;
+        putPatch(heightOffset, widthOffset, window, {source.exemplar, (uint16_t) top, (uint16_t) left}, &library, nullptr, nullptr);
+        if(seamEnergy <= energyBefore){
+            countIteration();
+            placed++;
+            continue;
+        }
+        auto pixel = saved.begin();
+        for(int i = firstRow; i < lastRow; i++)
+            for(int j = firstCol; j < lastCol; j++, pixel++){
+                outputImg[i][j] = pixel->color;
+                pixelColorStatus[i][j] = pixel->status;
+                sourceMap[i][j] = pixel->source;
+                seamCost[i][j] = pixel->seams;
+            }
+        if(cutCost == CutCost::gradient && !outputGradientsStale)
+            updateOutputGradients(firstRow - 1, firstCol - 1, lastRow + 1, lastCol + 1);
+        seamEnergy = energyBefore;
+        coveredPixels = coveredBefore;
+        case2Count = case2Before;
+        iterations = iterationsBefore;
+        lastCutCost = 0;
+        lastChangedPixels = 0;
+        if(preview)
+            preview->publish(firstRow, firstCol, lastRow, lastCol, outputImg);
+    }
+    return placed;
+}
+/**
+ * @brief state of the synthesis reported by the patch fitting with limits
+ * 
+ * @param iterationsDone iterations done by the patch fitting
+ * @param start time when the patch fitting started
+ */
+ImageTexture::Progress ImageTexture::currentProgress(uint64_t iterationsDone, std::chrono::steady_clock::time_point start) const{
+    Progress progress;
+    progress.iterations = iterationsDone;
+    progress.coverage = 100.0 * (double) coveredPixels / ((double) imgWidth * imgHeight);
+    progress.case2Count = case2Count;
+    progress.seamEnergy = seamEnergy;
+    progress.lastCutCost = lastCutCost;
+    progress.lastChangedPixels = lastChangedPixels;
+    progress.elapsedSeconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+    return progress;
+}
 /**
  * @brief tests if the input image has any intersection with existing patches
  * 
@@ -244,11 +1468,66 @@ bool ImageTexture::stPlanarGraph(int heightOffset, int widthOffset, const png::i
     }
     return false;
 } 
+/**
+ * @brief blends a patch whose border crosses colored pixels, with a cut in each intersection
+ * 
+ * The intersections are pixel disjoint, and the cut of one doesn't read the pixels of the others, so with more than
+ * one cut and more than one core they are cut concurrently on the shared pool, each one with its own scratch: first
+ * their dual graphs and costs, which read the pixels around them, then the searches, which change only the pixels of
+ * their intersection. When the dual graph of an intersection has enough vertices for the parallel search (see
+ * parallelCut), the intersections are cut one by one, each one with all the cores.
+ */
 void ImageTexture::blendingCase1(int heightOffset, int widthOffset, const png::image<png::rgb_pixel> &inputImg){
     std::vector<Intersection> intersections = findIntersections(heightOffset, widthOffset, inputImg);
+    // intersections with a cut, and their S and T
+    std::vector<std::tuple<const Intersection *, std::pair<int, int>, std::pair<int, int>>> cuts;
     for(auto &inter : intersections){
         auto [S, T] = findSTInIntersectionCase1(inter);
-        markMinABCut(S, T, inter, heightOffset, widthOffset, inputImg);
+        // an island of colored pixels inside the patch (around a hole or a resynthesized rectangle) has no cut, the patch covers it
+        if(S == std::pair<int, int>{-1, -1}){
+            for(const auto &[i, j] : inter.interPixels)
+                pixelColorStatus[i][j] = PixelStatusEnum::newcolor;
+            continue;
+        }
+        cuts.emplace_back(&inter, S, T);
+    }
+    ThreadPool &pool = ThreadPool::shared();
+    const size_t tasks = std::min(cuts.size(), (size_t) pool.size());
+    // the vertices of the dual graphs, which the searches visit, are only needed to choose how to cut more than one
+    std::vector<std::vector<std::pair<int, int>>> inDual(tasks > 1 ? cuts.size() : 0);
+    size_t largest = 0;
+    for(size_t c = 0; c < inDual.size(); c++){
+        inDual[c] = dualCells(*std::get<0>(cuts[c]));
+        largest = std::max(largest, inDual[c].size());
+    }
+    if(tasks <= 1 || parallelCut(largest)){
+        for(const auto &[inter, S, T] : cuts)
+            markMinABCut(*cutScratch[0], S, T, *inter, heightOffset, widthOffset, inputImg);
+    }else{
+        prepareEdgeCosts(inputImg);
+        while(cutScratch.size() < cuts.size())
+            cutScratch.push_back(std::make_unique<CutScratch>(imgHeight, imgWidth));
+        // runs cut(c) for each cut, the task t runs the cuts t, t + tasks...
+        auto concurrently = [&](const std::function<void(size_t)> &cut){
+            auto run = [&cut, &cuts, tasks](size_t t){
+                for(size_t c = t; c < cuts.size(); c += tasks)
+                    cut(c);
+            };
+            std::vector<std::future<void>> running;
+            for(size_t t = 1; t < tasks; t++)
+                running.push_back(pool.submit([&run, t]{ run(t); }));
+            run(0);
+            for(auto &task : running)
+                task.get();
+        };
+        concurrently([&](size_t c){
+            for(auto [i, j] : inDual[c])
+                cutScratch[c]->inSubgraph[i][j] = true;
+            markIntersectionEdgeCostsInDual(*cutScratch[c], *std::get<0>(cuts[c]), heightOffset, widthOffset, inputImg, inDual[c]);
+        });
+        concurrently([&](size_t c){
+            cutIntersectionInDual(*cutScratch[c], std::get<1>(cuts[c]), std::get<2>(cuts[c]), *std::get<0>(cuts[c]), inDual[c], false);
+        });
     }
     copyPixelsNewColor(heightOffset, widthOffset, inputImg);
 
@@ -257,19 +1536,25 @@ void ImageTexture::blendingCase1(int heightOffset, int widthOffset, const png::i
             for(int j = 0, b = j + widthOffset; j < (int) inputImg.get_width() && b < this->imgWidth; j++, b++){
                 if(a < 0 || b < 0)
                     continue;
-                M_ASSERT("All pixels should be colored", pixelColorStatus[a][b] == PixelStatusEnum::colored);
+                M_ASSERT("All pixels should be colored", pixelColorStatus[a][b] == PixelStatusEnum::colored || isFixed(a, b));
             }
     }
 }
 void ImageTexture::blendingCase2(int heightOffset, int widthOffset, const png::image<png::rgb_pixel> &inputImg){
+    CutScratch &scratch = *cutScratch[0];
     /*find intersection*/
     auto intersections = findIntersections(heightOffset, widthOffset, inputImg);
-    M_ASSERT("", intersections.size() == 1);
+    M_ASSERT("", !intersections.empty());
     Intersection inter = intersections[0];
+    // the first intersection has the border of the patch, the others are islands inside it (around a hole or a
+    // resynthesized rectangle) with no cut, the patch covers them
+    for(size_t k = 1; k < intersections.size(); k++)
+        for(const auto &[i, j] : intersections[k].interPixels)
+            pixelColorStatus[i][j] = PixelStatusEnum::newcolor;
     
     /*mark cells in dual of intersection and mark edges costs*/
-    std::vector<std::pair<int, int>> cellsInDual = markIntersectionCellsInDual(inter);
-    markIntersectionEdgeCostsInDual(heightOffset, widthOffset, inputImg, cellsInDual);
+    std::vector<std::pair<int, int>> cellsInDual = markIntersectionCellsInDual(scratch, inter);
+    markIntersectionEdgeCostsInDual(scratch, inter, heightOffset, widthOffset, inputImg, cellsInDual);
 
     /*find ST path*/
     auto S = findSCase2(heightOffset, widthOffset, inputImg);
@@ -277,11 +1562,11 @@ void ImageTexture::blendingCase2(int heightOffset, int widthOffset, const png::i
         for(auto [x, y] : inter.interPixels)
             pixelColorStatus[x][y] = PixelStatusEnum::colored;
         for(auto [i,j]: cellsInDual)
-            inSubgraph[i][j] = false;
+            scratch.inSubgraph[i][j] = false;
         return;
     }
     auto T = dualBorder(heightOffset, widthOffset, inputImg);
-    auto tsPath = findSTPath(S, T);
+    auto tsPath = findSTPath(scratch, S, T, cellsInDual);
     
 
     // exit by right - original graph
@@ -299,25 +1584,25 @@ void ImageTexture::blendingCase2(int heightOffset, int widthOffset, const png::i
         for(int i =0; i < int(tsPath.size()) - 1; i++){
             auto [x, y] = tsPath[i];
             auto [nextX, nextY] = tsPath[i+1];
-            int d = parent[x][y];
+            int d = scratch.parent[x][y];
             edgeTo[edgeType::copyGraph][nextX][nextY][revDir(d)] = edgeType::copyGraph;
             edgeTo[edgeType::copyGraph][x][y][d] = edgeType::copyGraph;
         }
         {// dealing with edges of T
-            int d = prevDir( revDir(parent[secondX][secondY]) );
+            int d = prevDir( revDir(scratch.parent[secondX][secondY]) );
             auto [lastX, lastY] = tsPath.back();
             for(int i = 0; i < 3; i++){
                 int nextX = lastX + directions[d].first, nextY = lastY + directions[d].second;
-                if(insideDual(nextX, nextY) && inSubgraph[nextX][nextY]){
+                if(insideDual(nextX, nextY) && scratch.inSubgraph[nextX][nextY]){
                     edgeTo[edgeType::originalGraph][nextX][nextY][revDir(d)] = edgeType::invalid;
                     if(inS[nextX][nextY]) break;
                 }
                 d = prevDir(d);
             }
-            d = nextDir( revDir(parent[secondX][secondY]) );
+            d = nextDir( revDir(scratch.parent[secondX][secondY]) );
             for(int i = 0; i < 3; i++){
                 int nextX = lastX + directions[d].first, nextY = lastY + directions[d].second;
-                if(insideDual(nextX, nextY) && inSubgraph[nextX][nextY]){
+                if(insideDual(nextX, nextY) && scratch.inSubgraph[nextX][nextY]){
                     edgeTo[edgeType::originalGraph][nextX][nextY][revDir(d)] = edgeType::copyGraph;
                     edgeTo[edgeType::originalGraph][lastX][lastY][d] = edgeType::invalid;
                     if(inS[nextX][nextY]) break;
@@ -329,19 +1614,19 @@ void ImageTexture::blendingCase2(int heightOffset, int widthOffset, const png::i
         // edges from original graph to copy graph, to close the cycle
         for(int i =0; i < int(tsPath.size()) - 1; i++){
             auto [x, y] = tsPath[i];
-            int d = prevDir(parent[x][y]);
+            int d = prevDir(scratch.parent[x][y]);
             int nextX = x + directions[d].first, nextY = y + directions[d].second;
-            if((i > 0 && tsPath[i-1] == std::make_pair(nextX, nextY)) || (i == 0 && d == revDir(parent[x][y])))
+            if((i > 0 && tsPath[i-1] == std::make_pair(nextX, nextY)) || (i == 0 && d == revDir(scratch.parent[x][y])))
                 continue;
-            if(insideDual(nextX, nextY) && inSubgraph[nextX][nextY]){
+            if(insideDual(nextX, nextY) && scratch.inSubgraph[nextX][nextY]){
                 edgeTo[edgeType::originalGraph][nextX][nextY][revDir(d)] = edgeType::copyGraph;
                 edgeTo[edgeType::originalGraph][x][y][d] = edgeType::invalid;
             }
             d = prevDir(d);
             nextX = x + directions[d].first, nextY = y + directions[d].second;
-            if((i > 0 && tsPath[i-1] == std::make_pair(nextX, nextY))|| (i == 0 && d == revDir(parent[x][y])))
+            if((i > 0 && tsPath[i-1] == std::make_pair(nextX, nextY))|| (i == 0 && d == revDir(scratch.parent[x][y])))
                 continue;
-            if(insideDual(nextX, nextY) && inSubgraph[nextX][nextY]){
+            if(insideDual(nextX, nextY) && scratch.inSubgraph[nextX][nextY]){
                 edgeTo[edgeType::originalGraph][nextX][nextY][revDir(d)] = edgeType::copyGraph;
                 edgeTo[edgeType::originalGraph][x][y][d] = edgeType::invalid;
             }
@@ -349,18 +1634,18 @@ void ImageTexture::blendingCase2(int heightOffset, int widthOffset, const png::i
         // invalid edges, so we must go to the left first
         for(int i =0; i < int(tsPath.size()) - 1; i++){
             auto [x, y] = tsPath[i];
-            int d = nextDir(parent[x][y]);
+            int d = nextDir(scratch.parent[x][y]);
             int nextX = x + directions[d].first, nextY = y + directions[d].second;
-            if((i > 0 && tsPath[i-1] == std::make_pair(nextX, nextY)) || (i == 0 && d == revDir(parent[x][y])))
+            if((i > 0 && tsPath[i-1] == std::make_pair(nextX, nextY)) || (i == 0 && d == revDir(scratch.parent[x][y])))
                 continue;
-            if(insideDual(nextX, nextY) && inSubgraph[nextX][nextY]){
+            if(insideDual(nextX, nextY) && scratch.inSubgraph[nextX][nextY]){
                 edgeTo[edgeType::originalGraph][nextX][nextY][revDir(d)] = edgeType::invalid;
             }
             d = nextDir(d);
             nextX = x + directions[d].first, nextY = y + directions[d].second;
-            if((i > 0 && tsPath[i-1] == std::make_pair(nextX, nextY)) || (i == 0 && d == revDir(parent[x][y])))
+            if((i > 0 && tsPath[i-1] == std::make_pair(nextX, nextY)) || (i == 0 && d == revDir(scratch.parent[x][y])))
                 continue;
-            if(insideDual(nextX, nextY) && inSubgraph[nextX][nextY]){
+            if(insideDual(nextX, nextY) && scratch.inSubgraph[nextX][nextY]){
                 edgeTo[edgeType::originalGraph][nextX][nextY][revDir(d)] = edgeType::invalid;
             }
         }
@@ -372,7 +1657,7 @@ void ImageTexture::blendingCase2(int heightOffset, int widthOffset, const png::i
         minCut = minCutCycle(0, (int) tsPath.size(), tsPath, visited);
         
         /*mark left and right of min cut*/
-        markLeftOfMinCut(tsPath);
+        markLeftOfMinCut(scratch, inter, tsPath);
         /*mark right of min cut*/{    
             for(auto [i, j] : inter.interPixels)
                 if(pixelColorStatus[i][j] == PixelStatusEnum::intersection){
@@ -399,25 +1684,25 @@ void ImageTexture::blendingCase2(int heightOffset, int widthOffset, const png::i
         for(int i =0; i < int(tsPath.size()) - 1; i++){
             auto [x, y] = tsPath[i];
             auto [nextX, nextY] = tsPath[i+1];
-            int d = parent[x][y];
+            int d = scratch.parent[x][y];
             edgeTo[edgeType::copyGraph][nextX][nextY][revDir(d)] = edgeType::originalGraph;
             edgeTo[edgeType::copyGraph][x][y][d] = edgeType::originalGraph;
         }
         {// dealing with edges of T
-            int d = prevDir( revDir(parent[secondX][secondY]) );
+            int d = prevDir( revDir(scratch.parent[secondX][secondY]) );
             auto [lastX, lastY] = tsPath.back();
             for(int i = 0; i < 3; i++){
                 int nextX = lastX + directions[d].first, nextY = lastY + directions[d].second;
-                if(insideDual(nextX, nextY) && inSubgraph[nextX][nextY]){
+                if(insideDual(nextX, nextY) && scratch.inSubgraph[nextX][nextY]){
                     edgeTo[edgeType::originalGraph][nextX][nextY][revDir(d)] = edgeType::originalGraph;
                     if(inS[nextX][nextY]) break;
                 }
                 d = prevDir(d);
             }
-            d = nextDir( revDir(parent[secondX][secondY]) );
+            d = nextDir( revDir(scratch.parent[secondX][secondY]) );
             for(int i = 0; i < 3; i++){
                 int nextX = lastX + directions[d].first, nextY = lastY + directions[d].second;
-                if(insideDual(nextX, nextY) && inSubgraph[nextX][nextY]){
+                if(insideDual(nextX, nextY) && scratch.inSubgraph[nextX][nextY]){
                     edgeTo[edgeType::originalGraph][nextX][nextY][revDir(d)] = edgeType::originalGraph;
                     edgeTo[edgeType::originalGraph][lastX][lastY][d] = edgeType::originalGraph;
                     if(inS[nextX][nextY]) break;
@@ -429,19 +1714,19 @@ void ImageTexture::blendingCase2(int heightOffset, int widthOffset, const png::i
         // edges from original graph to copy graph, to close the cycle
         for(int i =0; i < int(tsPath.size()) - 1; i++){
             auto [x, y] = tsPath[i];
-            int d = prevDir(parent[x][y]);
+            int d = prevDir(scratch.parent[x][y]);
             int nextX = x + directions[d].first, nextY = y + directions[d].second;
-            if((i > 0 && tsPath[i-1] == std::make_pair(nextX, nextY)) || (i == 0 && d == revDir(parent[x][y])))
+            if((i > 0 && tsPath[i-1] == std::make_pair(nextX, nextY)) || (i == 0 && d == revDir(scratch.parent[x][y])))
                 continue;
-            if(insideDual(nextX, nextY) && inSubgraph[nextX][nextY]){
+            if(insideDual(nextX, nextY) && scratch.inSubgraph[nextX][nextY]){
                 edgeTo[edgeType::originalGraph][nextX][nextY][revDir(d)] = edgeType::originalGraph;
                 edgeTo[edgeType::originalGraph][x][y][d] = edgeType::originalGraph;
             }
             d = prevDir(d);
             nextX = x + directions[d].first, nextY = y + directions[d].second;
-            if((i > 0 && tsPath[i-1] == std::make_pair(nextX, nextY))|| (i == 0 && d == revDir(parent[x][y])))
+            if((i > 0 && tsPath[i-1] == std::make_pair(nextX, nextY))|| (i == 0 && d == revDir(scratch.parent[x][y])))
                 continue;
-            if(insideDual(nextX, nextY) && inSubgraph[nextX][nextY]){
+            if(insideDual(nextX, nextY) && scratch.inSubgraph[nextX][nextY]){
                 edgeTo[edgeType::originalGraph][nextX][nextY][revDir(d)] = edgeType::originalGraph;
                 edgeTo[edgeType::originalGraph][x][y][d] = edgeType::originalGraph;
             }
@@ -449,18 +1734,18 @@ void ImageTexture::blendingCase2(int heightOffset, int widthOffset, const png::i
         // invalid edges, so we must go to the left first
         for(int i =0; i < int(tsPath.size()) - 1; i++){
             auto [x, y] = tsPath[i];
-            int d = nextDir(parent[x][y]);
+            int d = nextDir(scratch.parent[x][y]);
             int nextX = x + directions[d].first, nextY = y + directions[d].second;
-            if((i > 0 && tsPath[i-1] == std::make_pair(nextX, nextY)) || (i == 0 && d == revDir(parent[x][y])))
+            if((i > 0 && tsPath[i-1] == std::make_pair(nextX, nextY)) || (i == 0 && d == revDir(scratch.parent[x][y])))
                 continue;
-            if(insideDual(nextX, nextY) && inSubgraph[nextX][nextY]){
+            if(insideDual(nextX, nextY) && scratch.inSubgraph[nextX][nextY]){
                 edgeTo[edgeType::originalGraph][nextX][nextY][revDir(d)] = edgeType::originalGraph;
             }
             d = nextDir(d);
             nextX = x + directions[d].first, nextY = y + directions[d].second;
-            if((i > 0 && tsPath[i-1] == std::make_pair(nextX, nextY)) || (i == 0 && d == revDir(parent[x][y])))
+            if((i > 0 && tsPath[i-1] == std::make_pair(nextX, nextY)) || (i == 0 && d == revDir(scratch.parent[x][y])))
                 continue;
-            if(insideDual(nextX, nextY) && inSubgraph[nextX][nextY]){
+            if(insideDual(nextX, nextY) && scratch.inSubgraph[nextX][nextY]){
                 edgeTo[edgeType::originalGraph][nextX][nextY][revDir(d)] = edgeType::originalGraph;
             }
         }
@@ -477,9 +1762,9 @@ void ImageTexture::blendingCase2(int heightOffset, int widthOffset, const png::i
 
     /*unmark cells in dual of intersection*/{
         for(auto [i,j] : cellsInDual){
-            inSubgraph[i][j] = false;
-            parent[i][j] = -1;
-            vis[i][j] = false;
+            scratch.inSubgraph[i][j] = false;
+            scratch.parent[i][j] = -1;
+            scratch.vis[i][j] = false;
         }
     }
 }
@@ -490,9 +1775,8 @@ long double ImageTexture::pow2(long double x){
 }
 template<typename Pixel>
 long double ImageTexture::calcCost(const Pixel &as, const Pixel &bs, const Pixel &at, const Pixel &bt){
-    long double cost =
-    sqrtl(pow2((int)as.red-bs.red) + pow2((int)as.green-bs.green) + pow2((int)as.blue-bs.blue)) +
-    sqrtl(pow2((int)at.red-bt.red) + pow2((int)at.green-bt.green) + pow2((int)at.blue-bt.blue));
+    // the distance of pixeltraits.hpp, compiled for the rgb pixels and for the 16 bit samples
+    long double cost = colorDistance(as, bs) + colorDistance(at, bt);
     return cost;
 }
 
@@ -510,6 +1794,15 @@ int ImageTexture::revDir(int i){
 }
 // Auxiliar Nonstatic Functions
 void ImageTexture::copyPixelsNewColor(int heightOffset, int widthOffset, const png::image<png::rgb_pixel> &inputImg, bool case2){
+    // the fixed pixels keep their color (or stay not colored), the seams of the patch are computed against them. The
+    // cuts already keep the colored ones on the old side (see markEdgeCosts), this only reverts the pixels that were
+    // not colored, the islands covered without a cut and the fixed pixels enclosed by the new pixels
+    if(holeSet || editSet)
+        for(int a = std::max(0, heightOffset); a < std::min(imgHeight, heightOffset + (int) inputImg.get_height()); a++)
+            for(int b = std::max(0, widthOffset); b < std::min(imgWidth, widthOffset + (int) inputImg.get_width()); b++)
+                if(pixelColorStatus[a][b] == PixelStatusEnum::newcolor && isFixed(a, b))
+                    pixelColorStatus[a][b] = wasColored[a][b] ? PixelStatusEnum::colored : PixelStatusEnum::notcolored;
+    updateSeams(heightOffset, widthOffset, inputImg);
     for(int i = 0, a = i + heightOffset; i < (int) inputImg.get_height() && a < this->imgHeight; i++, a++)
         for(int j = 0, b = j + widthOffset; j < (int) inputImg.get_width() && b < this->imgWidth; j++, b++){
             if(a < 0 || b < 0)
@@ -528,6 +1821,63 @@ void ImageTexture::copyPixelsNewColor(int heightOffset, int widthOffset, const p
             if(pixelColorStatus[a][b] == PixelStatusEnum::newcolor){
                 outputImg[a][b] = inputImg[i][j];
                 pixelColorStatus[a][b] = PixelStatusEnum::colored;
+                sourceMap[a][b] = patchOrigin.exemplar == unknownExemplar ? patchOrigin
+                    : SourcePixel{patchOrigin.exemplar, (uint16_t) (patchOrigin.row + i), (uint16_t) (patchOrigin.col + j)};
+                // the layers get the pixels of the same cut
+                for(size_t k = 0; patchMaterial != nullptr && k < patchMaterial->size(); k++)
+                    (*layerImgs[k])[a][b] = patchMaterial->layer(k)[i][j];
+            }
+        }
+    // the gradients of the pixels next to the patch change as well
+    if(cutCost == CutCost::gradient && !outputGradientsStale)
+        updateOutputGradients(heightOffset - 1, widthOffset - 1, heightOffset + (int) inputImg.get_height() + 1, widthOffset + (int) inputImg.get_width() + 1);
+    if(preview)
+        preview->publish(heightOffset, widthOffset, heightOffset + (int) inputImg.get_height(), widthOffset + (int) inputImg.get_width(), outputImg);
+}
+/**
+ * @brief updates the seam costs around the pixels that will get the color of the new patch
+ * 
+ * The cost of a seam between a pixel p of the new patch and a kept pixel q is calcCost(old p, new p, old q, new q),
+ * a pixel without an old color uses its new color and a pixel outside the new patch keeps its old color.
+ * When both pixels come from a library the cost is sourceSeamCost of their sources instead.
+ * Seams between two pixels of the new patch are removed.
+ * 
+ * @param heightOffset height position of the upper left corner of the input image on the output image
+ * @param widthOffset width position of the upper left corner of the input image on the output image
+ * @param inputImg png::image object from which the patch will be copied
+ * 
+ * Time complexity: linear on the number of pixels of the input image
+ */
+void ImageTexture::updateSeams(int heightOffset, int widthOffset, const png::image<png::rgb_pixel> &inputImg){
+    for(int i = 0, a = i + heightOffset; i < (int) inputImg.get_height() && a < this->imgHeight; i++, a++)
+        for(int j = 0, b = j + widthOffset; j < (int) inputImg.get_width() && b < this->imgWidth; j++, b++){
+            if(a < 0 || b < 0 || pixelColorStatus[a][b] != PixelStatusEnum::newcolor)
+                continue;
+            const png::rgb_pixel &oldP = wasColored[a][b] ? outputImg[a][b] : inputImg[i][j];
+            if(!wasColored[a][b])
+                coveredPixels++;
+            lastChangedPixels++;
+            for(int dir = 0; dir < 4; dir++){
+                const auto [dI, dJ] = directions[dir];
+                int nA = a + dI, nB = b + dJ;
+                if(!insidePrimal(nA, nB))
+                    continue;
+                // up and left seams are stored in the neighbor
+                float &edge = dir == 0 ? seamCost[nA][nB][1] : dir == 1 ? seamCost[nA][nB][0] : dir == 2 ? seamCost[a][b][1] : seamCost[a][b][0];
+                float cost = 0;
+                if(pixelColorStatus[nA][nB] == PixelStatusEnum::colored){
+                    const png::rgb_pixel &oldQ = outputImg[nA][nB];
+                    if(patchLibrary != nullptr && patchOrigin.exemplar != unknownExemplar && sourceMap[nA][nB].exemplar != unknownExemplar){
+                        const SourcePixel sourceP = {patchOrigin.exemplar, (uint16_t) (patchOrigin.row + i), (uint16_t) (patchOrigin.col + j)};
+                        cost = sourceSeamCost(*patchLibrary, sourceP, inputImg[i][j], sourceMap[nA][nB], oldQ, dI, dJ);
+                    } else{
+                        const png::rgb_pixel &newQ = insideImg(nA - heightOffset, nB - widthOffset, inputImg) ? inputImg[nA - heightOffset][nB - widthOffset] : oldQ;
+                        cost = (float) calcCost(oldP, inputImg[i][j], oldQ, newQ);
+                    }
+                }
+                seamEnergy += (long double) cost - edge;
+                lastCutCost += cost;
+                edge = cost;
             }
         }
 }
@@ -544,41 +1894,130 @@ bool ImageTexture::insideDual(int i, int j){
 bool ImageTexture::insideImg(int i, int j, const png::image<png::rgb_pixel> &img){
     return 0 <= i && i < int(img.get_height()) && 0 <= j && j < int(img.get_width());
 }
+bool ImageTexture::isFixed(int i, int j){
+    if(editSet && (i < editTop || i >= editBottom || j < editLeft || j >= editRight))
+        return true;
+    // the mask is only read inside the bounding box, so no tile is allocated away from the hole
+    return holeSet && (i < holeTop || i >= holeBottom || j < holeLeft || j >= holeRight || !inHole[i][j]);
+}
+/**
+ * @brief the pixel (i, j) is one of the pixels of inter still waiting for its side of the cut
+ * 
+ * The index is only read after the status, which findIntersections set with it, so it is never stale.
+ */
+bool ImageTexture::inIntersection(int i, int j, const Intersection &inter){
+    return insidePrimal(i, j) && pixelColorStatus[i][j] == PixelStatusEnum::intersection && intersectionOf[i][j] == inter.index;
+}
+void ImageTexture::releaseScratch(bool always){
+    // every auxiliar variable is back to its default value after a blending,
+    // so the tiles can be released when the working set grows too much
+    size_t resident = std::max({inS.resident(), inStPath.resident(), inCutCycle.resident(),
+        edgeTo[0].resident(), edgeTo[1].resident(), distCase2[0].resident(), distCase2[1].resident(), visCase2[0].resident(),
+        visCase2[1].resident(), seenCase2[0].resident(), seenCase2[1].resident(), parentCase2[0].resident(), parentCase2[1].resident(),
+        wasColored.resident(), fixedInPatch.resident(), intersectionOf.resident()});
+    for(const auto &scratch : cutScratch)
+        resident = std::max(resident, scratch->resident());
+    if(!always && resident <= maxResidentScratchTiles)
+        return;
+    for(auto grid : {&wasColored, &fixedInPatch, &inS})
+        grid->release();
+    for(auto grid : {&intersectionOf, &inStPath, &inCutCycle, &visCase2[0], &visCase2[1], &seenCase2[0], &seenCase2[1], &parentCase2[0], &parentCase2[1]})
+        grid->release();
+    for(auto grid : {&distCase2[0], &distCase2[1]})
+        grid->release();
+    edgeTo[0].release();
+    edgeTo[1].release();
+    // the scratch of the concurrent cuts is allocated again by the next patch that needs it
+    cutScratch.resize(1);
+    cutScratch[0]->release();
+}
 // Auxiliar class
-ImageTexture::Intersection::Intersection(const std::vector<std::pair<int,int>> &pixels) : interPixels(pixels){};
+ImageTexture::Intersection::Intersection(const std::vector<std::pair<int,int>> &pixels, int interIndex) : interPixels(pixels), index(interIndex){};
+ImageTexture::CutScratch::CutScratch(int height, int width)
+    :
+    inSubgraph(height + 1, width + 1, false),
+    edgesCosts(height + 1, width + 1),
+    dist(height + 1, width + 1),
+    vis(height + 1, width + 1, false),
+    parent(height + 1, width + 1, -1),
+    validEdge(height + 1, width + 1, {true,true,true,true}),
+    isT(height + 1, width + 1, false),
+    isS(height + 1, width + 1, false),
+    distBackward(height + 1, width + 1),
+    visBackward(height + 1, width + 1, false),
+    parentBackward(height + 1, width + 1, -1)
+    {
+}
+size_t ImageTexture::CutScratch::resident() const{
+    return std::max({inSubgraph.resident(), edgesCosts.resident(), dist.resident(), vis.resident(), parent.resident(), validEdge.resident(),
+        isT.resident(), isS.resident(), distBackward.resident(), visBackward.resident(), parentBackward.resident()});
+}
+size_t ImageTexture::CutScratch::residentBytes() const{
+    return inSubgraph.residentBytes() + edgesCosts.residentBytes() + dist.residentBytes() + vis.residentBytes() + parent.residentBytes()
+        + validEdge.residentBytes() + isT.residentBytes() + isS.residentBytes() + distBackward.residentBytes() + visBackward.residentBytes()
+        + parentBackward.residentBytes();
+}
+void ImageTexture::CutScratch::release(){
+    for(auto grid : {&inSubgraph, &vis, &isT, &isS, &visBackward})
+        grid->release();
+    for(auto grid : {&parent, &parentBackward})
+        grid->release();
+    for(auto grid : {&dist, &distBackward})
+        grid->release();
+    edgesCosts.release();
+    validEdge.release();
+}
 std::pair<std::pair<int, int>, std::pair<int, int> > ImageTexture::findSTInIntersectionCase1(ImageTexture::Intersection &inter){
-    std::pair<int, int> S = {-1,-1}, T = {-1,-1};
-    for(const auto &[i, j] : inter.interPixels){
-        for(int d = 0; d < (int) directions.size(); d++){
-            int neiI = i + directions[d].first;
-            int neiJ = j + directions[d].second;
-            if(!insidePrimal(neiI, neiJ) || pixelColorStatus[neiI][neiJ] != PixelStatusEnum::newcolor)
+    // the fixed pixels of the intersection are on the old side (see markEdgeCosts), the cut starts and ends next to them
+    const bool constrained = holeSet || editSet;
+    auto search = [&](bool skipFixed){
+        auto onOldSide = [&](int a, int b){
+            return (pixelColorStatus[a][b] != PixelStatusEnum::newcolor && pixelColorStatus[a][b] != PixelStatusEnum::intersection)
+                || (skipFixed && pixelColorStatus[a][b] == PixelStatusEnum::intersection && fixedInPatch[a][b]);
+        };
+        std::pair<int, int> S = {-1,-1}, T = {-1,-1};
+        for(const auto &[i, j] : inter.interPixels){
+            if(skipFixed && fixedInPatch[i][j])
                 continue;
-            { //S
-                int nextI = i + directions[prevDir(d)].first;
-                int nextJ = j + directions[prevDir(d)].second;
-                if(!insidePrimal(nextI, nextJ)){
-                    S = {i + primalToDual[prevDir(d)].first, j + primalToDual[prevDir(d)].second};
-                }else if(pixelColorStatus[nextI][nextJ] != PixelStatusEnum::newcolor && pixelColorStatus[nextI][nextJ] != PixelStatusEnum::intersection){
-                    S = {i + primalToDual[prevDir(d)].first, j + primalToDual[prevDir(d)].second};
-                }
-
-            }
-            { //T
-                    int nextI = i + directions[nextDir(d)].first;
-                    int nextJ = j + directions[nextDir(d)].second;
+            for(int d = 0; d < (int) directions.size(); d++){
+                int neiI = i + directions[d].first;
+                int neiJ = j + directions[d].second;
+                if(!insidePrimal(neiI, neiJ) || pixelColorStatus[neiI][neiJ] != PixelStatusEnum::newcolor)
+                    continue;
+                { //S
+                    int nextI = i + directions[prevDir(d)].first;
+                    int nextJ = j + directions[prevDir(d)].second;
                     if(!insidePrimal(nextI, nextJ)){
-                        T = {i + primalToDual[d].first, j + primalToDual[d].second};
-                    }else if(pixelColorStatus[nextI][nextJ] != PixelStatusEnum::newcolor && pixelColorStatus[nextI][nextJ] != PixelStatusEnum::intersection){
-                        T = {i + primalToDual[d].first, j + primalToDual[d].second};
+                        S = {i + primalToDual[prevDir(d)].first, j + primalToDual[prevDir(d)].second};
+                    }else if(onOldSide(nextI, nextJ)){
+                        S = {i + primalToDual[prevDir(d)].first, j + primalToDual[prevDir(d)].second};
                     }
+
+                }
+                { //T
+                        int nextI = i + directions[nextDir(d)].first;
+                        int nextJ = j + directions[nextDir(d)].second;
+                        if(!insidePrimal(nextI, nextJ)){
+                            T = {i + primalToDual[d].first, j + primalToDual[d].second};
+                        }else if(onOldSide(nextI, nextJ)){
+                            T = {i + primalToDual[d].first, j + primalToDual[d].second};
+                        }
+                }
             }
         }
-    }
+        return std::make_pair(S, T);
+    };
+    auto [S, T] = search(constrained);
+    // neither is found when only fixed pixels touch the new ones, the patch covers the others. With a single one, the
+    // free pixels have no cut of their own, the cut goes through the fixed ones and copyPixelsNewColor keeps them
+    const std::pair<int, int> none = {-1, -1};
+    if(constrained && ((S == none) != (T == none) || (S == T && S != none)))
+        std::tie(S, T) = search(false);
     
-    M_ASSERT("findSTInIntersectionCase1 should always find S", (S) != (std::pair<int, int>{-1,-1}));
-    M_ASSERT("findSTInIntersectionCase1 should always find T", (T) != (std::pair<int, int>{-1,-1}));
-    M_ASSERT("findSTInIntersectionCase1 should find different S and T", (S) != (T));
+    // neither is found on an island surrounded by the new patch
+    M_ASSERT("findSTInIntersectionCase1 should always find S", (S) != (std::pair<int, int>{-1,-1}) || (T) == (std::pair<int, int>{-1,-1}));
+    M_ASSERT("findSTInIntersectionCase1 should always find T", (T) != (std::pair<int, int>{-1,-1}) || (S) == (std::pair<int, int>{-1,-1}));
+    M_ASSERT("findSTInIntersectionCase1 should find different S and T", (S) != (T) || (S) == (std::pair<int, int>{-1,-1}));
     return {S, T};
 }
 std::vector<ImageTexture::Intersection> ImageTexture::findIntersections(int heightOffset, int widthOffset, const png::image<png::rgb_pixel> &inputImg){
@@ -588,8 +2027,10 @@ std::vector<ImageTexture::Intersection> ImageTexture::findIntersections(int heig
             if(a < 0 || b < 0)
                 continue;
             if(pixelColorStatus[a][b] == PixelStatusEnum::colored){
+                const int index = (int) intersectionsList.size();
                 std::vector<std::pair<int,int>> interPixels;
                 pixelColorStatus[a][b] = PixelStatusEnum::intersection;
+                intersectionOf[a][b] = index;
                 interPixels.emplace_back(a,b);
                 for(int front = 0; front < (int) interPixels.size(); front++){
                     auto [iFront, jFront] = interPixels[front];
@@ -602,43 +2043,54 @@ std::vector<ImageTexture::Intersection> ImageTexture::findIntersections(int heig
                         if(pixelColorStatus[nborI][nborJ] != PixelStatusEnum::colored) continue;
                         interPixels.emplace_back(nborI,nborJ);
                         pixelColorStatus[nborI][nborJ] = PixelStatusEnum::intersection;
+                        intersectionOf[nborI][nborJ] = index;
                     
                     }
                 }
-                intersectionsList.push_back(Intersection(interPixels));
+                intersectionsList.push_back(Intersection(interPixels, index));
             } else if(pixelColorStatus[a][b] == PixelStatusEnum::notcolored){
                 pixelColorStatus[a][b] = PixelStatusEnum::newcolor;
             }      
         }  
     return intersectionsList;
 }
-void ImageTexture::markMinABCut(std::pair<int, int> S, std::pair<int, int> T, const ImageTexture::Intersection &inter, int heightOffset, int widthOffset, const png::image<png::rgb_pixel> &inputImg){
+void ImageTexture::markMinABCut(CutScratch &scratch, std::pair<int, int> S, std::pair<int, int> T, const ImageTexture::Intersection &inter, int heightOffset, int widthOffset, const png::image<png::rgb_pixel> &inputImg){
     /*mark cells in dual of intersection and mark edges costs*/
     
-    std::vector<std::pair<int, int>> inDual = markIntersectionCellsInDual(inter);
-    markIntersectionEdgeCostsInDual(heightOffset, widthOffset, inputImg, inDual);
-    /*find min cut (min s-t path)*/
-    auto tsPath = findSTPath({S}, {T});
+    std::vector<std::pair<int, int>> inDual = markIntersectionCellsInDual(scratch, inter);
+    markIntersectionEdgeCostsInDual(scratch, inter, heightOffset, widthOffset, inputImg, inDual);
+    cutIntersectionInDual(scratch, S, T, inter, inDual, true);
+}
+/**
+ * @brief marks the pixels of the intersection on the side of the old pixels of its minimum S-T cut as colored, and the others as newcolor
+ * 
+ * The cells and edge costs of the intersection are already marked in the dual graph of the scratch, which is unmarked.
+ * 
+ * @param parallelSearch the search may run on the shared pool (not from a task of the pool)
+ */
+void ImageTexture::cutIntersectionInDual(CutScratch &scratch, std::pair<int, int> S, std::pair<int, int> T, const ImageTexture::Intersection &inter, const std::vector<std::pair<int, int>> &inDual, bool parallelSearch){
+    /*find min cut (min s-t path), from both ends unless the graph is searched on all the cores*/
+    auto tsPath = parallelSearch && parallelCut(inDual.size()) ? findSTPath(scratch, {S}, {T}, inDual) : findSTPathBidirectional(scratch, S, T);
     
     /*mark edges on the path*/
-    M_ASSERT("T should always be visited, intersection is connected", (vis[T.first][T.second]));
+    M_ASSERT("T should always be visited, intersection is connected", (scratch.vis[T.first][T.second]));
     
     /*mark ST path*/{
         int lastD = -1;
         for(auto [curI, curJ] : tsPath){
             if(lastD >= 0){
-                validEdge[curI][curJ][lastD] = false;
+                scratch.validEdge[curI][curJ][lastD] = false;
             }
-            int d = parent[curI][curJ];
+            int d = scratch.parent[curI][curJ];
             if(d >= 0){
-                validEdge[curI][curJ][d] = false;
+                scratch.validEdge[curI][curJ][d] = false;
                 lastD = revDir(d);
             }
         }
     }    
     
     /*mark left and right of min cut*/
-    markLeftOfMinCut(tsPath);
+    markLeftOfMinCut(scratch, inter, tsPath);
     /*mark right of min cut*/{    
         for(auto [i, j] : inter.interPixels)
             if(pixelColorStatus[i][j] == PixelStatusEnum::intersection){
@@ -651,11 +2103,11 @@ void ImageTexture::markMinABCut(std::pair<int, int> S, std::pair<int, int> T, co
             int lastD = -1;
             for(auto [curI, curJ] : tsPath){
                 if(lastD >= 0){
-                    validEdge[curI][curJ][lastD] = true;
+                    scratch.validEdge[curI][curJ][lastD] = true;
                 }
-                int d = parent[curI][curJ];
+                int d = scratch.parent[curI][curJ];
                 if(d >= 0){
-                    validEdge[curI][curJ][d] = true;
+                    scratch.validEdge[curI][curJ][d] = true;
                     lastD = revDir(d);
                 }
             }
@@ -665,78 +2117,185 @@ void ImageTexture::markMinABCut(std::pair<int, int> S, std::pair<int, int> T, co
         for(auto [i,j] : inter.interPixels)
             for(auto [di, dj] : primalToDual)
                 if(insideDual(i + di, j + dj)){
-                    inSubgraph[i + di][j + dj] = false;
-                    parent[i + di][j + dj] = -1;
-                    vis[i + di][j + dj] = false;
+                    scratch.inSubgraph[i + di][j + dj] = false;
+                    scratch.parent[i + di][j + dj] = -1;
+                    scratch.vis[i + di][j + dj] = false;
+                    scratch.parentBackward[i + di][j + dj] = -1;
+                    scratch.visBackward[i + di][j + dj] = false;
                 }
     }
 }
-std::vector<std::pair<int, int>> ImageTexture::markIntersectionCellsInDual(const Intersection &inter){
+std::vector<std::pair<int, int>> ImageTexture::markIntersectionCellsInDual(CutScratch &scratch, const Intersection &inter){
+    std::vector<std::pair<int, int>> inDual = dualCells(inter);
+    for(auto [i,j] : inDual)
+        scratch.inSubgraph[i][j] = true;
+    return inDual;
+}
+/**
+ * @brief the vertices of the dual graph of the intersection, the corners of its pixels, sorted and without repetitions
+ */
+std::vector<std::pair<int, int>> ImageTexture::dualCells(const Intersection &inter){
     std::vector<std::pair<int, int>> inDual;
     for(auto [i,j] : inter.interPixels)
         for(auto [di, dj] : primalToDual)
-            if(insideDual(i + di, j + dj)){
-                inSubgraph[i + di][j + dj] = true;
+            if(insideDual(i + di, j + dj))
                 inDual.emplace_back(i + di, j + dj);
-            }    
     sort(inDual.begin(), inDual.end());
     inDual.resize(unique(inDual.begin(), inDual.end()) - inDual.begin());
     return inDual;
 }
-void ImageTexture::markIntersectionEdgeCostsInDual(int heightOffset, int widthOffset, const png::image<png::rgb_pixel> &inputImg, const std::vector<std::pair<int, int>> &inDual){
+void ImageTexture::markIntersectionEdgeCostsInDual(CutScratch &scratch, const Intersection &inter, int heightOffset, int widthOffset, const png::image<png::rgb_pixel> &inputImg, const std::vector<std::pair<int, int>> &inDual){
+    if(cutCost != CutCost::gradient){
+        markEdgeCosts<CutCost::color>(scratch, inter, heightOffset, widthOffset, inputImg, inDual);
+        return;
+    }
+    prepareEdgeCosts(inputImg);
+    markEdgeCosts<CutCost::gradient>(scratch, inter, heightOffset, widthOffset, inputImg, inDual);
+}
+/**
+ * @brief computes the gradients of the patch read by the gradient cost when they are missing, so the costs of the edges only read
+ * 
+ * The output gradients were computed by blending before the cut, so they don't depend on the pixels in its intersection.
+ * 
+ * Time complexity: linear on the number of pixels of the patch when it has no gradients, O(1) otherwise
+ */
+void ImageTexture::prepareEdgeCosts(const png::image<png::rgb_pixel> &inputImg){
+    if(cutCost != CutCost::gradient)
+        return;
+    M_ASSERT("the output gradients must be computed before the cut", !outputGradientsStale);
+    // blending called without placePatch, or a patch whose exemplar has no gradients yet
+    if(patchGradients == nullptr){
+        ownGradients = GradientPlanes(inputImg);
+        patchGradients = &ownGradients;
+        patchGradientRow = patchGradientCol = 0;
+    }
+}
+/**
+ * @brief marks the costs of the edges of the dual graph of the intersection
+ * 
+ * The edge between the dual vertices (i, j) and its neighbor d crosses the primal pixels A and B, its cost is
+ * calcCost of their old and new colors. The gradient cost divides it by 1 plus the gradients of A and B along the
+ * edge in the output image and in the patch, so the seams go along the edges of the texture. An edge next to a fixed
+ * pixel (see isFixed) costs inftyCost like the edges out of the intersection, so the cut goes around the fixed pixels
+ * and keeps them with the old pixels they touch. The pixels of another intersection are out of this one, even when
+ * they touch it diagonally. A patch of a grayscale library is cut on the 16 bit samples of the pixels (see
+ * outputSample) instead of their colors.
+ * 
+ * @tparam cost cost of the edges, the loop is compiled for each one
+ * 
+ * Time complexity: linear on the number of dual vertices of the intersection
+ */
+template<ImageTexture::CutCost cost>
+void ImageTexture::markEdgeCosts(CutScratch &scratch, const Intersection &inter, int heightOffset, int widthOffset, const png::image<png::rgb_pixel> &inputImg, const std::vector<std::pair<int, int>> &inDual){
+    const bool constrained = holeSet || editSet;
+    // samples of the patch, when it is a window of a grayscale library
+    const uint16_t *samples = nullptr;
+    int sampleWidth = 0;
+    if(patchLibrary != nullptr && patchLibrary->hasSamples() && patchOrigin.exemplar < patchLibrary->size()){
+        sampleWidth = patchLibrary->width(patchOrigin.exemplar);
+        samples = patchLibrary->samples(patchOrigin.exemplar) + (size_t) patchOrigin.row * sampleWidth + patchOrigin.col;
+    }
+    auto patchSample = [&](int i, int j){ return png::gray_pixel_16(samples[(size_t) (i - heightOffset) * sampleWidth + j - widthOffset]); };
     for(auto [i,j] : inDual)
         for(int d = 0; d < (int) directions.size(); d++){
             int nextI = i + directions[d].first;
             int nextJ = j + directions[d].second;
-            if(insideDual(nextI, nextJ) && inSubgraph[nextI][nextJ]){
+            if(insideDual(nextI, nextJ) && scratch.inSubgraph[nextI][nextJ]){
                 int iA = i + dualToPrimal[d].first, jA = j + dualToPrimal[d].second;
                 int iB = i + dualToPrimal[prevDir(d)].first, jB = j + dualToPrimal[prevDir(d)].second;
-                if(insidePrimal(iA, jA) && pixelColorStatus[iA][jA] == PixelStatusEnum::intersection && insidePrimal(iB, jB) && pixelColorStatus[iB][jB] == PixelStatusEnum::intersection)
-                    edgesCosts[i][j][d] = calcCost(outputImg[iA][jA], outputImg[iB][jB], inputImg[iA - heightOffset][jA - widthOffset], inputImg[iB - heightOffset][jB - widthOffset]);
-                else
-                    edgesCosts[i][j][d] = inftyCost;
+                if(inIntersection(iA, jA, inter) && inIntersection(iB, jB, inter)
+                    && !(constrained && (fixedInPatch[iA][jA] || fixedInPatch[iB][jB]))){
+                    if(samples != nullptr)
+                        scratch.edgesCosts[i][j][d] = calcCost(png::gray_pixel_16(outputSample(iA, jA, *patchLibrary)), png::gray_pixel_16(outputSample(iB, jB, *patchLibrary)), patchSample(iA, jA), patchSample(iB, jB));
+                    else
+                        scratch.edgesCosts[i][j][d] = calcCost(outputImg[iA][jA], outputImg[iB][jB], inputImg[iA - heightOffset][jA - widthOffset], inputImg[iB - heightOffset][jB - widthOffset]);
+                    if constexpr(cost == CutCost::gradient){
+                        // A and B are neighbors in a row (k = 0) or in a column (k = 1)
+                        const int k = iA == iB ? 0 : 1;
+                        const int rowA = iA - heightOffset + patchGradientRow, colA = jA - widthOffset + patchGradientCol;
+                        const int rowB = iB - heightOffset + patchGradientRow, colB = jB - widthOffset + patchGradientCol;
+                        const long double gradients = (long double) (*outputGradients)[iA][jA][k] + (*outputGradients)[iB][jB][k]
+                            + patchGradients->at(rowA, colA)[k] + patchGradients->at(rowB, colB)[k];
+                        scratch.edgesCosts[i][j][d] /= 1 + gradients;
+                    }
+                } else
+                    scratch.edgesCosts[i][j][d] = inftyCost;
+            }
+        }
+}
+/**
+ * @brief computes the output gradients of the pixels of the rectangle [firstRow, lastRow) &times; [firstCol, lastCol)
+ * 
+ * The gradient along a direction is the color distance to the next pixel, or to the previous one when the next isn't
+ * colored, and zero when neither is. The rectangle is clipped to the output image.
+ * 
+ * Time complexity: linear on the number of pixels of the rectangle
+ */
+void ImageTexture::updateOutputGradients(int firstRow, int firstCol, int lastRow, int lastCol){
+    firstRow = std::max(0, firstRow);
+    firstCol = std::max(0, firstCol);
+    lastRow = std::min(imgHeight, lastRow);
+    lastCol = std::min(imgWidth, lastCol);
+    auto isColored = [this](int i, int j){ return insidePrimal(i, j) && pixelColorStatus[i][j] == PixelStatusEnum::colored; };
+    for(int i = firstRow; i < lastRow; i++)
+        for(int j = firstCol; j < lastCol; j++){
+            std::array<float, 2> &gradients = (*outputGradients)[i][j];
+            gradients = {0, 0};
+            if(!isColored(i, j))
+                continue;
+            for(int k = 0; k < 2; k++){
+                const int di = k, dj = 1 - k;
+                if(isColored(i + di, j + dj))
+                    gradients[k] = (float) colorDistance(outputImg[i][j], outputImg[i + di][j + dj]);
+                else if(isColored(i - di, j - dj))
+                    gradients[k] = (float) colorDistance(outputImg[i - di][j - dj], outputImg[i][j]);
             }
         }
 }
 
-std::vector<std::pair<int,int>> ImageTexture::findSTPath(const std::vector<std::pair<int,int>> &S, const std::vector<std::pair<int,int>> &T){
+std::vector<std::pair<int,int>> ImageTexture::findSTPath(CutScratch &scratch, const std::vector<std::pair<int,int>> &S, const std::vector<std::pair<int,int>> &T, const std::vector<std::pair<int,int>> &inDual){
     for(auto [h, w] : T){
-        isT[h][w] = true;
-        M_ASSERT("T should be in subgraph", inSubgraph[h][w]);
+        scratch.isT[h][w] = true;
+        M_ASSERT("T should be in subgraph", scratch.inSubgraph[h][w]);
     }
     using qtype = std::tuple<long double, int, int>;
     std::priority_queue<qtype, std::vector<qtype>, std::greater<qtype>> Q;
     for(auto [h, w] : S){
-        M_ASSERT("S should be in subgraph", inSubgraph[h][w]);
-        isS[h][w] = true;
-        parent[h][w] = -2;
-        dist[h][w] = 0;
+        M_ASSERT("S should be in subgraph", scratch.inSubgraph[h][w]);
+        scratch.isS[h][w] = true;
+        scratch.parent[h][w] = -2;
+        scratch.dist[h][w] = 0;
         Q.emplace(0, h, w);
     }
     std::vector<std::pair<int, int>> path;
+    // large graphs are searched on all the cores, with the same minimum cost
+    if(parallelCut(inDual.size())){
+        path = parallelSTPath(scratch, inDual);
+        Q = {};
+    }
     while(!Q.empty()){
         long double pathCost;
         int i, j;
         std::tie(pathCost, i, j) = Q.top();
         Q.pop();
-        assert(i < (int) vis.size());
-        assert(j < (int) vis[i].size());
-        if(vis[i][j])
+        M_ASSERT("the vertex must be inside the dual graph", i < (int) scratch.vis.size());
+        M_ASSERT("the vertex must be inside the dual graph", j < (int) scratch.vis[i].size());
+        if(scratch.vis[i][j])
             continue;
         
-        vis[i][j] = true;
-        if(isT[i][j]){
+        scratch.vis[i][j] = true;
+        if(scratch.isT[i][j]){
             path = {{i,j}};
             break;
         }
         for(int d = 0; d < int(directions.size()); d++){
             int nextI = i + directions[d].first, nextJ = j + directions[d].second;
-            if(insideDual(nextI, nextJ) && inSubgraph[nextI][nextJ] && !vis[nextI][nextJ]){
-                long double curCost = edgesCosts[i][j][d];
-                if(parent[nextI][nextJ] == -1 || pathCost + curCost < dist[nextI][nextJ]){
-                    parent[nextI][nextJ] = revDir(d);
-                    dist[nextI][nextJ] = pathCost + curCost; // avoid overflow
-                    Q.emplace(dist[nextI][nextJ], nextI, nextJ);
+            if(insideDual(nextI, nextJ) && scratch.inSubgraph[nextI][nextJ] && !scratch.vis[nextI][nextJ]){
+                long double curCost = scratch.edgesCosts[i][j][d];
+                if(scratch.parent[nextI][nextJ] == -1 || pathCost + curCost < scratch.dist[nextI][nextJ]){
+                    scratch.parent[nextI][nextJ] = revDir(d);
+                    scratch.dist[nextI][nextJ] = pathCost + curCost; // avoid overflow
+                    Q.emplace(scratch.dist[nextI][nextJ], nextI, nextJ);
                 }
             }
         }
@@ -746,8 +2305,8 @@ std::vector<std::pair<int,int>> ImageTexture::findSTPath(const std::vector<std::
         for(auto [i, j] : S){
             for(int d = 0; d < int(directions.size()); d++){
                 int nextI = i + directions[d].first, nextJ = j + directions[d].second;
-                if(insideDual(nextI, nextJ) && inSubgraph[nextI][nextJ] && !vis[nextI][nextJ] && isT[nextI][nextJ]){
-                    parent[nextI][nextJ] = revDir(d);
+                if(insideDual(nextI, nextJ) && scratch.inSubgraph[nextI][nextJ] && !scratch.vis[nextI][nextJ] && scratch.isT[nextI][nextJ]){
+                    scratch.parent[nextI][nextJ] = revDir(d);
                     path = {{nextI, nextJ}};
                     break;
                 }
@@ -759,33 +2318,219 @@ std::vector<std::pair<int,int>> ImageTexture::findSTPath(const std::vector<std::
     M_ASSERT("path is empty!", !path.empty());
     int curI, curJ;
     std::tie(curI, curJ) = path[0];
-    while(parent[curI][curJ] != -2){
-        int d = parent[curI][curJ];
-        assert(0 <= d && d < int(directions.size()));
+    while(scratch.parent[curI][curJ] != -2){
+        int d = scratch.parent[curI][curJ];
+        M_ASSERT("invalid direction", 0 <= d && d < int(directions.size()));
         std::tie(curI, curJ) = std::make_pair(curI + directions[d].first, curJ + directions[d].second);
         path.emplace_back(curI, curJ);
     }
     for(auto [h, w] : T){
-        isT[h][w] = false;
+        scratch.isT[h][w] = false;
     }
     for(auto [h, w] : S){
-        isS[h][w] = false;
+        scratch.isS[h][w] = false;
+    }
+    return path;
+}
+
+/**
+ * @brief shortest path from the vertices of isS to the closest vertex of isT by a parallel delta-stepping
+ * 
+ * The dual vertices of the intersection are numbered in a flat grid of their bounding box and copied with their edges
+ * to a FlatGraph, so the tasks of the shared pool don't touch the tiled grids. The width of the buckets is the mean
+ * cost of the finite edges. As findSTPath, it marks vis the vertices closer than the target reached and the parents of
+ * the path.
+ * 
+ * Time complexity: linear on the number of dual vertices of the intersection, divided among the cores for the search
+ * 
+ * @param inDual dual vertices of the intersection (inSubgraph)
+ * @return std::vector<std::pair<int,int>> the target reached, empty if there is none
+ */
+std::vector<std::pair<int,int>> ImageTexture::parallelSTPath(CutScratch &scratch, const std::vector<std::pair<int,int>> &inDual){
+    int top = imgHeight, left = imgWidth, bottom = 0, right = 0;
+    for(auto [i, j] : inDual){
+        top = std::min(top, i);
+        left = std::min(left, j);
+        bottom = std::max(bottom, i);
+        right = std::max(right, j);
+    }
+    const int cols = right - left + 1;
+    std::vector<int> index((size_t) (bottom - top + 1) * cols, -1);
+    for(size_t v = 0; v < inDual.size(); v++)
+        index[(size_t) (inDual[v].first - top) * cols + inDual[v].second - left] = (int) v;
+
+    FlatGraph graph;
+    graph.next.resize(inDual.size());
+    graph.cost.resize(inDual.size());
+    std::vector<int> sources, targets;
+    long double finiteCost = 0;
+    size_t finiteEdges = 0;
+    for(size_t v = 0; v < inDual.size(); v++){
+        auto [i, j] = inDual[v];
+        if(scratch.isS[i][j])
+            sources.push_back((int) v);
+        if(scratch.isT[i][j])
+            targets.push_back((int) v);
+        const std::array<long double, 4> &costs = scratch.edgesCosts[i][j];
+        for(int d = 0; d < (int) directions.size(); d++){
+            const int nextI = i + directions[d].first, nextJ = j + directions[d].second;
+            const bool inside = top <= nextI && nextI <= bottom && left <= nextJ && nextJ <= right;
+            graph.next[v][d] = inside ? index[(size_t) (nextI - top) * cols + nextJ - left] : -1;
+            graph.cost[v][d] = costs[d];
+            if(graph.next[v][d] >= 0 && costs[d] < inftyCost){
+                finiteCost += costs[d];
+                finiteEdges++;
+            }
+        }
+    }
+    const long double delta = finiteEdges > 0 && finiteCost > 0 ? finiteCost / finiteEdges : 1;
+    const ShortestPaths paths = deltaStepping(graph, sources, targets, delta, ThreadPool::shared());
+
+    // the closest target, the first in the order of the priority queue of Dijkstra among the closest
+    int reached = -1;
+    for(int t : targets)
+        if(paths.dist[t] < std::numeric_limits<long double>::infinity() && (reached < 0 || std::tie(paths.dist[t], inDual[t]) < std::tie(paths.dist[reached], inDual[reached])))
+            reached = t;
+    if(reached < 0)
+        return {};
+    for(size_t v = 0; v < inDual.size(); v++)
+        if(paths.dist[v] < paths.dist[reached])
+            scratch.vis[inDual[v].first][inDual[v].second] = true;
+    scratch.vis[inDual[reached].first][inDual[reached].second] = true;
+    for(int v = reached; paths.parent[v] >= 0; v = paths.parent[v]){
+        auto [i, j] = inDual[v];
+        auto [parentI, parentJ] = inDual[paths.parent[v]];
+        for(int d = 0; d < (int) directions.size(); d++)
+            if(i + directions[d].first == parentI && j + directions[d].second == parentJ)
+                scratch.parent[i][j] = d;
+    }
+    return {inDual[reached]};
+}
+bool ImageTexture::parallelCut(size_t vertices) const{
+    return vertices >= parallelCutVertices && ThreadPool::shared().size() > 1;
+}
+/**
+ * @brief minimum S-T path by a bidirectional Dijkstra, with the format of findSTPath
+ * 
+ * One search goes from S with dist, vis and parent and the other from T with the backward variables, on the reversed
+ * edges. The side with the closest vertex in its queue is expanded, and each edge between both searches is a candidate
+ * path. It stops once the sum of the closest vertices of both queues reaches the best candidate, so it expands about
+ * the vertices closer to S or to T than half the cut, not all the vertices closer to S than the cut. The cost is the
+ * minimum, as with findSTPath (another path of that cost may be chosen). The backward variables are unmarked by the
+ * caller with vis and parent.
+ * 
+ * Time complexity: O(V log V), V is the number of dual vertices expanded
+ * 
+ * @param S start of the path
+ * @param T end of the path
+ * @return std::vector<std::pair<int,int>> the path from T to S, the parents of its vertices point to S
+ */
+std::vector<std::pair<int,int>> ImageTexture::findSTPathBidirectional(CutScratch &scratch, std::pair<int,int> S, std::pair<int,int> T){
+    M_ASSERT("S should be in subgraph", scratch.inSubgraph[S.first][S.second]);
+    M_ASSERT("T should be in subgraph", scratch.inSubgraph[T.first][T.second]);
+    using qtype = std::tuple<long double, int, int>;
+    std::array<std::priority_queue<qtype, std::vector<qtype>, std::greater<qtype>>, 2> Q;
+    scratch.parent[S.first][S.second] = -2;
+    scratch.dist[S.first][S.second] = 0;
+    Q[0].emplace(0, S.first, S.second);
+    scratch.parentBackward[T.first][T.second] = -2;
+    scratch.distBackward[T.first][T.second] = 0;
+    Q[1].emplace(0, T.first, T.second);
+
+    // the best path found goes through the edge from meet (reached from S) in the direction meetDir (to a vertex reached from T)
+    long double best = std::numeric_limits<long double>::infinity();
+    std::pair<int, int> meet = {-1, -1};
+    int meetDir = -1;
+    while(!Q[0].empty() && !Q[1].empty()){
+        if(std::get<0>(Q[0].top()) + std::get<0>(Q[1].top()) >= best)
+            break;
+        const int side = std::get<0>(Q[0].top()) <= std::get<0>(Q[1].top()) ? 0 : 1;
+        auto [pathCost, i, j] = Q[side].top();
+        Q[side].pop();
+        TiledGrid<bool> &visited = side == 0 ? scratch.vis : scratch.visBackward;
+        if(visited[i][j])
+            continue;
+        visited[i][j] = true;
+        TiledGrid<long double> &sideDist = side == 0 ? scratch.dist : scratch.distBackward;
+        TiledGrid<int> &sideParent = side == 0 ? scratch.parent : scratch.parentBackward;
+        for(int d = 0; d < int(directions.size()); d++){
+            int nextI = i + directions[d].first, nextJ = j + directions[d].second;
+            if(!insideDual(nextI, nextJ) || !scratch.inSubgraph[nextI][nextJ])
+                continue;
+            // the search from T follows the edges from the next vertex to this one
+            const long double curCost = side == 0 ? scratch.edgesCosts[i][j][d] : scratch.edgesCosts[nextI][nextJ][revDir(d)];
+            if(!visited[nextI][nextJ] && (sideParent[nextI][nextJ] == -1 || pathCost + curCost < sideDist[nextI][nextJ])){
+                sideParent[nextI][nextJ] = revDir(d);
+                sideDist[nextI][nextJ] = pathCost + curCost;
+                Q[side].emplace(sideDist[nextI][nextJ], nextI, nextJ);
+            }
+            TiledGrid<int> &otherParent = side == 0 ? scratch.parentBackward : scratch.parent;
+            if(otherParent[nextI][nextJ] != -1){
+                const long double candidate = pathCost + curCost + (side == 0 ? scratch.distBackward : scratch.dist)[nextI][nextJ];
+                if(candidate < best){
+                    best = candidate;
+                    meet = side == 0 ? std::make_pair(i, j) : std::make_pair(nextI, nextJ);
+                    meetDir = side == 0 ? d : revDir(d);
+                }
+            }
+        }
+    }
+    if(meetDir < 0)
+        return {};
+
+    // the path from S to the meeting edge and from it to T, joined at their last common vertex when they cross
+    std::vector<std::pair<int, int>> toS = {meet};
+    while(scratch.parent[toS.back().first][toS.back().second] != -2){
+        auto [i, j] = toS.back();
+        toS.emplace_back(i + directions[scratch.parent[i][j]].first, j + directions[scratch.parent[i][j]].second);
+    }
+    std::vector<std::pair<int, int>> toT = {{meet.first + directions[meetDir].first, meet.second + directions[meetDir].second}};
+    while(scratch.parentBackward[toT.back().first][toT.back().second] != -2){
+        auto [i, j] = toT.back();
+        toT.emplace_back(i + directions[scratch.parentBackward[i][j]].first, j + directions[scratch.parentBackward[i][j]].second);
+    }
+    std::sort(toS.begin(), toS.end());
+    size_t first = 0;
+    for(size_t k = 0; k < toT.size(); k++)
+        if(std::binary_search(toS.begin(), toS.end(), toT[k]))
+            first = k + 1;
+    if(first == 0)
+        scratch.parent[toT[0].first][toT[0].second] = revDir(meetDir);
+    for(size_t k = std::max<size_t>(first, 1); k < toT.size(); k++){
+        auto [i, j] = toT[k - 1];
+        scratch.parent[toT[k].first][toT[k].second] = revDir(scratch.parentBackward[i][j]);
+    }
+    scratch.vis[T.first][T.second] = true;
+
+    std::vector<std::pair<int, int>> path = {T};
+    while(scratch.parent[path.back().first][path.back().second] != -2){
+        auto [i, j] = path.back();
+        int d = scratch.parent[i][j];
+        M_ASSERT("invalid direction", 0 <= d && d < int(directions.size()));
+        path.emplace_back(i + directions[d].first, j + directions[d].second);
     }
     return path;
 }
 
-void ImageTexture::markLeftOfMinCut(const std::vector<std::pair<int, int>> &cut){
+/**
+ * @brief marks the pixels of the intersection on the left of the cut as colored
+ * 
+ * A BFS from the pixel on the left of each edge of the cut, through the edges of the intersection that aren't on the
+ * cut. The seeds and the BFS only take the pixels of inter (see intersectionOf): an edge of the cut may touch a pixel
+ * of another intersection that touches this one diagonally, which belongs to its own cut (and to another task).
+ */
+void ImageTexture::markLeftOfMinCut(CutScratch &scratch, const Intersection &inter, const std::vector<std::pair<int, int>> &cut){
     for(auto [i, j] : cut){
-        int d = parent[i][j];
+        int d = scratch.parent[i][j];
         if(d < 0)
             break;
-        assert(0 <= d && d < int(directions.size()));
+        M_ASSERT("invalid direction", 0 <= d && d < int(directions.size()));
         auto [curI, curJ] = std::make_pair(i + directions[d].first, j + directions[d].second);
         d = revDir(d);
         int firstI, firstJ;
         std::tie(firstI, firstJ) = std::make_pair(curI + dualToPrimal[d].first, curJ + dualToPrimal[d].second);
         //BFS Marking left
-        if(insidePrimal(firstI, firstJ) && pixelColorStatus[firstI][firstJ] == PixelStatusEnum::intersection){
+        if(inIntersection(firstI, firstJ, inter)){
             std::vector<std::pair<int, int>> q = {{firstI, firstJ}};
             pixelColorStatus[firstI][firstJ] = PixelStatusEnum::colored;
             for(int front = 0; front < int(q.size()); front++){
@@ -793,12 +2538,12 @@ void ImageTexture::markLeftOfMinCut(const std::vector<std::pair<int, int>> &cut)
                 for(int dir = 0; dir < (int) directions.size(); dir++){
                     int nxtI = fI + directions[dir].first;
                     int nxtJ = fJ + directions[dir].second;
-                    if(!insidePrimal(nxtI, nxtJ) || pixelColorStatus[nxtI][nxtJ] != PixelStatusEnum::intersection)
+                    if(!inIntersection(nxtI, nxtJ, inter))
                         continue;
                     int dualI = fI + primalToDual[dir].first;
                     int dualJ = fJ + primalToDual[dir].second;
-                    assert(insideDual(dualI, dualJ));
-                    if(validEdge[dualI][dualJ][prevDir(dir)]){
+                    M_ASSERT("the vertex must be inside the dual graph", insideDual(dualI, dualJ));
+                    if(scratch.validEdge[dualI][dualJ][prevDir(dir)]){
                         pixelColorStatus[nxtI][nxtJ] = PixelStatusEnum::colored;
                         q.emplace_back(nxtI, nxtJ);
                     }
@@ -952,6 +2697,7 @@ std::vector<std::pair<int, int>> ImageTexture::findSCase2(int heightOffset, int
 }
 
 std::pair<long double, std::vector<std::array<int,3>>> ImageTexture::findMinFCycle(const std::pair<int,int> &F, int visited){
+    CutScratch &scratch = *cutScratch[0];
     std::array<int, 3> S = {0, F.first, F.second};
     std::array<int, 3> T = {1, F.first, F.second};
     using qtype = std::tuple<long double, int, int, int>;
@@ -966,8 +2712,8 @@ std::pair<long double, std::vector<std::array<int,3>>> ImageTexture::findMinFCyc
         std::tie(pathCost, g, i, j) = Q.top();
         Q.pop();
         
-        assert(i < (int) visCase2[0].size());
-        assert(j < (int) visCase2[0][i].size());
+        M_ASSERT("the vertex must be inside the dual graph", i < (int) visCase2[0].size());
+        M_ASSERT("the vertex must be inside the dual graph", j < (int) visCase2[0][i].size());
         if(visCase2[g][i][j] == visited)
             continue;
         
@@ -981,8 +2727,8 @@ std::pair<long double, std::vector<std::array<int,3>>> ImageTexture::findMinFCyc
             int nextG = edgeTo[g][i][j][d];
             if(nextG == 2)
                 continue;
-            if(insideDual(nextI, nextJ) && inSubgraph[nextI][nextJ] && visCase2[nextG][nextI][nextJ] != visited){
-                long double curCost = edgesCosts[i][j][d];
+            if(insideDual(nextI, nextJ) && scratch.inSubgraph[nextI][nextJ] && visCase2[nextG][nextI][nextJ] != visited){
+                long double curCost = scratch.edgesCosts[i][j][d];
                 if(seenCase2[nextG][nextI][nextJ] != visited || pathCost + curCost < distCase2[nextG][nextI][nextJ]){
                     seenCase2[nextG][nextI][nextJ] = visited;
                     parentCase2[nextG][nextI][nextJ] = revDir(d)*10+g;
@@ -1009,8 +2755,8 @@ std::pair<long double, std::vector<std::array<int,3>>> ImageTexture::findMinFCyc
 
 
 std::pair<long double, std::vector<std::array<int,3>>> ImageTexture::minCutCycle(int left, int right, const std::vector<std::pair<int, int>> &stPath, int &visited){
+    CutScratch &scratch = *cutScratch[0];
     visited++;
-    static std::vector<std::vector<int>> inCutCycle(imgHeight + 1, std::vector<int>(imgWidth + 1));
     
     int f_mid = (left + right) / 2;
     
@@ -1029,10 +2775,10 @@ std::pair<long double, std::vector<std::array<int,3>>> ImageTexture::minCutCycle
         std::vector<std::array<int, 5>> oldEdgeValues;
         for(int i =0; i < int(curCutCycle.second.size()) - 1; i++){
             auto [g, x, y] = curCutCycle.second[i];
-            assert(parentsOfCutCycle[i] >= 0);
+            M_ASSERT("every vertex of the cut cycle must have a parent", parentsOfCutCycle[i] >= 0);
             int d = nextDir(parentsOfCutCycle[i]);
             int nextX = x + directions[d].first, nextY = y + directions[d].second;
-            if(insideDual(nextX, nextY) && inSubgraph[nextX][nextY] && 
+            if(insideDual(nextX, nextY) && scratch.inSubgraph[nextX][nextY] && 
               (inStPath[nextX][nextY] == -1 || inStPath[nextX][nextY] >= f_mid)){
                 if(inCutCycle[nextX][nextY])
                         continue;
@@ -1043,7 +2789,7 @@ std::pair<long double, std::vector<std::array<int,3>>> ImageTexture::minCutCycle
             }
             d = nextDir(d);
             nextX = x + directions[d].first, nextY = y + directions[d].second;
-            if(insideDual(nextX, nextY) && inSubgraph[nextX][nextY] && 
+            if(insideDual(nextX, nextY) && scratch.inSubgraph[nextX][nextY] && 
               (inStPath[nextX][nextY] == -1 || inStPath[nextX][nextY] >= f_mid)){
                 if(inCutCycle[nextX][nextY])
                         continue;
@@ -1065,10 +2811,10 @@ std::pair<long double, std::vector<std::array<int,3>>> ImageTexture::minCutCycle
         std::vector<std::array<int, 5>> oldEdgeValues;
         for(int i =0; i < int(curCutCycle.second.size()) - 1; i++){
             auto [g, x, y] = curCutCycle.second[i];
-            assert(parentsOfCutCycle[i] >= 0);
+            M_ASSERT("every vertex of the cut cycle must have a parent", parentsOfCutCycle[i] >= 0);
             int d = prevDir(parentsOfCutCycle[i]);
             int nextX = x + directions[d].first, nextY = y + directions[d].second;
-            if(insideDual(nextX, nextY) && inSubgraph[nextX][nextY] && 
+            if(insideDual(nextX, nextY) && scratch.inSubgraph[nextX][nextY] && 
               (inStPath[nextX][nextY] == -1 || inStPath[nextX][nextY] <= f_mid)){
                 if(inCutCycle[nextX][nextY])
                         continue;
@@ -1079,7 +2825,7 @@ std::pair<long double, std::vector<std::array<int,3>>> ImageTexture::minCutCycle
             }
             d = prevDir(d);
             nextX = x + directions[d].first, nextY = y + directions[d].second;
-            if(insideDual(nextX, nextY) && inSubgraph[nextX][nextY] && 
+            if(insideDual(nextX, nextY) && scratch.inSubgraph[nextX][nextY] && 
               (inStPath[nextX][nextY] == -1 || inStPath[nextX][nextY] <= f_mid)){
                 if(inCutCycle[nextX][nextY])
                         continue;
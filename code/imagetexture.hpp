@@ -10,11 +10,22 @@
  */
 #pragma once
 #include <png++/png.hpp>
+#include "previewstream.hpp"
+#include "tiledgrid.hpp"
+#include "pngstream.hpp"
+#include "imagecodec.hpp"
+#include "checkpoint.hpp"
+#include "exemplarlibrary.hpp"
+#include "sourcemap.hpp"
+#include "materialset.hpp"
+#include "pixeltraits.hpp"
+#include "gradientplanes.hpp"
 #include <algorithm>
 #include <math.h>
 #include <utility>
 #include <array>
 #include <queue>
+#include <deque>
 #include <tuple>
 #include <map>
 #include <random>
@@ -24,6 +35,14 @@
 #include <cstdlib> // just for debug
 #include <iomanip> // just for debug
 #include <string>
+#include <cstdint>
+#include <memory>
+#include <sstream>
+#include <functional>
+#include <atomic>
+
+/// assert with a message shown by the failed expression
+#define M_ASSERT(msg, expr) assert(( (void)(msg), (expr) ))
 
 /**
  * @brief 
@@ -32,6 +51,52 @@
  
 class ImageTexture{
 public:
+    /// Enum of the reasons why a patch fitting with limits stopped
+    enum StopReason{
+        iterationLimit, /// maxIterations iterations were done
+        deadline, /// another iteration would exceed the time budget
+        seamEnergyReached, /// the output image is covered and its seam energy reached the target
+        converged, /// the last convergenceWindow iterations stopped reducing the seam energy or changing pixels
+        cancelled /// the cancel flag was set
+    };
+
+    /// Enum of the costs of the edges of the cuts
+    enum CutCost{
+        color, /// color distance of the pixels across the edge, in the old and in the new patch
+        gradient /// the color cost divided by the gradients along the edge of both pixels in both patches, seams prefer edges
+    };
+
+    /**
+     * @brief State of the synthesis reported by the patch fitting with limits
+     */
+    struct Progress{
+        uint64_t iterations = 0; /// iterations done by this patch fitting
+        double coverage = 0; /// percentage of the pixels of the output image that are colored
+        uint64_t case2Count = 0; /// blendings whose new patch had no uncolored pixel on its border (case 2) since the texture was created
+        long double seamEnergy = 0; /// sum of the costs of the seams between pixels copied from different patches
+        long double lastCutCost = 0; /// sum of the costs of the seams created by the cut of the last iteration
+        uint64_t lastChangedPixels = 0; /// pixels that got the color of the patch of the last iteration
+        double elapsedSeconds = 0; /// wall clock time since the patch fitting started
+        StopReason stopReason = StopReason::iterationLimit; /// why the patch fitting stopped, only meaningful in its result
+    };
+
+    /**
+     * @brief Limits of the patch fitting, it stops at the first limit reached
+     * 
+     * With no limit and no cancel flag the patch fitting never stops
+     */
+    struct FittingLimits{
+        int maxIterations = -1; /// maximum number of iterations (negative for no limit)
+        std::chrono::nanoseconds timeBudget = std::chrono::nanoseconds::zero(); /// wall clock budget (zero for no limit), an iteration isn't started if an iteration of mean duration would exceed it
+        long double targetSeamEnergy = -1; /// stops once the output image is covered and its seam energy is at most this (negative for no target)
+        std::function<void(const Progress &)> progress; /// called after every progressEvery iterations (may be empty)
+        int progressEvery = 1; /// number of iterations between calls of progress
+        const std::atomic<bool> *cancel = nullptr; /// when set to true the patch fitting stops at the next phase of the iteration (null for no cancellation)
+        int convergenceWindow = 0; /// number of iterations of the sliding window of the convergence test (zero disables it), a few hundred works for the input images
+        double convergenceTolerance = 0.001; /// converged when, over the window, the seam energy decreased less than this fraction
+        double changedPixelsTolerance = 0.01; /// or when the pixels changed over the window are less than this fraction of the output image
+    };
+
     /**
      * @brief Construct a new Image Texture object
      * 
@@ -42,14 +107,27 @@ public:
     ImageTexture(const png::image<png::rgb_pixel> & _img);
 
     /**
-     * @brief Construct a new Image Texture object
+     * @brief Construct a new Image Texture object from an image file
      * 
      * Time Complexity: O(width &times; height)
      * 
+     * @param file_name file name of the image where the texture will be constructed, the codec is chosen by its extension (png, ppm, qoi or raw)
+     */
+    explicit ImageTexture(const std::string &file_name);
+
+    /**
+     * @brief Construct a new Image Texture object
+     * 
+     * The output image and the pixels status are stored in tiles of a memory mapping, when backing_file
+     * is given the mapping is backed by files, so the texture can be larger than the RAM
+     * 
+     * Time Complexity: O(width &times; height / tileSide<sup>2</sup>)
+     * 
      * @param width width of the texture that will be conctructed (in pixels)
      * @param height height of the texture that will be conctructed (in pixels)
+     * @param backing_file file name of the file that backs the output image, the pixels status uses backing_file + ".status" (empty for memory only)
      */
-    ImageTexture(int width, int height);
+    ImageTexture(int width, int height, const std::string &backing_file = "");
 
     /**
      * @brief An iteration of patch fitting
@@ -65,10 +143,36 @@ public:
      * 
      * Time Complexity: O(width &times; height &times; log<sup>2</sup>(width &times; height ))
      * 
-     * @param file_name file name of the png image from which the patch will be copied
+     * @param file_name file name of the image (png, ppm, qoi or raw) from which the patch will be copied
      */
     void patchFittingIteration(const std::string &file_name);
 
+    /**
+     * @brief An iteration of patch fitting that chooses the patch from a library of exemplars
+     * 
+     * Random positions are drawn, the exemplars of the library taking turns, and the one whose overlap with the colored pixels has the lowest
+     * mean squared difference, normalized by the variance of its exemplar, is placed. Positions with no overlap
+     * are only chosen when no position overlaps. The candidates are evaluated in parallel on the shared thread pool.
+     * 
+     * Time Complexity: O(candidates &times; pixels of an exemplar / threads + width &times; height &times; log<sup>2</sup>(width &times; height ))
+     * 
+     * @param library exemplars from which the patch will be copied
+     * @param candidates number of positions evaluated, shared by the exemplars of the library
+     */
+    void patchFittingIteration(const ExemplarLibrary &library, int candidates = 16);
+
+    /**
+     * @brief An iteration of patch fitting that copies every layer of a material
+     * 
+     * The matching and the cut are computed on the guide of the material, then each layer is copied to its own
+     * output layer with the same pixels of the patch (see renderLayer).
+     * 
+     * Time Complexity: O(width &times; height &times; (log<sup>2</sup>(width &times; height ) + material.size()))
+     * 
+     * @param material layers from which the patch will be copied
+     */
+    void patchFittingIteration(const MaterialSet &material);
+
     /**
      * @brief Runs 'CntIterations' iterations of the patch fitting
      * 
@@ -84,11 +188,121 @@ public:
      * 
      * Time Complexity: O(CntIterations &times; (width &times; height &times; log<sup>2</sup>(width &times; height )))
      * 
-     * @param file_name file name of the png image from which the patch will be copied
+     * @param file_name file name of the image (png, ppm, qoi or raw) from which the patch will be copied
      * @param CntIterations number of iterations
      */
     void patchFitting(const std::string &file_name, int CntIterations = 10000);
 
+    /**
+     * @brief Runs iterations of the patch fitting until a limit is reached
+     * 
+     * Cancellation is checked before the matching and before the blending of each iteration, an iteration
+     * is either fully done or not started, so the output image is always the result of the iterations done
+     * 
+     * Time Complexity: O(iterations &times; (width &times; height &times; log<sup>2</sup>(width &times; height )))
+     * 
+     * @param inputImg png::image object from which the patch will be copied
+     * @param limits limits of the patch fitting, progress callback and cancel flag
+     * @return Progress state of the synthesis when it stopped and the reason why it stopped
+     */
+    Progress patchFitting(const png::image<png::rgb_pixel> &inputImg, const FittingLimits &limits);
+
+    /**
+     * @brief Runs iterations of the patch fitting until a limit is reached, the iterations cycle through the input images
+     * 
+     * Time Complexity: O(iterations &times; (width &times; height &times; log<sup>2</sup>(width &times; height )))
+     * 
+     * @param inputImgs png::image objects from which the patches will be copied, the iteration i uses inputImgs[i % inputImgs.size()]
+     * @param limits limits of the patch fitting, progress callback and cancel flag
+     * @return Progress state of the synthesis when it stopped and the reason why it stopped
+     */
+    Progress patchFitting(const std::vector<const png::image<png::rgb_pixel> *> &inputImgs, const FittingLimits &limits);
+
+    /**
+     * @brief Runs iterations of the patch fitting until a limit is reached
+     * 
+     * Time Complexity: O(iterations &times; (width &times; height &times; log<sup>2</sup>(width &times; height )))
+     * 
+     * @param file_name file name of the image (png, ppm, qoi or raw) from which the patch will be copied
+     * @param limits limits of the patch fitting, progress callback and cancel flag
+     * @return Progress state of the synthesis when it stopped and the reason why it stopped (no iteration if the file is invalid)
+     */
+    Progress patchFitting(const std::string &file_name, const FittingLimits &limits);
+
+    /**
+     * @brief Runs iterations of the patch fitting until a limit is reached, each iteration chooses its patch from the library
+     * 
+     * Time Complexity: O(iterations &times; (candidates &times; pixels of an exemplar / threads + width &times; height &times; log<sup>2</sup>(width &times; height )))
+     * 
+     * @param library exemplars from which the patches will be copied
+     * @param limits limits of the patch fitting, progress callback and cancel flag
+     * @param candidates number of positions evaluated in each iteration, shared by the exemplars of the library
+     * @return Progress state of the synthesis when it stopped and the reason why it stopped
+     */
+    Progress patchFitting(const ExemplarLibrary &library, const FittingLimits &limits, int candidates = 16);
+
+    /**
+     * @brief Runs iterations of the patch fitting until a limit is reached, each patch copies every layer of the material
+     * 
+     * The patches are matched and cut on the guide of the material, which is what the output image gets, and copied with
+     * the same mask to an output layer per layer of the material. The output layers are created by the first patch of
+     * a material, all the patches of the texture should come from materials with the same number of layers.
+     * 
+     * Time Complexity: O(iterations &times; (width &times; height &times; (log<sup>2</sup>(width &times; height ) + material.size())))
+     * 
+     * @param material layers from which the patches will be copied
+     * @param limits limits of the patch fitting, progress callback and cancel flag
+     * @return Progress state of the synthesis when it stopped and the reason why it stopped
+     */
+    Progress patchFitting(const MaterialSet &material, const FittingLimits &limits);
+
+    /**
+     * @brief Constructs the texture coarse to fine, on a pyramid of the output image and of the exemplars
+     * 
+     * The coarsest level is synthesized with the patch fitting on the library, within the limits, on the exemplars and
+     * the output image downsampled by 2<sup>levels - 1</sup>, and then placed until it is covered. Each finer level starts
+     * from the coarser one with the exemplar pixel copied to each pixel upsampled, so its pixels come from the finer exemplars
+     * with the same seams, and its seams are refined by local cuts: small patches of the exemplar of a pixel on a
+     * costly seam, aligned with that pixel, are blended over the seam. The previous content of the texture is replaced.
+     * 
+     * Time Complexity: O(iterations &times; (candidates &times; pixels of an exemplar / 4<sup>levels - 1</sup>) + refineIterations &times; refinePatchSize<sup>2</sup> &times; log<sup>2</sup>(refinePatchSize) + width &times; height)
+     * 
+     * @param library exemplars from which the patches will be copied
+     * @param limits limits of the patch fitting of the coarsest level, progress callback and cancel flag
+     * @param levels number of levels of the pyramid, 3 synthesizes at 1/4, 1/2 and the full size
+     * @param candidates number of positions evaluated in each iteration of the coarsest level, shared by the exemplars of the library
+     * @param refineIterations number of local cuts of each finer level (negative for one per refinePatchSize<sup>2</sup> pixels of the level)
+     * @param refinePatchSize side of the patches of the local cuts
+     * @return Progress state of the synthesis when it stopped (iterations of all the levels) and the reason why the coarsest level stopped
+     */
+    Progress patchFittingPyramid(const ExemplarLibrary &library, const FittingLimits &limits, int levels = 3, int candidates = 16, int refineIterations = -1, int refinePatchSize = 32);
+
+    /**
+     * @brief Constructs the texture placing the patches in scanline order and renders it while it is constructed
+     * 
+     * The patches are placed in bands from top to bottom. When a band is finished no later patch can reach
+     * the rows above the next band, so these rows are written to the png file and their tiles are released.
+     * The memory used is O(width &times; height of the input image), independent of the height of the texture.
+     * 
+     * Time Complexity: O(number of patches &times; (width &times; height &times; log<sup>2</sup>(width &times; height )))
+     * 
+     * @param inputImg png::image object from which the patches will be copied, throws std::runtime_error if it is smaller than 2 &times; 2
+     * @param file_name file name of the png image on which the texture will be rendered
+     * @param overlap number of rows and columns shared by neighbor patches
+     */
+    void patchFittingScanline(const png::image<png::rgb_pixel> &inputImg, const std::string &file_name, int overlap = 32);
+
+    /**
+     * @brief Constructs the texture placing the patches in scanline order and renders it while it is constructed
+     * 
+     * Time Complexity: O(number of patches &times; (width &times; height &times; log<sup>2</sup>(width &times; height )))
+     * 
+     * @param input_file_name file name of the image (png, ppm, qoi or raw) from which the patches will be copied
+     * @param file_name file name of the png image on which the texture will be rendered
+     * @param overlap number of rows and columns shared by neighbor patches
+     */
+    void patchFittingScanline(const std::string &input_file_name, const std::string &file_name, int overlap = 32);
+
     /**
      * @brief Chooses the format of the new patch from the inputImg at this position
      * 
@@ -107,27 +321,386 @@ public:
      * 
      * @param heightOffset height offset of thhe position
      * @param widthOffset width offset of thhe position
-     * @param file_name file name of the png image from which the patch will be copied
+     * @param file_name file name of the image (png, ppm, qoi or raw) from which the patch will be copied
      */
     void blending(int heightOffset, int widthOffset, const std::string &file_name);
     
+    /**
+     * @brief Makes the texture tileable, so copies of it side by side have no seams across its borders
+     * 
+     * The output is a torus: the texture is shifted by half its size with its pixels wrapping around, so its new borders,
+     * which were its middle, continue across the wrap, and its old borders meet on a cross in the middle. Patches of the
+     * library are then blended along the cross, one pixel inside the borders so the wrap is kept. Each patch is the best
+     * of random windows of the exemplars over its pixels, the pixels on both sides of the cross inside it are uncolored
+     * first, so the patch replaces them and its cuts put new seams on both sides. The ends of each line of the cross, in
+     * the border rows or columns, are cut by one more patch with the texture rolled again so they meet in the middle of
+     * the line. The planar cuts are kept, a wrapping dual graph wouldn't be planar. The layers of a material and the guide
+     * are shifted with the texture.
+     * 
+     * Time Complexity: O(width &times; height + (width + height) / patchSize &times; (candidates &times; patchSize<sup>2</sup> + patchSize<sup>2</sup> &times; log<sup>2</sup>(patchSize)))
+     * 
+     * @param library exemplars of the patches, the library of the synthesis if the texture was synthesized from one
+     * @param candidates number of random windows evaluated for each patch
+     * @param patchSize side of the patches, at most the size of the texture minus 2
+     * @return int number of patches blended along the cross
+     */
+    int makeTileable(const ExemplarLibrary &library, int candidates = 16, int patchSize = 32);
+
+    /**
+     * @brief Makes the texture tileable with patches of an image (see makeTileable with a library)
+     * 
+     * @param inputImg png::image object from which the patches will be copied
+     * @param candidates number of random windows evaluated for each patch
+     * @param patchSize side of the patches, at most the size of the texture minus 2
+     * @return int number of patches blended along the cross
+     */
+    int makeTileable(const png::image<png::rgb_pixel> &inputImg, int candidates = 16, int patchSize = 32);
+
+    /**
+     * @brief Starts the texture from an image with a hole to be filled
+     * 
+     * The pixels out of the mask are copied, marked colored and fixed: no patch changes them, the cuts of the patches
+     * over them only choose the seams of the hole. The pixels of the mask are not colored. The mask tiles are only
+     * allocated around the hole, so fillHole works in its bounding box and the cost of filling a small hole in a large
+     * photo is proportional to the hole. The previous pixels, seams and sources are replaced, the known pixels have no
+     * source.
+     * 
+     * Time Complexity: O(width &times; height)
+     * 
+     * @param img image with the size of the texture, its pixels of the hole are ignored
+     * @param mask image with the size of the texture, the pixels with red above 127 are the hole
+     * @return uint64_t number of pixels of the hole
+     */
+    uint64_t setHole(const png::image<png::rgb_pixel> &img, const png::image<png::rgb_pixel> &mask);
+
+    /**
+     * @brief Fills the hole given to setHole with patches of a library
+     * 
+     * Like patchFitting, but every drawn position overlaps the bounding box of the hole, so the candidates that
+     * cover its pixels win the matching and the known pixels around the hole guide the choice. The limits work as in
+     * patchFitting, the changed pixels of the convergence test are relative to the bounding box of the hole.
+     * 
+     * Time Complexity: each iteration is like one of patchFitting, the scratch grids are only touched around the hole
+     * 
+     * @param library exemplars from which the patches will be copied
+     * @param limits limits of the synthesis
+     * @param candidates number of positions drawn, shared by the exemplars of the library
+     * @return Progress state of the synthesis when it stopped and the reason why it stopped
+     */
+    Progress fillHole(const ExemplarLibrary &library, const FittingLimits &limits, int candidates = 16);
+
+    /**
+     * @brief Fills the hole given to setHole with random patches of an image (see fillHole with a library)
+     * 
+     * @param inputImg png::image object from which the patches will be copied
+     * @param limits limits of the synthesis
+     * @return Progress state of the synthesis when it stopped and the reason why it stopped
+     */
+    Progress fillHole(const png::image<png::rgb_pixel> &inputImg, const FittingLimits &limits);
+
+    /**
+     * @brief Forgets the hole, every pixel can be changed by the next patches
+     * 
+     * Time Complexity: O(width &times; height / tileSide<sup>2</sup>)
+     */
+    void clearHole();
+
+    /// true while a hole given to setHole is kept fixed around
+    bool hasHole() const { return holeSet; }
+
+    /**
+     * @brief Synthesizes a rectangle of the texture again, keeping the rest of it
+     * 
+     * The pixels of the rectangle are not colored again and their seams are removed, then patches of the library are
+     * placed over it reusing the output image, the pixels status and the seams of the texture: every drawn position
+     * overlaps the rectangle and only the pixels up to margin pixels around it can be changed by the cuts, the
+     * others are fixed. Only the part of each patch inside that expanded rectangle is matched and cut, and the patches
+     * are placed past the iterations until the rectangle is covered. The scratch grids are only touched around the
+     * rectangle, so a local fix costs a few patches, not a run of the whole texture.
+     * 
+     * Time Complexity: O(rectangle area) plus the iterations, each like one of patchFitting
+     * 
+     * @param library exemplars from which the patches will be copied
+     * @param top first row of the rectangle
+     * @param left first column of the rectangle
+     * @param bottom row after the last row of the rectangle
+     * @param right column after the last column of the rectangle
+     * @param count number of patches placed over the rectangle (more if it isn't covered after them)
+     * @param candidates number of positions drawn, shared by the exemplars of the library
+     * @param margin pixels around the rectangle that the cuts can change
+     * @return Progress state of the texture after the patches, with the number of patches placed
+     */
+    Progress resynthesize(const ExemplarLibrary &library, int top, int left, int bottom, int right, int count, int candidates = 16, int margin = 16);
+
+    /**
+     * @brief Synthesizes a rectangle of the texture again with random patches of an image (see resynthesize with a library)
+     * 
+     * @param inputImg png::image object from which the patches will be copied
+     * @param top first row of the rectangle
+     * @param left first column of the rectangle
+     * @param bottom row after the last row of the rectangle
+     * @param right column after the last column of the rectangle
+     * @param count number of patches placed over the rectangle (more if it isn't covered after them)
+     * @param margin pixels around the rectangle that the cuts can change
+     * @return Progress state of the texture after the patches, with the number of patches placed
+     */
+    Progress resynthesize(const png::image<png::rgb_pixel> &inputImg, int top, int left, int bottom, int right, int count, int margin = 16);
+
     /**
      * @brief Renders the constructed texture image
      * 
+     * The format is chosen by the extension of the file name (png by default, ppm, qoi or raw). Rows are read
+     * from the tiles, for png blocks of rows are filtered and compressed in parallel, the image is never fully copied to memory
+     * 
      * Time Complexity: linear on the number of pixels of the output image
      * 
-     * @param file_name file name of the png image on which the texture will be rendered
+     * @param file_name file name of the image on which the texture will be rendered
+     * @param compressionLevel zlib compression level of png, from 0 (fastest) to 9 (smallest file)
+     */
+    void render(const std::string &file_name, int compressionLevel = 6);
+
+    /**
+     * @brief Starts streaming preview frames of the texture while it is constructed
+     * 
+     * Every copy of pixels publishes only the rectangle of the new patch, a background thread writes the frames,
+     * so the patch fitting never waits for the preview I/O
+     * 
+     * @param file_name file name (or named pipe) where the frames will be written
+     * @param format PreviewStream::ppm for a stream of PPM frames or PreviewStream::raw for a raw framebuffer file
+     * @param maxFramesPerSecond maximum number of frames written per second
+     */
+    void startPreview(const std::string &file_name, PreviewStream::PreviewFormat format = PreviewStream::PreviewFormat::ppm, int maxFramesPerSecond = 10);
+
+    /**
+     * @brief Writes the last preview frame and stops the preview
+     */
+    void stopPreview();
+
+    /**
+     * @brief Writes a checkpoint of the synthesis state (output image, pixels status, seams, sources, random generator, counters,
+     * cut cost, guide, material layers and hole)
+     * 
+     * The file has a format version and a flag per section, the absent state (no guide, layers or hole) takes no
+     * space, and the sections are compressed by zlib. With memory only storage the checkpoint is written by a forked
+     * process from a copy-on-write snapshot, so the patch fitting goes on while it is written and compressed. With a
+     * backing file it is written before returning.
+     * 
+     * Time Complexity: O(width &times; height) for the snapshot of the page tables and the bounding box of the hole
+     * 
+     * @param file_name file name of the checkpoint
+     * @return false if the previous checkpoint or this one (when written before returning) failed
+     */
+    bool checkpoint(const std::string &file_name);
+
+    /**
+     * @brief Writes a checkpoint every everyIterations iterations of patch fitting
+     * 
+     * @param file_name file name of the checkpoint, overwritten by each checkpoint
+     * @param everyIterations number of iterations between checkpoints (0 disables them)
+     */
+    void setCheckpoint(const std::string &file_name, int everyIterations);
+
+    /**
+     * @brief Waits for the checkpoint being written
+     * 
+     * @return true if it was written
+     */
+    bool waitCheckpoint();
+
+    /**
+     * @brief Resumes the synthesis from a checkpoint
+     * 
+     * The resumed texture continues bit-exactly: the next iterations are the ones the checkpointed texture would have done
+     * 
+     * Time Complexity: O(width &times; height)
+     * 
+     * @param checkpoint_file file name of the checkpoint
+     * @param backing_file file name of the file that backs the output image (empty for memory only)
+     * @return std::unique_ptr<ImageTexture> texture with the checkpointed state, throws std::runtime_error on invalid files
+     */
+    static std::unique_ptr<ImageTexture> resume(const std::string &checkpoint_file, const std::string &backing_file = "");
+
+    /**
+     * @brief Chooses the cost of the edges of the cuts of the next patches
+     * 
+     * The gradient cost reads precomputed gradient planes, of the exemplars (the library keeps them, other images get
+     * them once per patchFitting call) and of the output image, which are updated only around the copied pixels. Each
+     * cost has its own compiled edge loop, so the color cost pays nothing for the gradients. The seam energy is
+     * always the color cost, so it can be compared between both.
+     * 
+     * Time Complexity: O(1)
+     * 
+     * @param cost cost of the edges of the cuts
      */
-    void render(const std::string &file_name);
+    void setCutCost(CutCost cost);
+
+    /// cost of the edges of the cuts
+    CutCost getCutCost() const { return cutCost; }
+
+    /**
+     * @brief Chooses from which size the minimum cuts are searched on all the cores
+     * 
+     * The shortest paths of the dual graphs with at least this many vertices are found by a delta-stepping on the
+     * shared thread pool over a flat copy of the graph, the smaller ones by Dijkstra. Both find paths of the same
+     * minimum cost (another path of that cost may be chosen). With a single hardware thread Dijkstra is always used.
+     * 
+     * Time Complexity: O(1)
+     * 
+     * @param vertices number of vertices of the dual graph of an intersection
+     */
+    void setParallelCutThreshold(size_t vertices) { parallelCutVertices = vertices; }
+
+    /// number of vertices from which the minimum cuts are searched on all the cores
+    size_t getParallelCutThreshold() const { return parallelCutVertices; }
+
+    /**
+     * @brief Guides the next patches of a library to follow a target image (texture transfer)
+     * 
+     * The matching cost of each candidate becomes (1 - weight) &times; its overlap cost + weight &times; its guide cost,
+     * the mean squared difference between the luminance of the exemplar and of the target under the whole patch,
+     * divided by the variance of the exemplar like the overlap cost. The guide cost is summed in the same pass over
+     * the patch as the overlap cost, so it costs no other pass. A label map works as a grayscale target. The random
+     * positions of the patches of an image have no candidates, only the matching of a library is guided. The coarse
+     * levels of patchFittingPyramid get the target averaged to their size. reset removes the guide.
+     * 
+     * Time Complexity: O(width &times; height)
+     * 
+     * @param target image with the size of the texture
+     * @param weight weight of the guide cost, from 0 (no guide) to 1 (only the guide)
+     */
+    void setGuide(const png::image<png::rgb_pixel> &target, double weight = 0.5);
+
+    /// removes the guide of setGuide
+    void clearGuide();
+
+    /// true while the matching is guided by a target image
+    bool hasGuide() const { return guideLuma != nullptr; }
+
+    /// number of iterations of patch fitting done since the texture was created (including the checkpointed ones)
+    uint64_t getIterations() const { return iterations; }
+
+    /// seed of the random generator
+    uint64_t getSeed() const { return rngSeed; }
+
+    /**
+     * @brief Renders an output layer of the material patches
+     * 
+     * Time Complexity: linear on the number of pixels of the output image
+     * 
+     * @param layer index of the layer in the materials
+     * @param file_name file name of the image, its format is chosen by the extension (png, ppm, qoi or raw)
+     * @param compressionLevel zlib compression level of png, from 0 (fastest) to 9 (smallest file)
+     */
+    void renderLayer(size_t layer, const std::string &file_name, int compressionLevel = 6);
+
+    /// number of output layers, zero until a patch of a material is placed
+    size_t layerCount() const { return layerImgs.size(); }
+
+    /**
+     * @brief Exemplar pixel copied to the pixel (i, j) of the texture
+     * 
+     * Every patch placed from an ExemplarLibrary records the source of its pixels, a patch of a MaterialSet
+     * records the pixels of its layers as the exemplar 0, so a checkpointed material can be rendered again
+     * with renderSources and a library of one of its layers. 
+     * 
+     * @param i row of the pixel
+     * @param j column of the pixel
+     * @return SourcePixel its source, with unknownExemplar if the pixel isn't colored or its patch didn't come from a library
+     */
+    SourcePixel getSource(int i, int j) const;
+
+    /**
+     * @brief Renders the texture from the source map with the exemplars of another library
+     * 
+     * The library must have the exemplars of the synthesis in the same order, or other channels of them (normal,
+     * roughness or height maps) or versions scale times larger, so a texture synthesized once can be rendered for every
+     * channel of a material and at higher resolutions. The pixel (i, j) of the image gets the pixel
+     * (scale &times; row + i % scale, scale &times; col + j % scale) of the exemplar of the source of the pixel (i / scale, j / scale).
+     * Pixels without a source keep the color of the texture.
+     * 
+     * Time Complexity: linear on the number of pixels of the rendered image
+     * 
+     * @param file_name file name of the image, its format is chosen by the extension (png, ppm, qoi or raw)
+     * @param library exemplars with which the texture will be rendered
+     * @param scale the rendered image has scale &times; width by scale &times; height pixels
+     * @param compressionLevel zlib compression level of png, from 0 (fastest) to 9 (smallest file)
+     */
+    void renderSources(const std::string &file_name, const ExemplarLibrary &library, int scale = 1, int compressionLevel = 6);
+
+    /**
+     * @brief Renders the texture from the source map with the exemplars in their own pixel type
+     * 
+     * The synthesis works on 8 bit rgb exemplars, this renders its result with the exemplars as they are stored: rgba,
+     * grayscale or 16 bit height maps are copied with no conversion. sources[k] is the exemplar k given to the library
+     * (or versions of it scale times larger), the transformed exemplars of the library are mapped back to it with
+     * ExemplarLibrary::sourcePosition. Pixels without a source are zero. The image is written by png++, so it is built
+     * in memory and its format is png.
+     * 
+     * Time Complexity: linear on the number of pixels of the rendered image
+     * 
+     * @param file_name file name of the png image
+     * @param library library of the synthesis
+     * @param sources exemplars given to the library, in its order, in their own pixel type
+     * @param scale the rendered image has scale &times; width by scale &times; height pixels
+     */
+    template<typename Pixel>
+    void renderSources(const std::string &file_name, const ExemplarLibrary &library, const std::vector<const png::image<Pixel> *> &sources, int scale = 1);
+
+    /**
+     * @brief Writes the source map to a file (see writeSourceMap), a run of pixels per row of each patch
+     * 
+     * Time Complexity: linear on the number of pixels of the output image
+     * 
+     * @param file_name file name of the source map
+     * @return size_t number of runs written, throws std::runtime_error if the file can't be written
+     */
+    size_t saveSourceMap(const std::string &file_name);
+
+    /**
+     * @brief Constructs a texture from a source map file and the exemplars of its library
+     * 
+     * The pixels get the colors of their sources and the seam costs are computed again, the pixels without a
+     * source are not colored. The random generator gets a new seed.
+     * 
+     * Time Complexity: O(width &times; height)
+     * 
+     * @param file_name file name of the source map
+     * @param library exemplars of the synthesis, in the same order
+     * @param backing_file file name of the file that backs the output image (empty for memory only)
+     * @return std::unique_ptr<ImageTexture> the texture, throws std::runtime_error on invalid files
+     */
+    static std::unique_ptr<ImageTexture> fromSourceMap(const std::string &file_name, const ExemplarLibrary &library, const std::string &backing_file = "");
+
+    /// bytes of memory used by the grids of the texture (the mapped grids and the resident scratch tiles)
+    size_t memoryUsage() const;
+
+    /**
+     * @brief Clears the texture so it can be constructed again, keeping its mappings and scratch grids
+     * 
+     * Every pixel goes back to not colored, the counters are zeroed and the random generator is seeded again.
+     * The preview is stopped and the periodic checkpoints are disabled. The pages of the grids are dropped (see
+     * MappedGrid::clear) instead of written with zeros.
+     * 
+     * Time Complexity: linear on the number of resident pages of the grids
+     * 
+     * @param seed seed of the random generator, the same seed and calls construct the same texture
+     */
+    void reset(uint64_t seed);
 private:
-    const uint64_t rngSeed;
+    // the checks of selftest.cpp compare the searches of the minimum cuts on dual graphs of their own
+    friend struct CutSearchCheck;
+    uint64_t rngSeed;
     std::mt19937_64 rng;
+    uint64_t iterations = 0;
+    CheckpointWriter checkpointWriter;
+    std::string checkpointFile;
+    int checkpointInterval = 0;
     /// Enum of the status of each pixel on the output image
-    enum PixelStatusEnum{
+    enum PixelStatusEnum : uint8_t{
+        notcolored, /// no pixel from a patch has been copied in this pixel (zero, so new tiles start not colored)
         colored, /// at least one pixel from a patch has been copied in this pixel
         intersection, /// this pixel is in the intersection from the already updated pixels and a pixel of the new rectangle
-        newcolor, /// this pixel should be changed to a pixel from the new patch
-        notcolored // no pixel from a patch has been copied in this pixel
+        newcolor /// this pixel should be changed to a pixel from the new patch
     };
     // Enum of the type of the edges
     enum edgeType{
@@ -135,15 +708,82 @@ private:
         copyGraph, // edge to the copy graph (to deal with the cut cycles)
         invalid // invalid edge
     };
-    // Png image that will be construct
-    png::image<png::rgb_pixel> outputImg;
+    // Png image that will be construct, stored in tiles
+    MappedGrid<png::rgb_pixel> outputImg;
     // width of output image
     const int imgWidth;
     // height of output image
     const int imgHeight;
     // pixel of color status, may be useful to change to a counter of the number of improvements of each pixel in some implementations of matching
-    std::vector<std::vector<PixelStatusEnum>> pixelColorStatus;
+    MappedGrid<PixelStatusEnum> pixelColorStatus;
+    // cost of the seam between each pixel and its right [0] and lower [1] neighbors (zero where there is no seam)
+    MappedGrid<std::array<float, 2>> seamCost;
+    // exemplar pixel copied to each pixel of the output image, only meaningful on colored pixels
+    MappedGrid<SourcePixel> sourceMap;
+    // exemplar pixel of the upper left pixel of the patch being placed
+    SourcePixel patchOrigin = {unknownExemplar, 0, 0};
+    // library of the exemplar of the patch being placed, null if it isn't from a library
+    const ExemplarLibrary *patchLibrary = nullptr;
+    // material of the patch being placed, null if it isn't from a material
+    const MaterialSet *patchMaterial = nullptr;
+    // file that backs the output image, the output layers use backing_file + ".layer" + index (empty for memory only)
+    const std::string backingFile;
+    // layers of the material patches, with the same pixels copied as the output image
+    std::vector<std::unique_ptr<MappedGrid<png::rgb_pixel>>> layerImgs;
+    // cost of the edges of the cuts
+    CutCost cutCost = CutCost::color;
+    // dual graphs with at least this many vertices are cut by the parallel delta-stepping
+    size_t parallelCutVertices = 1 << 16;
+    // gradients of the colored pixels of the output image, like GradientPlanes, zero towards pixels not colored (only with the gradient cost)
+    std::unique_ptr<MappedGrid<std::array<float, 2>>> outputGradients;
+    // the output gradients must be computed again, the pixels were changed without copyPixelsNewColor
+    bool outputGradientsStale = true;
+    // gradients of the images of the patch fitting in progress without a library, by Candidate::image, so each one is computed once
+    std::vector<GradientPlanes> fittingGradients;
+    // gradients of a patch without a library or fittingGradients
+    GradientPlanes ownGradients;
+    // gradients of the exemplar of the patch being placed and position of the patch in them (only with the gradient cost)
+    const GradientPlanes *patchGradients = nullptr;
+    int patchGradientRow = 0;
+    int patchGradientCol = 0;
+    // luminance of the target of the guided synthesis, null without a guide
+    std::unique_ptr<MappedGrid<png::byte>> guideLuma;
+    // weight of the guide cost in the matching cost, the overlap cost has weight 1 - guideWeight
+    double guideWeight = 0;
+    // the drawn patches overlap the rows [placeTop, placeBottom) and the columns [placeLeft, placeRight), the whole image by default
+    int placeTop = 0;
+    int placeLeft = 0;
+    int placeBottom = imgHeight;
+    int placeRight = imgWidth;
+    // pixels of the hole of setHole, only its tiles are allocated (the pixels out of it are fixed while holeSet)
+    TiledGrid<bool> inHole;
+    bool holeSet = false;
+    // bounding box of the hole, rows [holeTop, holeBottom) and columns [holeLeft, holeRight)
+    int holeTop = 0;
+    int holeLeft = 0;
+    int holeBottom = 0;
+    int holeRight = 0;
+    // while editSet the pixels out of the rows [editTop, editBottom) and the columns [editLeft, editRight) are fixed too (see resynthesize)
+    bool editSet = false;
+    int editTop = 0;
+    int editLeft = 0;
+    int editBottom = 0;
+    int editRight = 0;
+    // sum of seamCost
+    long double seamEnergy = 0;
+    // number of colored pixels
+    uint64_t coveredPixels = 0;
+    // number of blendings of case 2
+    uint64_t case2Count = 0;
+    // sum of the costs of the seams created by the last cut
+    long double lastCutCost = 0;
+    // pixels copied from the last patch
+    uint64_t lastChangedPixels = 0;
+    // live preview of the output image, null when there is no preview
+    std::unique_ptr<PreviewStream> preview;
     static constexpr long double inftyCost = 10000000;
+    // auxiliar variables are released when one of them has more resident tiles than this
+    static constexpr size_t maxResidentScratchTiles = 256;
     //pixels adjacent (ccw)
     static constexpr std::array<std::pair<int, int>, 4> directions = {{
         {-1, 0},    //    |0|
@@ -173,7 +813,30 @@ private:
     template<typename Pixel>
     static long double calcCost(const Pixel &as, const Pixel &bs, const Pixel &at, const Pixel &bt);
     
+    // position of a patch from an exemplar of a library
+    struct Candidate{
+        size_t exemplar;
+        int heightOffset;
+        int widthOffset;
+        size_t image = 0; // index of the image among those of the patch fitting without a library, it keys their gradients
+    };
+    // chooses the exemplar and position of the next patch, returns its image and the candidate (exemplar is unknownExemplar without a library)
+    using PatchChooser = std::function<std::pair<const png::image<png::rgb_pixel> *, Candidate>()>;
+    // matching cost of a candidate
+    struct MatchingCost{
+        double cost; // overlap cost, plus the guide cost with a guide (zero without both)
+        uint64_t uncolored; // pixels it would color for the first time
+        bool overlaps; // it has colored pixels under it
+    };
+
     std::pair<int, int> matching(const png::image<png::rgb_pixel> &inputImg);
+    Candidate matching(const ExemplarLibrary &library, int candidates);
+    MatchingCost matchingCost(const ExemplarLibrary &library, const Candidate &candidate) const;
+    static png::byte luma(png::byte red, png::byte green, png::byte blue);
+    uint16_t outputSample(int i, int j, const ExemplarLibrary &library) const;
+    void guideFrom(const ImageTexture &fine, int factor);
+    // finished is tested with the patches placed before each one, the fitting stops (as iterationLimit) once it is true
+    Progress fitPatches(const FittingLimits &limits, const PatchChooser &nextPatch, const ExemplarLibrary *library = nullptr, const MaterialSet *material = nullptr, const std::function<bool(uint64_t)> &finished = nullptr);
     bool isFirstPatch(int heightOffset, int widthOffset, const png::image<png::rgb_pixel> &inputImg);
     bool stPlanarGraph(int heightOffset, int widthOffset, const png::image<png::rgb_pixel> &inputImg);
     void blendingCase1(int heightOffset, int widthOffset, const png::image<png::rgb_pixel> &inputImg);
@@ -181,46 +844,91 @@ private:
 
     void copyFirstPatch(int heightOffset, int widthOffset, const png::image<png::rgb_pixel> &inputImg);
     void copyPixelsNewColor(int heightOffset, int widthOffset, const png::image<png::rgb_pixel> &inputImg, bool case2 = false);
+    void updateSeams(int heightOffset, int widthOffset, const png::image<png::rgb_pixel> &inputImg);
+    void placePatch(int heightOffset, int widthOffset, const png::image<png::rgb_pixel> &inputImg, SourcePixel origin = {unknownExemplar, 0, 0}, const ExemplarLibrary *library = nullptr, const MaterialSet *material = nullptr, const GradientPlanes *gradients = nullptr);
+    void putPatch(int heightOffset, int widthOffset, const png::image<png::rgb_pixel> &inputImg, SourcePixel origin, const ExemplarLibrary *library, const MaterialSet *material, const GradientPlanes *gradients);
+    void countIteration();
+    static float sourceSeamCost(const ExemplarLibrary &library, const SourcePixel &sourceP, const png::rgb_pixel &p, const SourcePixel &sourceQ, const png::rgb_pixel &q, int di, int dj);
+    void upsampleFrom(const ImageTexture &coarse, const ExemplarLibrary &library);
+    void computeSeams(const ExemplarLibrary &library);
+    int refineSeams(const ExemplarLibrary &library, int count, int patchSize, const std::atomic<bool> *cancel);
+    Progress currentProgress(uint64_t iterationsDone, std::chrono::steady_clock::time_point start) const;
     bool inImgBorder(int i, int j, int heightOffset, int widthOffset, const png::image<png::rgb_pixel> &inputImg);    
     bool insidePrimal(int i, int j);  
     bool insideDual(int i, int j);
     bool insideImg(int i, int j, const png::image<png::rgb_pixel> &img);
+    bool isFixed(int i, int j);
+    Progress fitHole(const FittingLimits &limits, const PatchChooser &nextPatch, const ExemplarLibrary *library);
+    Progress resynthesizeRect(int top, int left, int bottom, int right, int count, int margin, const PatchChooser &nextPatch, const ExemplarLibrary *library);
+    void releaseScratch(bool always = false);
     class Intersection{
         public:
             // counter clockwise, starting with upper neighbor
             std::vector<std::pair<int, int>> interPixels;
-            Intersection(const std::vector<std::pair<int,int>> &pixels = {});
+            int index; // position in the list of findIntersections, written in intersectionOf for its pixels
+            Intersection(const std::vector<std::pair<int,int>> &pixels = {}, int interIndex = -1);
     };
     
-    //Case 1 auxiliar variables
-    std::vector<std::vector<bool>> inSubgraph;
-    std::vector<std::vector<std::array<long double, 4>>> edgesCosts;    
-    std::vector<std::vector<long double>> dist;
-    std::vector<std::vector<bool>> vis;
-    std::vector<std::vector<int>> parent;
-    std::vector<std::vector<std::array<bool, 4>>> validEdge;
-    std::vector<std::vector<bool>> isT;
-    std::vector<std::vector<bool>> isS;
+    //Blending auxiliar variables
+    TiledGrid<bool> wasColored; // pixels of the new patch that were colored before the blending
+    TiledGrid<bool> fixedInPatch; // pixels of the new patch that keep their color during the blending (only with a hole or an edit rectangle)
+    TiledGrid<int> intersectionOf; // index of the intersection of each pixel of the intersections, -1 for the others
+
+    //Case 1 auxiliar variables, a blending uses cutScratch[0], the concurrent cuts of case 1 one for each intersection
+    struct CutScratch{
+        CutScratch(int height, int width);
+        size_t resident() const;
+        size_t residentBytes() const;
+        void release();
+
+        TiledGrid<bool> inSubgraph;
+        TiledGrid<std::array<long double, 4>> edgesCosts;    
+        TiledGrid<long double> dist;
+        TiledGrid<bool> vis;
+        TiledGrid<int> parent;
+        TiledGrid<std::array<bool, 4>> validEdge;
+        TiledGrid<bool> isT;
+        TiledGrid<bool> isS;
+        // search from T of the bidirectional search, parentBackward is the direction towards T
+        TiledGrid<long double> distBackward;
+        TiledGrid<bool> visBackward;
+        TiledGrid<int> parentBackward;
+    };
+    std::vector<std::unique_ptr<CutScratch>> cutScratch;
 
     //Case 1 auxiliar methods
     std::pair<std::pair<int, int>, std::pair<int, int> > findSTInIntersectionCase1(Intersection &inter);
     std::vector<Intersection> findIntersections(int heightOffset, int widthOffset, const png::image<png::rgb_pixel> &inputImg);
-    void markMinABCut(std::pair<int, int> S, std::pair<int, int> T, const ImageTexture::Intersection &inter, int heightOffset, int widthOffset, const png::image<png::rgb_pixel> &inputImg);
+    bool inIntersection(int i, int j, const Intersection &inter);
+    void markMinABCut(CutScratch &scratch, std::pair<int, int> S, std::pair<int, int> T, const ImageTexture::Intersection &inter, int heightOffset, int widthOffset, const png::image<png::rgb_pixel> &inputImg);
+    void cutIntersectionInDual(CutScratch &scratch, std::pair<int, int> S, std::pair<int, int> T, const ImageTexture::Intersection &inter, const std::vector<std::pair<int, int>> &inDual, bool parallelSearch);
     //MarkMinABCut auxiliar methods
-    std::vector<std::pair<int, int>> markIntersectionCellsInDual(const ImageTexture::Intersection &inter);
-    void markIntersectionEdgeCostsInDual(int heightOffset, int widthOffset, const png::image<png::rgb_pixel> &inputImg, const std::vector<std::pair<int, int>> &inDual);
-    std::vector<std::pair<int,int>> findSTPath(const std::vector<std::pair<int,int>> &S, const std::vector<std::pair<int,int>> &T);
-    void markLeftOfMinCut(const std::vector<std::pair<int, int>> &cut);
+    std::vector<std::pair<int, int>> markIntersectionCellsInDual(CutScratch &scratch, const ImageTexture::Intersection &inter);
+    std::vector<std::pair<int, int>> dualCells(const ImageTexture::Intersection &inter);
+    void markIntersectionEdgeCostsInDual(CutScratch &scratch, const ImageTexture::Intersection &inter, int heightOffset, int widthOffset, const png::image<png::rgb_pixel> &inputImg, const std::vector<std::pair<int, int>> &inDual);
+    void prepareEdgeCosts(const png::image<png::rgb_pixel> &inputImg);
+    template<CutCost cost>
+    void markEdgeCosts(CutScratch &scratch, const Intersection &inter, int heightOffset, int widthOffset, const png::image<png::rgb_pixel> &inputImg, const std::vector<std::pair<int, int>> &inDual);
+    void updateOutputGradients(int firstRow, int firstCol, int lastRow, int lastCol);
+    template<typename T>
+    void rollGrid(MappedGrid<T> &grid, int down, int right);
+    void rollOutput(int down, int right, const ExemplarLibrary &library);
+    std::vector<std::pair<int,int>> findSTPath(CutScratch &scratch, const std::vector<std::pair<int,int>> &S, const std::vector<std::pair<int,int>> &T, const std::vector<std::pair<int,int>> &inDual);
+    std::vector<std::pair<int,int>> parallelSTPath(CutScratch &scratch, const std::vector<std::pair<int,int>> &inDual);
+    bool parallelCut(size_t vertices) const;
+    std::vector<std::pair<int,int>> findSTPathBidirectional(CutScratch &scratch, std::pair<int,int> S, std::pair<int,int> T);
+    void markLeftOfMinCut(CutScratch &scratch, const Intersection &inter, const std::vector<std::pair<int, int>> &cut);
     
     //Case 2 auxiliar variables
-    std::vector<std::vector<bool>> inS;
-    std::vector<std::vector<int>> inStPath;
+    TiledGrid<bool> inS;
+    TiledGrid<int> inStPath;
     constexpr static std::array<int, 4> edgesToOriginalGraph = {edgeType::originalGraph,edgeType::originalGraph,edgeType::originalGraph,edgeType::originalGraph};
-    std::array<std::vector<std::vector<std::array<int, 4>>>,2> edgeTo;
-    std::array<std::vector<std::vector<long double>>, 2> distCase2;
-    std::array<std::vector<std::vector<int>>, 2> visCase2;
-    std::array<std::vector<std::vector<int>>, 2> seenCase2;
-    std::array<std::vector<std::vector<int>>, 2> parentCase2;
+    std::array<TiledGrid<std::array<int, 4>>,2> edgeTo;
+    std::array<TiledGrid<long double>, 2> distCase2;
+    std::array<TiledGrid<int>, 2> visCase2;
+    std::array<TiledGrid<int>, 2> seenCase2;
+    std::array<TiledGrid<int>, 2> parentCase2;
+    TiledGrid<int> inCutCycle;
 
     //Case 2 auxiliar functions
     std::vector<std::pair<int, int>> dualBorder(int heightOffset, int widthOffset, const png::image<png::rgb_pixel> &inputImg);
@@ -228,3 +936,20 @@ private:
     std::pair<long double, std::vector<std::array<int,3>>> minCutCycle(int left, int right, const std::vector<std::pair<int, int>> &stPath, int &visited);    
     std::pair<long double, std::vector<std::array<int,3>>> findMinFCycle(const std::pair<int,int> &F, int visited);
 };
+
+template<typename Pixel>
+void ImageTexture::renderSources(const std::string &file_name, const ExemplarLibrary &library, const std::vector<const png::image<Pixel> *> &sources, int scale){
+    M_ASSERT("there must be an image for each exemplar given to the library", sources.size() >= library.sourceCount());
+    scale = std::max(1, scale);
+    png::image<Pixel> img(imgWidth * scale, imgHeight * scale);
+    for(int i = 0; i < imgHeight * scale; i++)
+        for(int j = 0; j < imgWidth * scale; j++){
+            const SourcePixel source = getSource(i / scale, j / scale);
+            if(source.exemplar == unknownExemplar || source.exemplar >= library.size())
+                continue;
+            const png::image<Pixel> &exemplar = *sources[library.source(source.exemplar)];
+            const auto [row, col] = library.sourcePosition(source.exemplar, scale * source.row + i % scale, scale * source.col + j % scale, scale);
+            img[i][j] = exemplar[std::min(row, (int) exemplar.get_height() - 1)][std::min(col, (int) exemplar.get_width() - 1)];
+        }
+    img.write(file_name);
+}
@@ -0,0 +1,215 @@
+/**
+ * @file jsonline.cpp
+ * @author Letícia Freire Carvalho de Sousa
+ * @brief Implementation of jsonline.hpp
+ * @version 0.1
+ * @date 2026-10-19
+ *
+ * @copyright Copyright (c) 2024
+ *
+ */
+
+#include "jsonline.hpp"
+#include <stdexcept>
+#include <cstdlib>
+#include <cmath>
+#include <cstdio>
+#include <charconv>
+
+namespace{
+
+class Parser{
+public:
+    explicit Parser(const std::string &_text) : text(_text) {}
+
+    JsonObject object(){
+        JsonObject members;
+        expect('{');
+        if(peek() == '}'){
+            pos++;
+            return finish(members);
+        }
+        while(true){
+            std::string name = string();
+            expect(':');
+            members[name] = value();
+            char c = next();
+            if(c == '}')
+                return finish(members);
+            if(c != ',')
+                fail("expected ',' or '}'");
+        }
+    }
+private:
+    const std::string &text;
+    size_t pos = 0;
+
+    [[noreturn]] void fail(const std::string &what){
+        throw std::runtime_error("Invalid JSON at " + std::to_string(pos) + ": " + what);
+    }
+    void skipSpaces(){
+        while(pos < text.size() && (text[pos] == ' ' || text[pos] == '\t' || text[pos] == '\n' || text[pos] == '\r'))
+            pos++;
+    }
+    char peek(){
+        skipSpaces();
+        return pos < text.size() ? text[pos] : '\0';
+    }
+    char next(){
+        char c = peek();
+        if(c == '\0')
+            fail("unexpected end");
+        pos++;
+        return c;
+    }
+    void expect(char c){
+        if(next() != c)
+            fail(std::string("expected '") + c + "'");
+    }
+    JsonObject finish(JsonObject &members){
+        if(peek() != '\0')
+            fail("text after the object");
+        return members;
+    }
+
+    std::string string(){
+        expect('"');
+        std::string s;
+        while(true){
+            if(pos >= text.size())
+                fail("unterminated string");
+            char c = text[pos++];
+            if(c == '"')
+                return s;
+            if(c != '\\'){
+                s += c;
+                continue;
+            }
+            if(pos >= text.size())
+                fail("unterminated string");
+            c = text[pos++];
+            switch(c){
+                case 'n': s += '\n'; break;
+                case 't': s += '\t'; break;
+                case 'r': s += '\r'; break;
+                case 'b': s += '\b'; break;
+                case 'f': s += '\f'; break;
+                case 'u':{
+                    if(pos + 4 > text.size())
+                        fail("invalid escape");
+                    unsigned code = (unsigned) std::strtoul(text.substr(pos, 4).c_str(), nullptr, 16);
+                    pos += 4;
+                    // utf-8 of the code point (surrogate pairs are kept as two code points)
+                    if(code < 0x80){
+                        s += (char) code;
+                    } else if(code < 0x800){
+                        s += (char) (0xc0 | (code >> 6));
+                        s += (char) (0x80 | (code & 0x3f));
+                    } else{
+                        s += (char) (0xe0 | (code >> 12));
+                        s += (char) (0x80 | ((code >> 6) & 0x3f));
+                        s += (char) (0x80 | (code & 0x3f));
+                    }
+                    break;
+                }
+                default: s += c; break;
+            }
+        }
+    }
+
+    JsonValue value(){
+        JsonValue v;
+        char c = peek();
+        if(c == '"'){
+            v.type = JsonValue::Type::string;
+            v.text = string();
+        } else if(c == '['){
+            pos++;
+            v.type = JsonValue::Type::array;
+            if(peek() == ']'){
+                pos++;
+                return v;
+            }
+            while(true){
+                v.items.push_back(value());
+                char d = next();
+                if(d == ']')
+                    break;
+                if(d != ',')
+                    fail("expected ',' or ']'");
+            }
+        } else if(c == '{'){
+            fail("nested objects are not supported");
+        } else{
+            size_t start = pos;
+            while(pos < text.size() && text[pos] != ',' && text[pos] != '}' && text[pos] != ']' && text[pos] != ' ' && text[pos] != '\t' && text[pos] != '\n' && text[pos] != '\r')
+                pos++;
+            v.text = text.substr(start, pos - start);
+            if(v.text == "true" || v.text == "false"){
+                v.type = JsonValue::Type::boolean;
+            } else if(v.text == "null"){
+                v.type = JsonValue::Type::null;
+            } else{
+                // strtod also reads nan, inf and hexadecimal numbers, which JSON doesn't have
+                char *end;
+                const double number = std::strtod(v.text.c_str(), &end);
+                if(v.text.empty() || *end != '\0' || v.text.find_first_not_of("0123456789+-.eE") != std::string::npos || !std::isfinite(number))
+                    fail("invalid value");
+                v.type = JsonValue::Type::number;
+            }
+        }
+        return v;
+    }
+};
+
+} // namespace
+
+double JsonValue::asNumber() const{
+    if(type != Type::number)
+        throw std::runtime_error("expected a number, got " + text);
+    return std::strtod(text.c_str(), nullptr);
+}
+uint64_t JsonValue::asUnsigned() const{
+    if(type != Type::number && type != Type::string)
+        throw std::runtime_error("expected an unsigned integer, got " + text);
+    uint64_t value = 0;
+    auto [end, error] = std::from_chars(text.data(), text.data() + text.size(), value);
+    if(text.empty() || error != std::errc() || end != text.data() + text.size())
+        throw std::runtime_error("expected an unsigned integer, got " + text);
+    return value;
+}
+const std::string &JsonValue::asString() const{
+    if(type != Type::string)
+        throw std::runtime_error("expected a string, got " + text);
+    return text;
+}
+bool JsonValue::asBool() const{
+    if(type != Type::boolean)
+        throw std::runtime_error("expected a boolean, got " + text);
+    return text == "true";
+}
+
+JsonObject parseJsonObject(const std::string &text){
+    return Parser(text).object();
+}
+
+std::string jsonQuote(const std::string &s){
+    std::string quoted = "\"";
+    for(char c : s){
+        switch(c){
+            case '"': quoted += "\\\""; break;
+            case '\\': quoted += "\\\\"; break;
+            case '\n': quoted += "\\n"; break;
+            case '\t': quoted += "\\t"; break;
+            case '\r': quoted += "\\r"; break;
+            default:
+                if((unsigned char) c < 0x20){
+                    char escaped[8];
+                    std::snprintf(escaped, sizeof(escaped), "\\u%04x", (unsigned) c);
+                    quoted += escaped;
+                } else
+                    quoted += c;
+        }
+    }
+    return quoted + "\"";
+}
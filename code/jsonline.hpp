@@ -0,0 +1,62 @@
+/**
+ * @file jsonline.hpp
+ * @author Letícia Freire Carvalho de Sousa
+ * @brief Header file of the parser of the JSON objects of the job protocol
+ * @version 0.1
+ * @date 2026-10-19
+ *
+ * @copyright Copyright (c) 2024
+ *
+ */
+#pragma once
+#include <string>
+#include <vector>
+#include <map>
+#include <cstdint>
+
+/**
+ * @brief Value of a member of a JSON object: a scalar or an array
+ */
+struct JsonValue{
+    /// Enum of the types of the values
+    enum Type{
+        null,
+        boolean,
+        number,
+        string,
+        array
+    };
+    Type type = Type::null;
+    std::string text; /// contents of a string, or the literal of a number or boolean
+    std::vector<JsonValue> items; /// elements of an array
+
+    /// number of a number value, throws std::runtime_error for other types
+    double asNumber() const;
+    /// digits of a number or string value read exactly, throws std::runtime_error for other types, signs, fractions, exponents and values over 2^64 - 1
+    uint64_t asUnsigned() const;
+    /// contents of a string value, throws std::runtime_error for other types
+    const std::string &asString() const;
+    /// true for the boolean true, throws std::runtime_error for other types
+    bool asBool() const;
+};
+
+/// members of a JSON object by name
+using JsonObject = std::map<std::string, JsonValue>;
+
+/**
+ * @brief Parses a JSON object whose members are scalars or arrays (nested objects are not supported)
+ *
+ * Time Complexity: linear on the length of the text
+ *
+ * @param text text of the object, usually a line of the protocol
+ * @return JsonObject members of the object, throws std::runtime_error on invalid text
+ */
+JsonObject parseJsonObject(const std::string &text);
+
+/**
+ * @brief Quotes and escapes a string as a JSON string
+ *
+ * @param s string that will be quoted
+ * @return std::string
+ */
+std::string jsonQuote(const std::string &s);
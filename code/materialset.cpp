@@ -0,0 +1,71 @@
+/**
+ * @file materialset.cpp
+ * @author Letícia Freire Carvalho de Sousa
+ * @brief Implementation of materialset.hpp
+ * @version 0.1
+ * @date 2026-10-19
+ *
+ * @copyright Copyright (c) 2024
+ *
+ */
+
+#include "materialset.hpp"
+#include "sourcemap.hpp"
+#include <stdexcept>
+#include <algorithm>
+#include <cmath>
+
+MaterialSet::MaterialSet(const std::vector<const png::image<png::rgb_pixel> *> &_layers, const std::vector<double> &weights){
+    for(const png::image<png::rgb_pixel> *layer : _layers)
+        // not owned, the deleter does nothing
+        layers.emplace_back(layer, [](const png::image<png::rgb_pixel> *){});
+    makeGuide(weights);
+}
+MaterialSet::MaterialSet(const std::vector<std::string> &file_names, const std::vector<double> &weights){
+    for(const std::string &file_name : file_names)
+        layers.push_back(std::make_shared<const png::image<png::rgb_pixel>>(readImage(file_name)));
+    makeGuide(weights);
+}
+
+void MaterialSet::makeGuide(const std::vector<double> &weights){
+    if(layers.empty())
+        throw std::runtime_error("A material needs at least one layer");
+    for(const auto &layer : layers)
+        if(layer->get_width() != layers[0]->get_width() || layer->get_height() != layers[0]->get_height())
+            throw std::runtime_error("The layers of a material must have the same size");
+    // its patches record their sources like the exemplars of a library
+    if((int64_t) layers[0]->get_width() > maxExemplarSide || (int64_t) layers[0]->get_height() > maxExemplarSide)
+        throw std::runtime_error("The layers of a material can't be larger than " + std::to_string(maxExemplarSide) + " pixels on a side");
+    if(weights.size() > layers.size())
+        throw std::runtime_error("A material has more weights than layers");
+    double total = 0;
+    for(double weight : weights){
+        if(weight < 0)
+            throw std::runtime_error("The weights of the layers can't be negative");
+        total += weight;
+    }
+    // with one weighted layer the guide is the layer itself
+    const size_t weighted = (size_t) std::count_if(weights.begin(), weights.end(), [](double weight){ return weight > 0; });
+    if(weighted <= 1){
+        size_t chosen = weighted == 0 ? 0 : (size_t) (std::find_if(weights.begin(), weights.end(), [](double weight){ return weight > 0; }) - weights.begin());
+        guideImg = layers[chosen];
+        return;
+    }
+    const int height = (int) layers[0]->get_height(), width = (int) layers[0]->get_width();
+    auto guide = std::make_shared<png::image<png::rgb_pixel>>(width, height);
+    for(int i = 0; i < height; i++)
+        for(int j = 0; j < width; j++){
+            double sum[3] = {0, 0, 0};
+            for(size_t k = 0; k < weights.size(); k++){
+                if(weights[k] <= 0)
+                    continue;
+                const png::rgb_pixel &p = (*layers[k])[i][j];
+                sum[0] += weights[k] * p.red;
+                sum[1] += weights[k] * p.green;
+                sum[2] += weights[k] * p.blue;
+            }
+            auto channel = [total](double value){ return png::byte(std::clamp(std::lround(value / total), 0l, 255l)); };
+            (*guide)[i][j] = png::rgb_pixel(channel(sum[0]), channel(sum[1]), channel(sum[2]));
+        }
+    guideImg = std::move(guide);
+}
@@ -0,0 +1,70 @@
+/**
+ * @file materialset.hpp
+ * @author Letícia Freire Carvalho de Sousa
+ * @brief Header file of the material sets, aligned exemplar layers synthesized together
+ * @version 0.1
+ * @date 2026-10-19
+ *
+ * @copyright Copyright (c) 2024
+ *
+ */
+#pragma once
+#include <png++/png.hpp>
+#include "imagecodec.hpp"
+#include <string>
+#include <vector>
+#include <memory>
+
+/**
+ * @brief Layers of a material (albedo, normal, roughness, height...) that must stay pixel aligned
+ *
+ * The patch fitting computes the matching and the cuts on a guide image, the weighted mean of the layers, and
+ * copies every layer with the same mask of the cut, so a whole material costs one synthesis and a copy per
+ * layer. The material never changes after it is constructed.
+ */
+class MaterialSet{
+public:
+    /**
+     * @brief Construct a new Material Set object from decoded layers
+     *
+     * The images are not copied, they must outlive the material
+     *
+     * Time Complexity: linear on the number of pixels of the layers
+     *
+     * @param layers images of the layers, all of the same size and at most maxExemplarSide pixels on a side, throws
+     * std::runtime_error if they are not
+     * @param weights weight of each layer in the guide, the guide is the first layer when empty
+     */
+    explicit MaterialSet(const std::vector<const png::image<png::rgb_pixel> *> &layers, const std::vector<double> &weights = {});
+
+    /**
+     * @brief Construct a new Material Set object from image files
+     *
+     * Time Complexity: linear on the number of pixels of the layers
+     *
+     * @param file_names file names of the layers (png, ppm, qoi or raw), throws png::error if one can't be read and
+     * std::runtime_error if they are not of the same size or are larger than maxExemplarSide
+     * @param weights weight of each layer in the guide, the guide is the first layer when empty
+     */
+    explicit MaterialSet(const std::vector<std::string> &file_names, const std::vector<double> &weights = {});
+
+    /// number of layers
+    size_t size() const { return layers.size(); }
+
+    /// image of the layer i
+    const png::image<png::rgb_pixel> &layer(size_t i) const { return *layers[i]; }
+
+    /// image on which the matching and the cuts are computed, each channel is the weighted mean of the channel of the layers
+    const png::image<png::rgb_pixel> &guide() const { return *guideImg; }
+
+    /// width of the layers
+    int width() const { return (int) guideImg->get_width(); }
+
+    /// height of the layers
+    int height() const { return (int) guideImg->get_height(); }
+private:
+    std::vector<std::shared_ptr<const png::image<png::rgb_pixel>>> layers;
+    std::shared_ptr<const png::image<png::rgb_pixel>> guideImg;
+
+    void makeGuide(const std::vector<double> &weights);
+};
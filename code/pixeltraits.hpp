@@ -0,0 +1,106 @@
+/**
+ * @file pixeltraits.hpp
+ * @author Letícia Freire Carvalho de Sousa
+ * @brief Header file of the channels of the png++ pixel types and of the color distance of the cuts
+ * @version 0.1
+ * @date 2026-10-19
+ *
+ * @copyright Copyright (c) 2024
+ *
+ */
+#pragma once
+#include <png++/png.hpp>
+#include <utility>
+#include <cmath>
+
+/**
+ * @brief Channels of a pixel type
+ *
+ * channels is the number of channels and unit is the value of a channel that is one step of an 8 bit channel,
+ * so distances of pixels of different depths are in the same scale. channel(p, c) reads the channel c of p.
+ *
+ * The output image and the exemplars of the synthesis are 8 bit rgb. The cuts and the matching of ImageTexture use the
+ * gray_pixel_16 distance on the samples of a library of grayscale exemplars (see ExemplarLibrary::hasSamples) and the
+ * rgb one otherwise, the gradient planes and the video cuts only the rgb one. The rgba exemplars are only rendered from
+ * the source map by ImageTexture::renderSources.
+ */
+template<typename Pixel>
+struct PixelTraits;
+
+template<typename T>
+struct PixelTraits<png::basic_rgb_pixel<T>>{
+    static constexpr int channels = 3;
+    static constexpr int unit = sizeof(T) == 1 ? 1 : 257;
+    static T channel(const png::basic_rgb_pixel<T> &p, int c){ return c == 0 ? p.red : c == 1 ? p.green : p.blue; }
+};
+
+template<typename T>
+struct PixelTraits<png::basic_rgba_pixel<T>>{
+    static constexpr int channels = 4;
+    static constexpr int unit = sizeof(T) == 1 ? 1 : 257;
+    static T channel(const png::basic_rgba_pixel<T> &p, int c){ return c == 0 ? p.red : c == 1 ? p.green : c == 2 ? p.blue : p.alpha; }
+};
+
+template<>
+struct PixelTraits<png::gray_pixel>{
+    static constexpr int channels = 1;
+    static constexpr int unit = 1;
+    static int channel(const png::gray_pixel &p, int){ return (int) p; }
+};
+
+template<>
+struct PixelTraits<png::gray_pixel_16>{
+    static constexpr int channels = 1;
+    static constexpr int unit = 257;
+    static int channel(const png::gray_pixel_16 &p, int){ return (int) p; }
+};
+
+namespace pixeltraits_detail{
+
+template<typename Pixel, size_t... C>
+long double squaredDistance(const Pixel &a, const Pixel &b, std::index_sequence<C...>){
+    using Traits = PixelTraits<Pixel>;
+    // the channels are unrolled at compile time, summed in order
+    return (... + ((long double) ((int) Traits::channel(a, (int) C) - (int) Traits::channel(b, (int) C))
+        * (long double) ((int) Traits::channel(a, (int) C) - (int) Traits::channel(b, (int) C))));
+}
+
+} // namespace pixeltraits_detail
+
+/**
+ * @brief Squared euclidean distance of the channels of two pixels, in steps of an 8 bit channel
+ *
+ * Time Complexity: O(channels)
+ *
+ * @param a first pixel
+ * @param b second pixel
+ * @return long double the squared distance, a 16 bit channel that differs by 257 counts as 1
+ */
+template<typename Pixel>
+long double squaredColorDistance(const Pixel &a, const Pixel &b){
+    using Traits = PixelTraits<Pixel>;
+    const long double squared = pixeltraits_detail::squaredDistance(a, b, std::make_index_sequence<Traits::channels>{});
+    if constexpr(Traits::unit == 1)
+        return squared;
+    else
+        return squared / ((long double) Traits::unit * Traits::unit);
+}
+
+/**
+ * @brief Euclidean distance of the channels of two pixels, in steps of an 8 bit channel
+ *
+ * Time Complexity: O(channels)
+ *
+ * @param a first pixel
+ * @param b second pixel
+ * @return long double the distance, a 16 bit channel that differs by 257 counts as 1
+ */
+template<typename Pixel>
+long double colorDistance(const Pixel &a, const Pixel &b){
+    using Traits = PixelTraits<Pixel>;
+    const long double squared = pixeltraits_detail::squaredDistance(a, b, std::make_index_sequence<Traits::channels>{});
+    if constexpr(Traits::unit == 1)
+        return sqrtl(squared);
+    else
+        return sqrtl(squared) / Traits::unit;
+}
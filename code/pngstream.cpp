@@ -0,0 +1,229 @@
+/**
+ * @file pngstream.cpp
+ * @author Letícia Freire Carvalho de Sousa
+ * @brief Implementation of pngstream.hpp
+ * @version 0.1
+ * @date 2026-10-19
+ *
+ * @copyright Copyright (c) 2024
+ *
+ */
+
+#include "pngstream.hpp"
+#include <png.h>
+#include <csetjmp>
+#include <zlib.h>
+#include <deque>
+#include <algorithm>
+#include <future>
+#include <vector>
+#include <cstdlib>
+#include "threadpool.hpp"
+
+namespace{
+    // png images have at least one row and one column, and up to 2^31 - 1 of each
+    void checkSize(const std::string &file_name, int width, int height){
+        if(width <= 0 || height <= 0)
+            throw png::error("Invalid size " + std::to_string(width) + "x" + std::to_string(height) + " of png image " + file_name);
+    }
+}
+
+PngStreamWriter::PngStreamWriter(const std::string &file_name, int _width, int _height)
+    :
+    width(_width),
+    height(_height) {
+    checkSize(file_name, width, height);
+    file = fopen(file_name.c_str(), "wb");
+    if(!file)
+        throw png::error("Invalid name for output file " + file_name);
+    png_structp png = png_create_write_struct(PNG_LIBPNG_VER_STRING, nullptr, nullptr, nullptr);
+    png_infop info = png_create_info_struct(png);
+    pngStruct = png;
+    pngInfo = info;
+    if(setjmp(png_jmpbuf(png))){
+        png_destroy_write_struct(&png, &info);
+        fclose(file);
+        throw png::error("Can't write png header of " + file_name);
+    }
+    png_init_io(png, file);
+    png_set_IHDR(png, info, (png_uint_32) width, (png_uint_32) height, 8, PNG_COLOR_TYPE_RGB, PNG_INTERLACE_NONE, PNG_COMPRESSION_TYPE_DEFAULT, PNG_FILTER_TYPE_DEFAULT);
+    png_write_info(png, info);
+}
+PngStreamWriter::~PngStreamWriter(){
+    png_structp png = static_cast<png_structp>(pngStruct);
+    png_infop info = static_cast<png_infop>(pngInfo);
+    if(!setjmp(png_jmpbuf(png)) && nextRow == height)
+        png_write_end(png, info);
+    png_destroy_write_struct(&png, &info);
+    fclose(file);
+}
+
+void PngStreamWriter::writeRow(const png::rgb_pixel *row){
+    static_assert(sizeof(png::rgb_pixel) == 3, "rows are written as packed rgb bytes");
+    png_structp png = static_cast<png_structp>(pngStruct);
+    if(setjmp(png_jmpbuf(png)))
+        throw png::error("Can't write png row");
+    png_write_row(png, reinterpret_cast<png_const_bytep>(row));
+    nextRow++;
+}
+void PngStreamWriter::flush(){
+    png_structp png = static_cast<png_structp>(pngStruct);
+    if(setjmp(png_jmpbuf(png)))
+        throw png::error("Can't flush png rows");
+    png_write_flush(png);
+    fflush(file);
+}
+
+namespace{
+    // a block is about this many bytes of filtered rows
+    constexpr size_t blockBytes = 1 << 18;
+
+    struct CompressedBlock{
+        std::vector<png::byte> data;
+        uLong adler;
+        size_t length;
+    };
+
+    void putUint32(std::vector<png::byte> &out, uint32_t value){
+        out.push_back(png::byte(value >> 24));
+        out.push_back(png::byte(value >> 16));
+        out.push_back(png::byte(value >> 8));
+        out.push_back(png::byte(value));
+    }
+    void writeChunk(FILE *file, const char *type, const png::byte *data, size_t size){
+        std::vector<png::byte> header;
+        putUint32(header, (uint32_t) size);
+        header.insert(header.end(), type, type + 4);
+        uLong crc = crc32(0, reinterpret_cast<const Bytef *>(type), 4);
+        if(size > 0)
+            crc = crc32(crc, data, (uInt) size);
+        std::vector<png::byte> footer;
+        putUint32(footer, (uint32_t) crc);
+        if(fwrite(header.data(), 1, header.size(), file) != header.size() || (size > 0 && fwrite(data, 1, size, file) != size)
+            || fwrite(footer.data(), 1, footer.size(), file) != footer.size())
+            throw png::error("Can't write png chunk");
+    }
+
+    png::byte paeth(int a, int b, int c){
+        int p = a + b - c;
+        int pa = std::abs(p - a), pb = std::abs(p - b), pc = std::abs(p - c);
+        if(pa <= pb && pa <= pc)
+            return png::byte(a);
+        return png::byte(pb <= pc ? b : c);
+    }
+    // filters the row with the filter with the smallest sum of absolute values, as libpng does
+    void filterRow(const png::byte *row, const png::byte *prev, size_t size, png::byte *out, std::vector<png::byte> &candidate){
+        constexpr size_t bpp = 3;
+        unsigned long bestSum = ~0UL;
+        for(int type = 0; type < 5; type++){
+            candidate[0] = png::byte(type);
+            unsigned long sum = 0;
+            for(size_t k = 0; k < size; k++){
+                int a = k >= bpp ? row[k - bpp] : 0;
+                int b = prev ? prev[k] : 0;
+                int c = prev && k >= bpp ? prev[k - bpp] : 0;
+                int predictor = 0;
+                switch(type){
+                    case 1: predictor = a; break;
+                    case 2: predictor = b; break;
+                    case 3: predictor = (a + b) / 2; break;
+                    case 4: predictor = paeth(a, b, c); break;
+                }
+                png::byte value = png::byte(row[k] - predictor);
+                candidate[k + 1] = value;
+                sum += value < 128 ? value : 256 - value;
+            }
+            if(sum < bestSum){
+                bestSum = sum;
+                std::copy(candidate.begin(), candidate.begin() + size + 1, out);
+            }
+        }
+    }
+
+    CompressedBlock compressBlock(int width, int firstRow, int lastRow, int height, const std::function<void(int, png::rgb_pixel *)> &getRow, int compressionLevel){
+        const size_t rowBytes = size_t(width) * 3;
+        std::vector<png::rgb_pixel> prev(width), cur(width);
+        std::vector<png::byte> filtered((rowBytes + 1) * (lastRow - firstRow)), candidate(rowBytes + 1);
+        if(firstRow > 0)
+            getRow(firstRow - 1, prev.data());
+        for(int i = firstRow; i < lastRow; i++){
+            getRow(i, cur.data());
+            filterRow(reinterpret_cast<const png::byte *>(cur.data()), i > 0 ? reinterpret_cast<const png::byte *>(prev.data()) : nullptr,
+                rowBytes, &filtered[(rowBytes + 1) * (i - firstRow)], candidate);
+            std::swap(prev, cur);
+        }
+
+        CompressedBlock block;
+        block.length = filtered.size();
+        block.adler = adler32(adler32(0, nullptr, 0), filtered.data(), (uInt) filtered.size());
+        z_stream stream{};
+        if(deflateInit2(&stream, compressionLevel, Z_DEFLATED, -15, 8, Z_DEFAULT_STRATEGY) != Z_OK)
+            throw png::error("Can't initialize zlib");
+        block.data.resize(deflateBound(&stream, (uLong) filtered.size()) + 16);
+        stream.next_in = filtered.data();
+        stream.avail_in = (uInt) filtered.size();
+        stream.next_out = block.data.data();
+        stream.avail_out = (uInt) block.data.size();
+        // the last block ends the deflate stream, the others end at a byte boundary so they can be concatenated
+        int status = deflate(&stream, lastRow == height ? Z_FINISH : Z_SYNC_FLUSH);
+        block.data.resize(block.data.size() - stream.avail_out);
+        deflateEnd(&stream);
+        if(status != Z_OK && status != Z_STREAM_END)
+            throw png::error("Can't compress png rows");
+        return block;
+    }
+}
+
+void writePngParallel(const std::string &file_name, int width, int height, const std::function<void(int, png::rgb_pixel *)> &getRow, int compressionLevel){
+    static_assert(sizeof(png::rgb_pixel) == 3, "rows are written as packed rgb bytes");
+    compressionLevel = std::clamp(compressionLevel, 0, 9);
+    checkSize(file_name, width, height);
+    FILE *file = fopen(file_name.c_str(), "wb");
+    if(!file)
+        throw png::error("Invalid name for output file " + file_name);
+    std::unique_ptr<FILE, int (*)(FILE *)> closer(file, fclose);
+
+    const png::byte signature[8] = {137, 80, 78, 71, 13, 10, 26, 10};
+    if(fwrite(signature, 1, 8, file) != 8)
+        throw png::error("Can't write png signature");
+    std::vector<png::byte> header;
+    putUint32(header, (uint32_t) width);
+    putUint32(header, (uint32_t) height);
+    header.insert(header.end(), {8, PNG_COLOR_TYPE_RGB, 0, 0, 0});
+    writeChunk(file, "IHDR", header.data(), header.size());
+
+    const int rowsPerBlock = std::max<int>(1, int(blockBytes / (size_t(width) * 3 + 1)));
+    ThreadPool &pool = ThreadPool::shared();
+    std::deque<std::future<CompressedBlock>> pending;
+    // zlib header with the flags of the compression level
+    const png::byte levelFlags[4] = {0x01, 0x5e, 0x9c, 0xda};
+    std::vector<png::byte> zlibHeader = {0x78, levelFlags[compressionLevel < 2 ? 0 : compressionLevel < 6 ? 1 : compressionLevel == 6 ? 2 : 3]};
+    writeChunk(file, "IDAT", zlibHeader.data(), zlibHeader.size());
+    uLong adler = adler32(0, nullptr, 0);
+    auto writeBlock = [&](){
+        CompressedBlock block = pending.front().get();
+        pending.pop_front();
+        adler = adler32_combine(adler, block.adler, (z_off_t) block.length);
+        if(!block.data.empty())
+            writeChunk(file, "IDAT", block.data.data(), block.data.size());
+    };
+    try{
+        for(int firstRow = 0; firstRow < height; firstRow += rowsPerBlock){
+            int lastRow = std::min(height, firstRow + rowsPerBlock);
+            pending.push_back(pool.submit([=, &getRow]{ return compressBlock(width, firstRow, lastRow, height, getRow, compressionLevel); }));
+            if((int) pending.size() >= 2 * pool.size())
+                writeBlock();
+        }
+        while(!pending.empty())
+            writeBlock();
+    } catch(...){
+        // the blocks still running use getRow
+        for(auto &block : pending)
+            block.wait();
+        throw;
+    }
+    std::vector<png::byte> trailer;
+    putUint32(trailer, (uint32_t) adler);
+    writeChunk(file, "IDAT", trailer.data(), trailer.size());
+    writeChunk(file, "IEND", nullptr, 0);
+}
@@ -0,0 +1,79 @@
+/**
+ * @file pngstream.hpp
+ * @author Letícia Freire Carvalho de Sousa
+ * @brief Header file of the png writers
+ * @version 0.1
+ * @date 2026-10-19
+ *
+ * @copyright Copyright (c) 2024
+ *
+ */
+#pragma once
+#include <png++/png.hpp>
+#include <cstdio>
+#include <string>
+#include <functional>
+
+/**
+ * @brief Writes a png image row by row, so the whole image never has to be in memory
+ */
+class PngStreamWriter{
+public:
+    /**
+     * @brief Construct a new Png Stream Writer object and writes the png header, throws png::error if the size is not positive
+     *
+     * @param file_name file name of the png image
+     * @param width width of the image (in pixels)
+     * @param height height of the image (in pixels)
+     */
+    PngStreamWriter(const std::string &file_name, int width, int height);
+
+    /**
+     * @brief Writes the end of the png if every row was written and closes the file
+     */
+    ~PngStreamWriter();
+
+    PngStreamWriter(const PngStreamWriter &) = delete;
+    PngStreamWriter &operator=(const PngStreamWriter &) = delete;
+
+    /**
+     * @brief Writes the next row of the image
+     *
+     * Time Complexity: linear on the width of the image
+     *
+     * @param row width pixels of the row
+     */
+    void writeRow(const png::rgb_pixel *row);
+
+    /**
+     * @brief Flushes the compressed rows written so far to the file
+     */
+    void flush();
+
+    /// number of rows written
+    int rowsWritten() const { return nextRow; }
+private:
+    const int width;
+    const int height;
+    int nextRow = 0;
+    FILE *file = nullptr;
+    void *pngStruct = nullptr;
+    void *pngInfo = nullptr;
+};
+
+/**
+ * @brief Writes a png image filtering and compressing independent blocks of rows in parallel
+ *
+ * Every block is compressed as a separate deflate stream ended by a sync flush and the streams
+ * are concatenated in a single zlib stream (like pigz does), so the file is a regular png image.
+ * Only a few blocks per thread are in memory at the same time. Throws png::error if the size is not positive.
+ *
+ * Time Complexity: O(width &times; height / number of threads)
+ *
+ * @param file_name file name of the png image
+ * @param width width of the image (in pixels)
+ * @param height height of the image (in pixels)
+ * @param getRow copies the row i of the image to the buffer, called concurrently by several threads
+ * @param compressionLevel zlib compression level, from 0 (no compression) to 9 (best compression)
+ */
+void writePngParallel(const std::string &file_name, int width, int height, const std::function<void(int, png::rgb_pixel *)> &getRow, int compressionLevel = 6);
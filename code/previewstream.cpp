@@ -0,0 +1,143 @@
+/**
+ * @file previewstream.cpp
+ * @author Letícia Freire Carvalho de Sousa
+ * @brief Implementation of previewstream.hpp
+ * @version 0.1
+ * @date 2026-10-19
+ *
+ * @copyright Copyright (c) 2024
+ *
+ */
+
+#include "previewstream.hpp"
+#include <tuple>
+#include <iostream>
+#include <cstring>
+#include <cerrno>
+#include <csignal>
+#include <fcntl.h>
+#include <unistd.h>
+#include <pthread.h>
+
+PreviewStream::PreviewStream(const std::string &file_name, int _width, int _height, PreviewFormat _format, int maxFramesPerSecond)
+    :
+    fileName(file_name),
+    width(_width),
+    height(_height),
+    format(_format),
+    minFrameInterval(std::chrono::nanoseconds(1000000000LL / std::max(1, maxFramesPerSecond))),
+    shadow(size_t(_width) * _height * 3, 0),
+    frame(size_t(_width) * _height * 3, 0),
+    dirtyTop(0), dirtyLeft(0), dirtyBottom(_height), dirtyRight(_width)
+    {
+    worker = std::thread(&PreviewStream::run, this);
+}
+PreviewStream::~PreviewStream(){
+    {
+        std::lock_guard<std::mutex> lock(mtx);
+        stopping = true;
+    }
+    cv.notify_one();
+    worker.join();
+    if(fd >= 0)
+        close(fd);
+}
+
+void PreviewStream::markDirty(int top, int left, int bottom, int right){
+    if(!dirty){
+        dirty = true;
+        std::tie(dirtyTop, dirtyLeft, dirtyBottom, dirtyRight) = std::make_tuple(top, left, bottom, right);
+    } else{
+        dirtyTop = std::min(dirtyTop, top);
+        dirtyLeft = std::min(dirtyLeft, left);
+        dirtyBottom = std::max(dirtyBottom, bottom);
+        dirtyRight = std::max(dirtyRight, right);
+    }
+}
+
+void PreviewStream::run(){
+    // a reader closing the pipe must not kill the process, write will fail with EPIPE instead
+    sigset_t blocked;
+    sigemptyset(&blocked);
+    sigaddset(&blocked, SIGPIPE);
+    pthread_sigmask(SIG_BLOCK, &blocked, nullptr);
+
+    if(!openOutput()){
+        std::cerr<<"Invalid name for preview file"<<std::endl;
+        failed = true;
+    }
+    auto nextFrame = std::chrono::steady_clock::now();
+    std::unique_lock<std::mutex> lock(mtx);
+    while(true){
+        cv.wait(lock, [this]{ return dirty || stopping; });
+        if(!stopping){
+            // frame rate cap, publishes arriving meanwhile are coalesced
+            cv.wait_until(lock, nextFrame, [this]{ return stopping; });
+        }
+        if(dirty){
+            int top = dirtyTop, left = dirtyLeft, bottom = dirtyBottom, right = dirtyRight;
+            dirty = false;
+            for(int i = top; i < bottom; i++){
+                size_t start = (size_t(i) * width + left) * 3;
+                std::memcpy(&frame[start], &shadow[start], size_t(right - left) * 3);
+            }
+            lock.unlock();
+            if(!failed)
+                writeFrame(top, bottom);
+            nextFrame = std::chrono::steady_clock::now() + minFrameInterval;
+            lock.lock();
+        }
+        if(stopping && !dirty)
+            break;
+    }
+}
+
+bool PreviewStream::openOutput(){
+    if(format == PreviewFormat::raw){
+        fd = open(fileName.c_str(), O_RDWR | O_CREAT, 0644);
+        if(fd < 0)
+            return false;
+        return ftruncate(fd, (off_t) frame.size()) == 0;
+    }
+    // a named pipe without a reader can't be opened yet, waits for one unless the stream is stopping
+    while((fd = open(fileName.c_str(), O_WRONLY | O_CREAT | O_TRUNC | O_NONBLOCK, 0644)) < 0){
+        if(errno != ENXIO)
+            return false;
+        std::unique_lock<std::mutex> lock(mtx);
+        if(cv.wait_for(lock, std::chrono::milliseconds(100), [this]{ return stopping; }))
+            return false;
+    }
+    return fcntl(fd, F_SETFL, fcntl(fd, F_GETFL) & ~O_NONBLOCK) == 0;
+}
+
+void PreviewStream::writeFrame(int top, int bottom){
+    bool ok;
+    if(format == PreviewFormat::raw){
+        // only the dirty rows are rewritten, readers may mmap the file
+        size_t start = size_t(top) * width * 3;
+        ok = writeAll(&frame[start], size_t(bottom - top) * width * 3, (long long) start);
+    } else{
+        std::string header = "P6\n" + std::to_string(width) + " " + std::to_string(height) + "\n255\n";
+        ok = writeAll((const png::byte *) header.data(), header.size(), -1) && writeAll(frame.data(), frame.size(), -1);
+    }
+    if(!ok){
+        std::cerr<<"Preview stream closed: "<<std::strerror(errno)<<std::endl;
+        failed = true;
+    }
+}
+
+bool PreviewStream::writeAll(const png::byte *data, size_t size, long long offset){
+    while(size > 0){
+        ssize_t written = offset >= 0 ? pwrite(fd, data, size, (off_t) offset) : write(fd, data, size);
+        if(written < 0){
+            if(errno == EINTR)
+                continue;
+            return false;
+        }
+        data += written;
+        size -= (size_t) written;
+        if(offset >= 0)
+            offset += written;
+    }
+    return true;
+}
@@ -0,0 +1,121 @@
+/**
+ * @file previewstream.hpp
+ * @author Letícia Freire Carvalho de Sousa
+ * @brief Header file of the live preview stream
+ * @version 0.1
+ * @date 2026-10-19
+ *
+ * @copyright Copyright (c) 2024
+ *
+ */
+#pragma once
+#include <png++/png.hpp>
+#include <string>
+#include <algorithm>
+#include <vector>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <chrono>
+
+/**
+ * @brief Streams preview frames of a texture being synthesized from a background thread
+ *
+ * The synthesis thread only publishes the rectangles it changed (dirty rectangles), which
+ * are copied to a shadow framebuffer. A background thread coalesces the dirty rectangles
+ * and writes at most maxFramesPerSecond frames per second, so the synthesis never waits
+ * for the preview I/O.
+ */
+class PreviewStream{
+public:
+    /// Enum of the formats of the preview output
+    enum PreviewFormat{
+        ppm, /// a stream of binary PPM frames, can be a named pipe (e.g. read by ffplay)
+        raw /// a raw framebuffer file (width &times; height &times; 3 bytes) updated in place, only the dirty rows are rewritten
+    };
+
+    /**
+     * @brief Construct a new Preview Stream object and starts the background thread
+     *
+     * The file is opened by the background thread, so opening a named pipe with no reader does not block the caller
+     *
+     * @param file_name file name (or named pipe) where the frames will be written
+     * @param width width of the frames (in pixels)
+     * @param height height of the frames (in pixels)
+     * @param format format of the frames
+     * @param maxFramesPerSecond maximum number of frames written per second
+     */
+    PreviewStream(const std::string &file_name, int width, int height, PreviewFormat format = PreviewFormat::ppm, int maxFramesPerSecond = 10);
+
+    /**
+     * @brief Writes the last pending frame and stops the background thread
+     */
+    ~PreviewStream();
+
+    PreviewStream(const PreviewStream &) = delete;
+    PreviewStream &operator=(const PreviewStream &) = delete;
+
+    /**
+     * @brief Publishes the pixels of a rectangle of the image
+     *
+     * Time Complexity: linear on the area of the rectangle, never waits for the I/O
+     *
+     * @param top first row of the rectangle
+     * @param left first column of the rectangle
+     * @param bottom one past the last row of the rectangle
+     * @param right one past the last column of the rectangle
+     * @param img image from which the pixels will be copied, any grid of png::rgb_pixel indexed as img[i][j]
+     */
+    template<typename Image>
+    void publish(int top, int left, int bottom, int right, const Image &img);
+private:
+    const std::string fileName;
+    const int width;
+    const int height;
+    const PreviewFormat format;
+    const std::chrono::nanoseconds minFrameInterval;
+
+    // pixels published by the synthesis thread (guarded by mtx)
+    std::vector<png::byte> shadow;
+    // pixels owned by the background thread
+    std::vector<png::byte> frame;
+    // coalesced dirty rectangle (guarded by mtx)
+    int dirtyTop, dirtyLeft, dirtyBottom, dirtyRight;
+    bool dirty = false;
+    bool stopping = false;
+    std::mutex mtx;
+    std::condition_variable cv;
+    int fd = -1;
+    bool failed = false;
+    std::thread worker;
+
+    void markDirty(int top, int left, int bottom, int right);
+    void run();
+    bool openOutput();
+    void writeFrame(int top, int bottom);
+    bool writeAll(const png::byte *data, size_t size, long long offset);
+};
+
+template<typename Image>
+void PreviewStream::publish(int top, int left, int bottom, int right, const Image &img){
+    top = std::max(top, 0);
+    left = std::max(left, 0);
+    bottom = std::min(bottom, height);
+    right = std::min(right, width);
+    if(top >= bottom || left >= right)
+        return;
+    {
+        std::lock_guard<std::mutex> lock(mtx);
+        for(int i = top; i < bottom; i++){
+            png::byte *row = &shadow[(size_t(i) * width + left) * 3];
+            for(int j = left; j < right; j++, row += 3){
+                const png::rgb_pixel &pixel = img[i][j];
+                row[0] = pixel.red;
+                row[1] = pixel.green;
+                row[2] = pixel.blue;
+            }
+        }
+        markDirty(top, left, bottom, right);
+    }
+    cv.notify_one();
+}
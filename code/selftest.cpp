@@ -0,0 +1,461 @@
+/**
+ * @file selftest.cpp
+ * @author Letícia Freire Carvalho de Sousa
+ * @brief Checks of the engine that compute the same texture in two ways and compare the results
+ * @version 0.1
+ * @date 2026-10-19
+ *
+ * @copyright Copyright (c) 2024
+ *
+ * Usage: ./selftest [check]
+ *
+ * Runs every check (or only the one named) from the code folder, the exemplars are read from ../input_images and
+ * the files of the checks are written to /tmp. Prints a line per check and returns 1 if one of them failed.
+ */
+
+#include "imagetexture.hpp"
+#include "deltastepping.hpp"
+#include <iostream>
+#include <fstream>
+#include <iterator>
+#include <functional>
+#include <stdexcept>
+#include <cmath>
+#include <algorithm>
+#include <limits>
+#include <queue>
+#include <random>
+#include <unistd.h>
+
+namespace{
+
+// file of a check in /tmp, unique to this process
+std::string scratchFile(const std::string &name){
+    return "/tmp/selftest." + std::to_string(getpid()) + "." + name;
+}
+
+void expect(bool condition, const std::string &what){
+    if(!condition)
+        throw std::runtime_error(what);
+}
+
+bool sameFiles(const std::string &a, const std::string &b){
+    std::ifstream fileA(a, std::ios::binary), fileB(b, std::ios::binary);
+    const std::string bytesA((std::istreambuf_iterator<char>(fileA)), std::istreambuf_iterator<char>());
+    const std::string bytesB((std::istreambuf_iterator<char>(fileB)), std::istreambuf_iterator<char>());
+    return !bytesA.empty() && bytesA == bytesB;
+}
+
+// a material resumed from a checkpoint renders the same layers and goes on with the same patches
+void resumedMaterialLayers(){
+    MaterialSet material(std::vector<std::string>{"../input_images/areia_input0.png", "../input_images/areia_input1.png"});
+    ImageTexture texture(120, 90);
+    ImageTexture::FittingLimits limits;
+    limits.maxIterations = 8;
+    texture.patchFitting(material, limits);
+    const std::string checkpoint = scratchFile("layers.ckpt");
+    expect(texture.checkpoint(checkpoint) && texture.waitCheckpoint(), "the checkpoint wasn't written");
+
+    std::unique_ptr<ImageTexture> resumed = ImageTexture::resume(checkpoint);
+    expect(texture.layerCount() == material.size(), "the material patches made " + std::to_string(texture.layerCount()) + " layers");
+    expect(resumed->layerCount() == texture.layerCount(), "the resumed texture has " + std::to_string(resumed->layerCount()) + " layers instead of " + std::to_string(texture.layerCount()));
+    for(int round = 0; round < 2; round++){
+        if(round > 0){
+            texture.patchFitting(material, limits);
+            resumed->patchFitting(material, limits);
+        }
+        for(size_t layer = 0; layer < texture.layerCount(); layer++){
+            const std::string original = scratchFile("original.ppm"), copy = scratchFile("resumed.ppm");
+            texture.renderLayer(layer, original);
+            resumed->renderLayer(layer, copy);
+            expect(sameFiles(original, copy), "the layer " + std::to_string(layer) + (round == 0 ? " differs after the resume" : " differs after more patches"));
+            std::remove(original.c_str());
+            std::remove(copy.c_str());
+        }
+    }
+    std::remove(checkpoint.c_str());
+}
+
+// the guide rolls with a texture made tileable, which goes on like a texture given the rolled target
+void guidedTileable(){
+    const png::image<png::rgb_pixel> exemplar = readImage("../input_images/areia_input0.png");
+    const ExemplarLibrary library(std::vector<const png::image<png::rgb_pixel> *>{&exemplar});
+    const int height = 90, width = 120, down = height / 2, right = width / 2;
+    // a ramp, so a guide that doesn't roll with the output asks for other patches
+    png::image<png::rgb_pixel> target(width, height), rolled(width, height);
+    for(int i = 0; i < height; i++)
+        for(int j = 0; j < width; j++){
+            const png::byte level = (png::byte) (255 * j / (width - 1));
+            target[i][j] = png::rgb_pixel(level, level, level);
+            rolled[(i + down) % height][(j + right) % width] = target[i][j];
+        }
+    ImageTexture texture(width, height), expected(width, height);
+    ImageTexture::FittingLimits limits;
+    limits.maxIterations = 30;
+    for(ImageTexture *t : {&texture, &expected}){
+        t->reset(46);
+        t->setGuide(target, 0.7);
+        t->patchFitting(library, limits);
+        t->makeTileable(library);
+    }
+    expected.setGuide(rolled, 0.7);
+    limits.maxIterations = 20;
+    texture.patchFitting(library, limits);
+    expected.patchFitting(library, limits);
+    const std::string output = scratchFile("tileable.ppm"), reference = scratchFile("rolled.ppm");
+    texture.render(output);
+    expected.render(reference);
+    expect(sameFiles(output, reference), "the patches after makeTileable don't follow the rolled guide");
+    std::remove(output.c_str());
+    std::remove(reference.c_str());
+}
+
+// the pixels on both sides of the lines of the cross of makeTileable come from the same patch, also at their ends in
+// the border rows and columns, where the tile wraps
+void tileableCrossEnds(){
+    // every pixel of the exemplar has its own color, so neighbors from the same window have colors a step apart
+    const int exemplarSide = 64, colorStep = 3;
+    png::image<png::rgb_pixel> exemplar(exemplarSide, exemplarSide);
+    for(int i = 0; i < exemplarSide; i++)
+        for(int j = 0; j < exemplarSide; j++)
+            exemplar[i][j] = png::rgb_pixel((png::byte) (colorStep * i), (png::byte) (colorStep * j), 128);
+    const ExemplarLibrary library(std::vector<const png::image<png::rgb_pixel> *>{&exemplar});
+    const int height = 90, width = 120, down = height / 2, right = width / 2;
+    ImageTexture texture(width, height);
+    texture.reset(43);
+    ImageTexture::FittingLimits limits;
+    limits.maxIterations = 40;
+    texture.patchFitting(library, limits);
+    texture.makeTileable(library);
+    const std::string output = scratchFile("cross.png");
+    texture.render(output);
+    const png::image<png::rgb_pixel> tile = readImage(output);
+    std::remove(output.c_str());
+    for(int i = 0; i < height; i++)
+        expect(tile[i][right].green == tile[i][right - 1].green + colorStep && tile[i][right].red == tile[i][right - 1].red,
+            "the vertical line of the cross is still a seam in the row " + std::to_string(i));
+    for(int j = 0; j < width; j++)
+        expect(tile[down][j].red == tile[down - 1][j].red + colorStep && tile[down][j].green == tile[down - 1][j].green,
+            "the horizontal line of the cross is still a seam in the column " + std::to_string(j));
+}
+
+// two intersections that touch diagonally are cut as if each one were alone, neither cut takes pixels of the other
+void diagonalIntersections(){
+    const png::image<png::rgb_pixel> exemplar = readImage("../input_images/areia_input0.png");
+    const png::image<png::rgb_pixel> other = readImage("../input_images/areia_input1.png");
+    const int side = 64, half = side / 2;
+    png::image<png::rgb_pixel> img(side, side), patch(half, half);
+    for(int i = 0; i < side; i++)
+        for(int j = 0; j < side; j++)
+            img[i][j] = exemplar[i % exemplar.get_height()][j % exemplar.get_width()];
+    for(int i = 0; i < half; i++)
+        for(int j = 0; j < half; j++)
+            patch[i][j] = other[i % other.get_height()][j % other.get_width()];
+    // the colored squares, the upper left and the lower right ones, touch at the center, where the patch crosses both
+    auto square = [half](int i, int j){ return i < half && j < half ? 1 : i >= half && j >= half ? 2 : 0; };
+    // the pixels of the patch with both squares, only the upper left one and only the lower right one
+    std::vector<png::image<png::rgb_pixel>> blended;
+    for(int squares : {3, 1, 2}){
+        png::image<png::rgb_pixel> mask(side, side);
+        for(int i = 0; i < side; i++)
+            for(int j = 0; j < side; j++)
+                mask[i][j] = (square(i, j) & squares) ? png::rgb_pixel(0, 0, 0) : png::rgb_pixel(255, 255, 255);
+        ImageTexture texture(side, side);
+        texture.setHole(img, mask);
+        texture.clearHole();
+        texture.blending(half / 2, half / 2, patch);
+        const std::string output = scratchFile("diagonal.png");
+        texture.render(output);
+        blended.push_back(readImage(output));
+        std::remove(output.c_str());
+    }
+    for(int i = 0; i < side; i++)
+        for(int j = 0; j < side; j++){
+            if(square(i, j) == 0)
+                continue;
+            const png::rgb_pixel a = blended[0][i][j], b = blended[square(i, j)][i][j];
+            expect(a.red == b.red && a.green == b.green && a.blue == b.blue, "the pixel (" + std::to_string(i) + ", " + std::to_string(j)
+                + ") differs from the cut of its square alone");
+        }
+}
+
+// a grayscale exemplar that is flat at 8 bits is matched and cut on its 16 bit samples, so its texture has smoother
+// seams than the one of the same exemplar rounded to 8 bits
+void graySamples(){
+    const int exemplarSide = 64;
+    png::image<png::gray_pixel_16> exemplar(exemplarSide, exemplarSide);
+    png::image<png::rgb_pixel> rounded(exemplarSide, exemplarSide);
+    for(int i = 0; i < exemplarSide; i++)
+        for(int j = 0; j < exemplarSide; j++){
+            // waves of 60 steps of a 16 bit channel around 32704, all of them round to the 8 bit level 127
+            exemplar[i][j] = png::gray_pixel_16((uint16_t) std::lround(32704 + 30 * std::sin(0.3 * i) + 30 * std::sin(0.23 * j + 1)));
+            rounded[i][j] = png::rgb_pixel(127, 127, 127);
+        }
+    const ExemplarLibrary sampled(std::vector<const png::image<png::gray_pixel_16> *>{&exemplar});
+    const ExemplarLibrary flat(std::vector<const png::image<png::rgb_pixel> *>{&rounded});
+    expect(sampled.hasSamples() && !flat.hasSamples(), "only the grayscale library has samples");
+    const int height = 90, width = 120;
+    // mean squared difference of the 16 bit neighbors of the texture rendered from the grayscale exemplar
+    auto seamEnergy = [&](const ExemplarLibrary &library){
+        ImageTexture texture(width, height);
+        texture.reset(41);
+        ImageTexture::FittingLimits limits;
+        limits.maxIterations = 40;
+        texture.patchFitting(library, limits);
+        const std::string output = scratchFile("gray.png");
+        texture.renderSources(output, library, std::vector<const png::image<png::gray_pixel_16> *>{&exemplar});
+        const png::image<png::gray_pixel_16> tile(output);
+        std::remove(output.c_str());
+        double sum = 0;
+        for(int i = 0; i + 1 < height; i++)
+            for(int j = 0; j + 1 < width; j++){
+                const double right = (double) tile[i][j + 1] - tile[i][j], down = (double) tile[i + 1][j] - tile[i][j];
+                sum += right * right + down * down;
+            }
+        return sum / (2.0 * (height - 1) * (width - 1));
+    };
+    const double withSamples = seamEnergy(sampled), without = seamEnergy(flat);
+    expect(withSamples < 0.75 * without, "the neighbors differ by " + std::to_string(withSamples) + " squared steps with the samples and by "
+        + std::to_string(without) + " without them");
+}
+
+// deltaStepping finds the distances of the sequential Dijkstra on random dual grids with edges out of the intersection,
+// for the closest target and the vertices not farther than it, and its parents are shortest paths
+void deltaSteppingDistances(){
+    // cost of the edges out of an intersection, ImageTexture::inftyCost
+    const long double outsideCost = 10000000;
+    static constexpr int directions[4][2] = {{-1, 0}, {0, -1}, {1, 0}, {0, 1}};
+    // the sums of the costs may round differently along paths of the same length
+    auto same = [](long double a, long double b){ return std::abs(a - b) <= 1e-12L * std::max<long double>(1, std::max(a, b)); };
+    std::mt19937_64 rng(48);
+    ThreadPool single(1), pool(4);
+    for(int round = 0; round < 24; round++){
+        const int height = std::uniform_int_distribution<int>(2, 90)(rng), width = std::uniform_int_distribution<int>(2, 90)(rng), n = height * width;
+        // a few rounds are mostly out of the intersection, or have costs in ties
+        const int outsidePercent = round % 6 == 5 ? 60 : 5;
+        const bool ties = round % 4 == 3;
+        FlatGraph graph;
+        graph.next.assign(n, {-1, -1, -1, -1});
+        graph.cost.assign(n, {0, 0, 0, 0});
+        for(int i = 0; i < height; i++)
+            for(int j = 0; j < width; j++)
+                for(int d = 0; d < 4; d++){
+                    const int a = i + directions[d][0], b = j + directions[d][1];
+                    if(a < 0 || b < 0 || a >= height || b >= width)
+                        continue;
+                    graph.next[i * width + j][d] = a * width + b;
+                    graph.cost[i * width + j][d] = std::uniform_int_distribution<int>(0, 99)(rng) < outsidePercent ? outsideCost
+                        : ties ? (long double) std::uniform_int_distribution<int>(0, 3)(rng) : (long double) std::uniform_real_distribution<double>(0, 200)(rng);
+                }
+        std::vector<int> sources, targets;
+        std::vector<char> isTarget(n, 0);
+        for(int v = 0; v < n; v++){
+            const int kind = std::uniform_int_distribution<int>(0, 40)(rng);
+            if(kind == 0)
+                sources.push_back(v);
+            else if(kind == 1 && !isTarget[v]){
+                targets.push_back(v);
+                isTarget[v] = 1;
+            }
+        }
+        if(sources.empty())
+            sources.push_back(0);
+        if(targets.empty() || (targets.size() == 1 && targets[0] == sources[0])){
+            targets.push_back(n - 1);
+            isTarget[n - 1] = 1;
+        }
+        // Dijkstra with a binary heap over the whole graph
+        std::vector<long double> dist(n, std::numeric_limits<long double>::infinity());
+        std::priority_queue<std::pair<long double, int>, std::vector<std::pair<long double, int>>, std::greater<>> queue;
+        for(int v : sources){
+            dist[v] = 0;
+            queue.push({0, v});
+        }
+        while(!queue.empty()){
+            const auto [d, v] = queue.top();
+            queue.pop();
+            if(d > dist[v])
+                continue;
+            for(int k = 0; k < 4; k++){
+                const int w = graph.next[v][k];
+                if(w >= 0 && d + graph.cost[v][k] < dist[w]){
+                    dist[w] = d + graph.cost[v][k];
+                    queue.push({dist[w], w});
+                }
+            }
+        }
+        long double closest = std::numeric_limits<long double>::infinity();
+        for(int t : targets)
+            closest = std::min(closest, dist[t]);
+        long double finiteCost = 0;
+        size_t finiteEdges = 0;
+        for(int v = 0; v < n; v++)
+            for(int k = 0; k < 4; k++)
+                if(graph.next[v][k] >= 0 && graph.cost[v][k] < outsideCost){
+                    finiteCost += graph.cost[v][k];
+                    finiteEdges++;
+                }
+        // the width of the buckets of ImageTexture::parallelSTPath, and narrower and wider ones
+        const long double mean = finiteEdges == 0 || finiteCost <= 0 ? 1 : finiteCost / (long double) finiteEdges;
+        for(long double delta : {mean, mean / 16, mean * 64})
+            for(ThreadPool *threads : {&single, &pool}){
+                const ShortestPaths paths = deltaStepping(graph, sources, targets, delta, *threads);
+                const std::string where = " in the round " + std::to_string(round) + " (" + std::to_string(height) + "x" + std::to_string(width)
+                    + ", delta " + std::to_string((double) delta) + ", " + std::to_string(threads->size()) + " threads)";
+                long double found = std::numeric_limits<long double>::infinity();
+                int best = -1;
+                for(int t : targets)
+                    if(paths.dist[t] < found){
+                        found = paths.dist[t];
+                        best = t;
+                    }
+                expect(same(found, closest), "the closest target is at " + std::to_string((double) found) + " instead of " + std::to_string((double) closest) + where);
+                for(int v = 0; v < n; v++)
+                    if(dist[v] <= closest)
+                        expect(same(paths.dist[v], dist[v]), "the vertex " + std::to_string(v) + " is at " + std::to_string((double) paths.dist[v])
+                            + " instead of " + std::to_string((double) dist[v]) + where);
+                // the parents lead back from the closest target to a source with the cost of its distance
+                long double length = 0;
+                for(int v = best; paths.parent[v] >= 0; v = paths.parent[v]){
+                    const int u = paths.parent[v];
+                    int k = 0;
+                    while(k < 4 && graph.next[u][k] != v)
+                        k++;
+                    expect(k < 4, "the parent of " + std::to_string(v) + " isn't a neighbor" + where);
+                    length += graph.cost[u][k];
+                }
+                expect(same(length, found), "the parents of the closest target make a path of "
+                    + std::to_string((double) length) + where);
+            }
+    }
+}
+
+} // namespace
+
+// the bidirectional search of the small cuts finds paths of the cost of the S-T Dijkstra of findSTPath, on random
+// intersections with edges out of them, elongated strips and costs in ties
+struct CutSearchCheck{
+    using Path = std::vector<std::pair<int, int>>;
+
+    // cost of a path from T to S along the parents of the scratch, checking that it follows the edges of the intersection
+    static long double pathCost(ImageTexture::CutScratch &scratch, const Path &path, std::pair<int, int> S, std::pair<int, int> T, const std::string &where){
+        expect(!path.empty() && path.front() == T && path.back() == S, "the path doesn't go from T to S" + where);
+        long double cost = 0;
+        for(size_t k = 0; k + 1 < path.size(); k++){
+            auto [i, j] = path[k];
+            const int d = scratch.parent[i][j];
+            expect(d >= 0 && d < 4, "a vertex of the path has no parent" + where);
+            const auto [nextI, nextJ] = path[k + 1];
+            expect(nextI == i + ImageTexture::directions[d].first && nextJ == j + ImageTexture::directions[d].second && scratch.inSubgraph[nextI][nextJ],
+                "the path leaves the edges of the intersection" + where);
+            cost += scratch.edgesCosts[nextI][nextJ][ImageTexture::revDir(d)];
+        }
+        return cost;
+    }
+
+    static void run(){
+        const int height = 40, width = 100;
+        ImageTexture texture(width, height);
+        std::mt19937_64 rng(49);
+        auto uniform = [&rng](int low, int high){ return std::uniform_int_distribution<int>(low, high)(rng); };
+        for(int round = 0; round < 60; round++){
+            // a rectangle, a strip of one to three vertices across, or a union of random rectangles
+            const int shape = round % 3;
+            std::vector<std::vector<char>> inside(height + 1, std::vector<char>(width + 1, 0));
+            auto fill = [&inside](int top, int left, int bottom, int right){
+                for(int i = top; i <= bottom; i++)
+                    for(int j = left; j <= right; j++)
+                        inside[i][j] = 1;
+            };
+            if(shape == 0)
+                fill(uniform(0, height / 2), uniform(0, width / 2), uniform(height / 2, height), uniform(width / 2, width));
+            else if(shape == 1){
+                const int across = uniform(0, 2);
+                if(round % 2 == 0){
+                    const int top = uniform(0, height - across);
+                    fill(top, 0, top + across, width);
+                } else{
+                    const int left = uniform(0, width - across);
+                    fill(0, left, height, left + across);
+                }
+            } else
+                for(int k = uniform(2, 8); k > 0; k--){
+                    const int top = uniform(0, height), left = uniform(0, width);
+                    fill(top, left, std::min(height, top + uniform(0, 12)), std::min(width, left + uniform(0, 30)));
+                }
+            // S is a random vertex of the shape and T one of the vertices connected to it, far from it in the strips
+            Path shapeVertices;
+            for(int i = 0; i <= height; i++)
+                for(int j = 0; j <= width; j++)
+                    if(inside[i][j])
+                        shapeVertices.emplace_back(i, j);
+            const std::pair<int, int> S = shapeVertices[(size_t) uniform(0, (int) shapeVertices.size() - 1)];
+            Path inDual = {S};
+            std::vector<std::vector<char>> reached(height + 1, std::vector<char>(width + 1, 0));
+            reached[S.first][S.second] = 1;
+            for(size_t front = 0; front < inDual.size(); front++)
+                for(auto [di, dj] : ImageTexture::directions){
+                    const int i = inDual[front].first + di, j = inDual[front].second + dj;
+                    if(i >= 0 && j >= 0 && i <= height && j <= width && inside[i][j] && !reached[i][j]){
+                        reached[i][j] = 1;
+                        inDual.emplace_back(i, j);
+                    }
+                }
+            if(inDual.size() < 2)
+                continue;
+            const std::pair<int, int> T = shape == 1 ? inDual.back() : inDual[(size_t) uniform(1, (int) inDual.size() - 1)];
+            std::sort(inDual.begin(), inDual.end());
+            // the costs of an edge both ways, real, in ties or all equal, and a few edges out of the intersection
+            const int costs = round % 4;
+            std::vector<std::vector<std::array<long double, 4>>> edgeCosts(height + 1, std::vector<std::array<long double, 4>>(width + 1));
+            for(auto [i, j] : inDual)
+                for(int d : {2, 3}){
+                    const int nextI = i + ImageTexture::directions[d].first, nextJ = j + ImageTexture::directions[d].second;
+                    if(nextI > height || nextJ > width)
+                        continue;
+                    const long double cost = uniform(0, 19) == 0 ? ImageTexture::inftyCost : costs == 0 ? (long double) std::uniform_real_distribution<double>(0, 200)(rng)
+                        : costs == 1 ? (long double) uniform(0, 2) : costs == 2 ? 1 : (long double) uniform(0, 1) * 50;
+                    edgeCosts[i][j][d] = edgeCosts[nextI][nextJ][ImageTexture::revDir(d)] = cost;
+                }
+            std::array<long double, 2> found;
+            for(int search = 0; search < 2; search++){
+                ImageTexture::CutScratch scratch(height, width);
+                for(auto [i, j] : inDual){
+                    scratch.inSubgraph[i][j] = true;
+                    scratch.edgesCosts[i][j] = edgeCosts[i][j];
+                }
+                const Path path = search == 0 ? texture.findSTPath(scratch, {S}, {T}, inDual) : texture.findSTPathBidirectional(scratch, S, T);
+                found[search] = pathCost(scratch, path, S, T, std::string(search == 0 ? " of findSTPath" : " of the bidirectional search")
+                    + " in the round " + std::to_string(round));
+            }
+            expect(std::abs(found[0] - found[1]) <= 1e-12L * std::max<long double>(1, found[0]), "the bidirectional search found a path of "
+                + std::to_string((double) found[1]) + " instead of " + std::to_string((double) found[0]) + " in the round " + std::to_string(round)
+                + " (" + std::to_string(inDual.size()) + " vertices)");
+        }
+    }
+};
+
+int main(int argc, char *argv[]){
+    const std::vector<std::pair<std::string, std::function<void()>>> checks = {
+        {"resumedMaterialLayers", resumedMaterialLayers},
+        {"guidedTileable", guidedTileable},
+        {"tileableCrossEnds", tileableCrossEnds},
+        {"diagonalIntersections", diagonalIntersections},
+        {"graySamples", graySamples},
+        {"deltaSteppingDistances", deltaSteppingDistances},
+        {"bidirectionalCuts", CutSearchCheck::run},
+    };
+    int failed = 0;
+    for(const auto &[name, check] : checks){
+        if(argc > 1 && name != argv[1])
+            continue;
+        try{
+            check();
+            std::cout<<"ok "<<name<<std::endl;
+        } catch(const std::exception &e){
+            std::cout<<"FAILED "<<name<<": "<<e.what()<<std::endl;
+            failed++;
+        }
+    }
+    return failed > 0 ? 1 : 0;
+}
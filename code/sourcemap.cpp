@@ -0,0 +1,215 @@
+/**
+ * @file sourcemap.cpp
+ * @author Letícia Freire Carvalho de Sousa
+ * @brief Implementation of sourcemap.hpp
+ * @version 0.1
+ * @date 2026-10-19
+ *
+ * @copyright Copyright (c) 2024
+ *
+ */
+
+#include "sourcemap.hpp"
+#include <stdexcept>
+#include <memory>
+#include <cstdio>
+#include <cstring>
+#include <zlib.h>
+
+namespace{
+
+constexpr char sourceMapMagic[8] = {'G', 'C', 'T', 'S', 'R', 'C', '0', '2'};
+
+struct SourceMapHeader{
+    char magic[8];
+    uint32_t width;
+    uint32_t height;
+    uint64_t runs;
+    uint64_t encodedBytes; /// bytes of the runs before they are deflated
+};
+
+// a run has at most four varints of 32 bits
+constexpr uint64_t maxRunBytes = 20;
+// deflate expands its input at most about 1032 times
+constexpr uint64_t maxDeflateRatio = 1032;
+
+using FilePtr = std::unique_ptr<FILE, int (*)(FILE *)>;
+
+// the pixel after source in its run
+bool continues(const SourcePixel &source, const SourcePixel &next){
+    if(source.exemplar == unknownExemplar)
+        return next.exemplar == unknownExemplar;
+    return next.exemplar == source.exemplar && next.row == source.row && next.col == source.col + 1;
+}
+
+// the source of a pixel guessed from the pixel above it, the next row of the same patch
+SourcePixel predicted(const SourcePixel &above){
+    if(above.exemplar == unknownExemplar)
+        return {unknownExemplar, 0, 0};
+    return {above.exemplar, (uint16_t) (above.row + 1), above.col};
+}
+
+bool operator==(const SourcePixel &a, const SourcePixel &b){
+    return a.exemplar == b.exemplar && a.row == b.row && a.col == b.col;
+}
+
+void putVarint(std::vector<unsigned char> &bytes, uint32_t value){
+    while(value >= 0x80){
+        bytes.push_back((unsigned char) (value | 0x80));
+        value >>= 7;
+    }
+    bytes.push_back((unsigned char) value);
+}
+
+// differences of rows and columns, small in magnitude, as small unsigned numbers
+uint32_t zigzag(int32_t value){
+    return ((uint32_t) value << 1) ^ (uint32_t) (value >> 31);
+}
+int32_t unzigzag(uint32_t value){
+    return (int32_t) (value >> 1) ^ -(int32_t) (value & 1);
+}
+
+/**
+ * Reads the encoded runs, throws std::runtime_error past their end or on a varint longer than 32 bits
+ */
+class RunDecoder{
+public:
+    RunDecoder(const std::vector<unsigned char> &_bytes, const std::string &_file_name) : bytes(_bytes), file_name(_file_name) {}
+
+    uint32_t varint(){
+        uint32_t value = 0;
+        for(int shift = 0; shift < 35; shift += 7){
+            if(next == bytes.size())
+                throw std::runtime_error("Invalid source map file " + file_name);
+            const unsigned char byte = bytes[next++];
+            value |= (uint32_t) (byte & 0x7f) << shift;
+            if(byte < 0x80)
+                return value;
+        }
+        throw std::runtime_error("Invalid source map file " + file_name);
+    }
+
+    bool done() const { return next == bytes.size(); }
+
+private:
+    const std::vector<unsigned char> &bytes;
+    const std::string &file_name;
+    size_t next = 0;
+};
+
+} // namespace
+
+size_t writeSourceMap(const std::string &file_name, int width, int height, const SourceRowReader &getRow){
+    SourceMapHeader header{};
+    std::memcpy(header.magic, sourceMapMagic, sizeof(sourceMapMagic));
+    header.width = (uint32_t) width;
+    header.height = (uint32_t) height;
+    // a run is its length and whether its first source is the one below the source above it, then the source
+    // when it isn't, as the exemplar (zero when unknown) and the differences to the last source written
+    std::vector<unsigned char> encoded;
+    std::vector<SourcePixel> row(width), above(width, SourcePixel{unknownExemplar, 0, 0});
+    SourcePixel last{0, 0, 0};
+    for(int i = 0; i < height; i++){
+        getRow(i, row.data());
+        for(int j = 0; j < width; ){
+            // the unused bytes of an unknown source are zeroed, so equal maps give equal files
+            const SourcePixel first = row[j].exemplar == unknownExemplar ? SourcePixel{unknownExemplar, 0, 0} : row[j];
+            int length = 1;
+            SourcePixel current = first;
+            while(j + length < width && continues(current, row[j + length])){
+                current = row[j + length];
+                length++;
+            }
+            const bool guessed = i > 0 && first == predicted(above[j]);
+            putVarint(encoded, ((uint32_t) (length - 1) << 1) | (guessed ? 1 : 0));
+            if(!guessed){
+                putVarint(encoded, first.exemplar + 1);
+                if(first.exemplar != unknownExemplar){
+                    putVarint(encoded, zigzag((int32_t) first.row - last.row));
+                    putVarint(encoded, zigzag((int32_t) first.col - last.col));
+                    last = first;
+                }
+            }
+            header.runs++;
+            j += length;
+        }
+        std::swap(row, above);
+    }
+    header.encodedBytes = encoded.size();
+
+    std::vector<unsigned char> compressed(compressBound((uLong) encoded.size()));
+    uLongf compressedBytes = (uLongf) compressed.size();
+    bool ok = compress2(compressed.data(), &compressedBytes, encoded.data(), (uLong) encoded.size(), Z_BEST_COMPRESSION) == Z_OK;
+    const std::string tmp_name = file_name + ".tmp";
+    FilePtr file(fopen(tmp_name.c_str(), "wb"), fclose);
+    if(!file)
+        throw std::runtime_error("Invalid name for source map file " + file_name);
+    ok = ok && fwrite(&header, sizeof(header), 1, file.get()) == 1 && fwrite(compressed.data(), 1, compressedBytes, file.get()) == compressedBytes;
+    ok = fclose(file.release()) == 0 && ok;
+    if(!ok || rename(tmp_name.c_str(), file_name.c_str()) != 0){
+        std::remove(tmp_name.c_str());
+        throw std::runtime_error("Can't write source map file " + file_name);
+    }
+    return header.runs;
+}
+
+SourceMap readSourceMap(const std::string &file_name){
+    FilePtr file(fopen(file_name.c_str(), "rb"), fclose);
+    if(!file)
+        throw std::runtime_error("Invalid name for source map file " + file_name);
+    SourceMapHeader header;
+    if(fread(&header, sizeof(header), 1, file.get()) != 1 || std::memcmp(header.magic, sourceMapMagic, sizeof(sourceMapMagic)) != 0
+        || header.width == 0 || header.height == 0 || header.width > (1u << 30) / header.height)
+        throw std::runtime_error("Invalid source map file " + file_name);
+    const size_t pixels = (size_t) header.width * header.height;
+    if(header.runs < header.height || header.runs > pixels || header.encodedBytes > header.runs * maxRunBytes)
+        throw std::runtime_error("Invalid source map file " + file_name);
+    std::vector<unsigned char> compressed;
+    unsigned char buffer[1 << 16];
+    for(size_t bytes; (bytes = fread(buffer, 1, sizeof(buffer), file.get())) > 0; )
+        compressed.insert(compressed.end(), buffer, buffer + bytes);
+    if(header.encodedBytes > compressed.size() * maxDeflateRatio)
+        throw std::runtime_error("Invalid source map file " + file_name);
+    std::vector<unsigned char> encoded(header.encodedBytes);
+    uLongf encodedBytes = (uLongf) encoded.size();
+    if(uncompress(encoded.data(), &encodedBytes, compressed.data(), (uLong) compressed.size()) != Z_OK || encodedBytes != encoded.size())
+        throw std::runtime_error("Invalid source map file " + file_name);
+
+    SourceMap map;
+    map.width = (int) header.width;
+    map.height = (int) header.height;
+    // not reserved from the header, which could claim a billion pixels in a few bytes
+    RunDecoder decoder(encoded, file_name);
+    SourcePixel last{0, 0, 0};
+    for(uint64_t r = 0; r < header.runs; r++){
+        const uint32_t tag = decoder.varint();
+        const uint32_t length = (tag >> 1) + 1;
+        const size_t j = map.pixels.size() % header.width;
+        // a run never crosses the end of a row, and the first row has nothing to guess from
+        if(map.pixels.size() == pixels || j + length > header.width || ((tag & 1) && map.pixels.size() < header.width))
+            throw std::runtime_error("Invalid source map file " + file_name);
+        SourcePixel first;
+        if(tag & 1)
+            first = predicted(map.pixels[map.pixels.size() - header.width]);
+        else{
+            first = {decoder.varint() - 1, 0, 0};
+            if(first.exemplar != unknownExemplar){
+                const int32_t row = last.row + unzigzag(decoder.varint()), col = last.col + unzigzag(decoder.varint());
+                if(row < 0 || row >= maxExemplarSide || col < 0 || col >= maxExemplarSide)
+                    throw std::runtime_error("Invalid source map file " + file_name);
+                first.row = (uint16_t) row;
+                first.col = (uint16_t) col;
+                last = first;
+            }
+        }
+        for(uint32_t k = 0; k < length; k++){
+            SourcePixel pixel = first;
+            if(pixel.exemplar != unknownExemplar)
+                pixel.col = (uint16_t) (pixel.col + k);
+            map.pixels.push_back(pixel);
+        }
+    }
+    if(map.pixels.size() != pixels || !decoder.done())
+        throw std::runtime_error("Invalid source map file " + file_name);
+    return map;
+}
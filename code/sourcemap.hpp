@@ -0,0 +1,72 @@
+/**
+ * @file sourcemap.hpp
+ * @author Letícia Freire Carvalho de Sousa
+ * @brief Header file of the source map, the exemplar pixel copied to each pixel of a texture, and of its files
+ * @version 0.1
+ * @date 2026-10-19
+ *
+ * @copyright Copyright (c) 2024
+ *
+ */
+#pragma once
+#include <string>
+#include <vector>
+#include <functional>
+#include <cstdint>
+
+/// exemplar of the pixels that don't come from a library (or that are not colored)
+constexpr uint32_t unknownExemplar = 0xffffffff;
+
+/// the rows and columns of the sources have 16 bits, so the exemplars of a library have at most this many of each
+constexpr int maxExemplarSide = 1 << 16;
+
+/**
+ * @brief Pixel of an exemplar of a library copied to a pixel of the output image (8 bytes)
+ */
+struct SourcePixel{
+    uint32_t exemplar; /// index of the exemplar in the library, unknownExemplar if the pixel didn't come from a library
+    uint16_t row; /// row of the pixel in the exemplar
+    uint16_t col; /// column of the pixel in the exemplar
+};
+
+/// copies the sources of the row i of the texture to the buffer
+using SourceRowReader = std::function<void(int, SourcePixel *)>;
+
+/**
+ * @brief Source map read from a file
+ */
+struct SourceMap{
+    int width = 0;
+    int height = 0;
+    std::vector<SourcePixel> pixels; /// row after row
+};
+
+/**
+ * @brief Writes a source map file
+ *
+ * The file has a 32 byte header ("GCTSRC02", width, height, number of runs and their encoded bytes) and the deflated
+ * runs of the rows. A run is a length and the source of its first pixel, the next pixels of the run come from the next
+ * columns of the same exemplar row, so a patch costs a run per row. The runs are varints: the source of a run that
+ * starts below the previous row of its patch is only a flag, the others are the exemplar and the differences of row
+ * and column to the last source written. A patch then costs a few bytes per row before deflate, which mostly removes
+ * the lengths repeated by its rows.
+ *
+ * Time Complexity: linear on the number of pixels
+ *
+ * @param file_name file name of the source map
+ * @param width width of the texture
+ * @param height height of the texture
+ * @param getRow copies the sources of a row
+ * @return size_t number of runs written, throws std::runtime_error if the file can't be written
+ */
+size_t writeSourceMap(const std::string &file_name, int width, int height, const SourceRowReader &getRow);
+
+/**
+ * @brief Reads a source map file written by writeSourceMap
+ *
+ * Time Complexity: linear on the number of pixels
+ *
+ * @param file_name file name of the source map
+ * @return SourceMap the sources of the pixels, throws std::runtime_error on invalid files
+ */
+SourceMap readSourceMap(const std::string &file_name);
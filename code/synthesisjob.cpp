@@ -0,0 +1,308 @@
+/**
+ * @file synthesisjob.cpp
+ * @author Letícia Freire Carvalho de Sousa
+ * @brief Implementation of synthesisjob.hpp
+ * @version 0.1
+ * @date 2026-10-19
+ *
+ * @copyright Copyright (c) 2024
+ *
+ */
+
+#include "synthesisjob.hpp"
+#include "imagecodec.hpp"
+#include <stdexcept>
+#include <sstream>
+#include <random>
+#include <filesystem>
+#include <sys/stat.h>
+
+namespace{
+
+const JsonValue &member(const JsonObject &object, const std::string &name){
+    auto it = object.find(name);
+    if(it == object.end())
+        throw std::runtime_error("missing \"" + name + "\"");
+    return it->second;
+}
+
+int intMember(const JsonObject &object, const std::string &name, int minimum, int fallback, bool required = false){
+    if(!required && !object.count(name))
+        return fallback;
+    double value = member(object, name).asNumber();
+    if(!(value >= minimum && value <= 1e9))
+        throw std::runtime_error("invalid \"" + name + "\"");
+    return (int) value;
+}
+
+const char *stopReasonName(ImageTexture::StopReason reason){
+    switch(reason){
+        case ImageTexture::StopReason::iterationLimit: return "iterations";
+        case ImageTexture::StopReason::deadline: return "deadline";
+        case ImageTexture::StopReason::seamEnergyReached: return "seamEnergy";
+        case ImageTexture::StopReason::converged: return "converged";
+        case ImageTexture::StopReason::cancelled: return "cancelled";
+    }
+    return "";
+}
+
+// runs a video job with a VideoTexture of its own, throws if it fails
+std::string runVideoJob(const SynthesisJob &job, std::chrono::steady_clock::time_point start){
+    std::unique_ptr<FrameSource> input;
+    if(job.inputWidth > 0)
+        input = std::make_unique<RawFrameSource>(job.inputs[0], job.inputWidth, job.inputHeight);
+    else
+        input = std::make_unique<DirectoryFrameSource>(job.inputs[0]);
+    std::error_code error;
+    std::filesystem::create_directories(job.output, error);
+    if(error)
+        throw std::runtime_error("Can't create the directory " + job.output);
+    const uint64_t seed = job.hasSeed ? job.seed : std::random_device()();
+    VideoTexture video(job.videoOptions, seed);
+    const int frames = video.synthesize(*input, VideoTexture::directorySink(job.output, job.frameFormat));
+    std::ostringstream response;
+    response<<"{\"status\":\"ok\",\"output\":"<<jsonQuote(job.output)
+        <<",\"frames\":"<<frames
+        <<",\"blocks\":"<<video.blocks()
+        <<",\"seamEnergy\":"<<(double) video.seamEnergy()
+        <<",\"peakResidentFrames\":"<<video.peakResidentFrames()
+        <<",\"totalSeconds\":"<<std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count()
+        <<",\"seed\":"<<seed<<"}";
+    return response.str();
+}
+
+} // namespace
+
+SynthesisJob parseSynthesisJob(const JsonObject &object){
+    SynthesisJob job;
+    if(object.count("kind")){
+        const std::string &kind = member(object, "kind").asString();
+        if(kind != "image" && kind != "video")
+            throw std::runtime_error("invalid \"kind\"");
+        job.video = kind == "video";
+    }
+    const JsonValue &input = member(object, "input");
+    if(input.type == JsonValue::Type::array){
+        for(const JsonValue &item : input.items)
+            job.inputs.push_back(item.asString());
+        if(job.inputs.empty())
+            throw std::runtime_error("empty \"input\"");
+    } else
+        job.inputs.push_back(input.asString());
+    job.output = member(object, "output").asString();
+    job.width = intMember(object, "width", 1, 0, true);
+    job.height = intMember(object, "height", 1, 0, true);
+    if(object.count("seed")){
+        job.hasSeed = true;
+        // a double would round the seeds over 2^53, so the literal is read as an integer
+        try{
+            job.seed = member(object, "seed").asUnsigned();
+        } catch(const std::runtime_error &){
+            throw std::runtime_error("invalid \"seed\"");
+        }
+    }
+    if(job.video){
+        // the clip is a single directory or stream
+        if(job.inputs.size() != 1)
+            throw std::runtime_error("invalid \"input\"");
+        VideoTexture::Options &options = job.videoOptions;
+        options.width = job.width;
+        options.height = job.height;
+        options.frames = intMember(object, "frames", 1, 0, true);
+        options.blockSize = intMember(object, "blockSize", 2, options.blockSize);
+        options.blockFrames = intMember(object, "blockFrames", 1, options.blockFrames);
+        options.overlap = intMember(object, "overlap", 0, options.overlap);
+        if(options.overlap >= options.blockSize)
+            throw std::runtime_error("\"overlap\" must be smaller than \"blockSize\"");
+        options.temporalOverlap = intMember(object, "temporalOverlap", 0, options.temporalOverlap);
+        options.candidates = intMember(object, "candidates", 1, options.candidates);
+        options.inputWindow = intMember(object, "window", 1, options.inputWindow);
+        if(object.count("format"))
+            job.frameFormat = member(object, "format").asString();
+        if(!hasImageCodec("frame." + job.frameFormat))
+            throw std::runtime_error("invalid \"format\"");
+        job.inputWidth = intMember(object, "inputWidth", 1, 0);
+        job.inputHeight = intMember(object, "inputHeight", 1, 0);
+        if((job.inputWidth == 0) != (job.inputHeight == 0))
+            throw std::runtime_error("\"inputWidth\" and \"inputHeight\" must be given together");
+        return job;
+    }
+    job.iterations = intMember(object, "iterations", 0, job.iterations);
+    job.convergenceWindow = intMember(object, "convergence", 0, job.convergenceWindow);
+    job.compressionLevel = intMember(object, "compression", 0, job.compressionLevel);
+    job.candidates = intMember(object, "candidates", 0, job.candidates);
+    if(object.count("dihedral"))
+        job.dihedral = member(object, "dihedral").asBool();
+    if(object.count("angles")){
+        const JsonValue &angles = member(object, "angles");
+        if(angles.type != JsonValue::Type::array)
+            throw std::runtime_error("invalid \"angles\"");
+        for(const JsonValue &angle : angles.items)
+            job.angles.push_back(angle.asNumber());
+    }
+    job.levels = intMember(object, "levels", 1, job.levels);
+    if(object.count("tileable"))
+        job.tileable = member(object, "tileable").asBool();
+    if(object.count("guide"))
+        job.guide = member(object, "guide").asString();
+    if(object.count("guideWeight")){
+        job.guideWeight = member(object, "guideWeight").asNumber();
+        if(!(job.guideWeight >= 0 && job.guideWeight <= 1))
+            throw std::runtime_error("invalid \"guideWeight\"");
+    }
+    if(job.candidates == 0 && (job.dihedral || !job.angles.empty() || job.levels > 1 || !job.guide.empty()))
+        job.candidates = 16;
+    if(object.count("seconds")){
+        job.seconds = member(object, "seconds").asNumber();
+        // at most 1e9 seconds, so the budget fits the nanoseconds
+        if(!(job.seconds >= 0 && job.seconds <= 1e9))
+            throw std::runtime_error("invalid \"seconds\"");
+    }
+    return job;
+}
+
+ExemplarCache::Exemplar ExemplarCache::get(const std::string &file_name){
+    struct stat info;
+    if(stat(file_name.c_str(), &info) != 0)
+        throw png::error("Invalid name for input file " + file_name);
+    long long modified = (long long) info.st_mtim.tv_sec * 1000000000LL + info.st_mtim.tv_nsec;
+    std::promise<Exemplar> decoded;
+    std::shared_future<Exemplar> cached;
+    {
+        std::lock_guard<std::mutex> lock(mtx);
+        auto it = entries.find(file_name);
+        if(it != entries.end() && it->second.modified == modified && it->second.fileSize == (long long) info.st_size){
+            hitCount++;
+            lruOrder.splice(lruOrder.begin(), lruOrder, it->second.lru);
+            cached = it->second.image;
+        } else{
+            if(it != entries.end()){
+                // the file changed, the old image is dropped (jobs using it keep their copy)
+                usedBytes -= it->second.bytes;
+                lruOrder.erase(it->second.lru);
+                entries.erase(it);
+            }
+            missCount++;
+            lruOrder.push_front(file_name);
+            entries[file_name] = Entry{decoded.get_future().share(), modified, (long long) info.st_size, 0, lruOrder.begin()};
+        }
+    }
+    // waits outside the lock, the exemplar may still be being decoded by another job
+    if(cached.valid())
+        return cached.get();
+    // decoded without the lock, other requests of this file wait for the future
+    Exemplar image;
+    try{
+        image = std::make_shared<const png::image<png::rgb_pixel>>(readImage(file_name));
+    } catch(...){
+        decoded.set_exception(std::current_exception());
+        std::lock_guard<std::mutex> lock(mtx);
+        auto it = entries.find(file_name);
+        if(it != entries.end() && it->second.modified == modified){
+            lruOrder.erase(it->second.lru);
+            entries.erase(it);
+        }
+        throw;
+    }
+    decoded.set_value(image);
+    std::lock_guard<std::mutex> lock(mtx);
+    auto it = entries.find(file_name);
+    if(it != entries.end() && it->second.modified == modified){
+        it->second.bytes = (size_t) image->get_width() * image->get_height() * sizeof(png::rgb_pixel);
+        usedBytes += it->second.bytes;
+        evict();
+    }
+    return image;
+}
+
+void ExemplarCache::evict(){
+    // the most recently used exemplar is always kept, even if it alone exceeds maxBytes
+    while(usedBytes > maxBytes && lruOrder.size() > 1){
+        auto it = entries.find(lruOrder.back());
+        usedBytes -= it->second.bytes;
+        entries.erase(it);
+        lruOrder.pop_back();
+    }
+}
+
+std::shared_ptr<ImageTexture> EnginePool::acquire(int width, int height, uint64_t seed){
+    std::unique_ptr<ImageTexture> engine;
+    {
+        std::lock_guard<std::mutex> lock(mtx);
+        auto &engines = idle[{width, height}];
+        if(!engines.empty()){
+            engine = std::move(engines.back());
+            engines.pop_back();
+            reuseCount++;
+        } else
+            createCount++;
+    }
+    if(!engine)
+        engine = std::make_unique<ImageTexture>(width, height);
+    engine->reset(seed);
+    return std::shared_ptr<ImageTexture>(engine.release(), [this, width, height](ImageTexture *released){
+        release(released, width, height);
+    });
+}
+
+void EnginePool::release(ImageTexture *engine, int width, int height){
+    std::unique_ptr<ImageTexture> owned(engine);
+    std::lock_guard<std::mutex> lock(mtx);
+    auto &engines = idle[{width, height}];
+    if(engines.size() < maxIdlePerSize)
+        engines.push_back(std::move(owned));
+}
+
+std::string runSynthesisJob(const SynthesisJob &job, ExemplarCache &exemplars, EnginePool &engines){
+    const auto start = std::chrono::steady_clock::now();
+    try{
+        if(job.video)
+            return runVideoJob(job, start);
+        std::vector<ExemplarCache::Exemplar> exemplar;
+        std::vector<const png::image<png::rgb_pixel> *> inputImgs;
+        for(const std::string &input : job.inputs){
+            exemplar.push_back(exemplars.get(input));
+            inputImgs.push_back(exemplar.back().get());
+        }
+        uint64_t seed = job.hasSeed ? job.seed : std::random_device()();
+        std::shared_ptr<ImageTexture> engine = engines.acquire(job.width, job.height, seed);
+        ImageTexture::FittingLimits limits;
+        limits.maxIterations = job.iterations;
+        limits.timeBudget = std::chrono::nanoseconds((long long) (job.seconds * 1e9));
+        limits.convergenceWindow = job.convergenceWindow;
+        if(!job.guide.empty()){
+            ExemplarCache::Exemplar target = exemplars.get(job.guide);
+            if((int) target->get_width() != job.width || (int) target->get_height() != job.height)
+                throw std::runtime_error("the guide must have the size of the texture");
+            engine->setGuide(*target, job.guideWeight);
+        }
+        ImageTexture::Progress progress;
+        if(job.candidates > 0){
+            ExemplarLibrary library(inputImgs, job.dihedral ? ExemplarLibrary::allTransforms : ExemplarLibrary::identityOnly, job.angles);
+            progress = job.levels > 1
+                ? engine->patchFittingPyramid(library, limits, job.levels, job.candidates)
+                : engine->patchFitting(library, limits, job.candidates);
+            if(job.tileable)
+                engine->makeTileable(library, job.candidates);
+        } else{
+            progress = engine->patchFitting(inputImgs, limits);
+            if(job.tileable)
+                engine->makeTileable(ExemplarLibrary(inputImgs));
+        }
+        engine->render(job.output, job.compressionLevel);
+        std::ostringstream response;
+        response<<"{\"status\":\"ok\",\"output\":"<<jsonQuote(job.output)
+            <<",\"iterations\":"<<progress.iterations
+            <<",\"coverage\":"<<progress.coverage
+            <<",\"case2\":"<<progress.case2Count
+            <<",\"seamEnergy\":"<<(double) progress.seamEnergy
+            <<",\"stopReason\":\""<<stopReasonName(progress.stopReason)<<"\""
+            <<",\"seconds\":"<<progress.elapsedSeconds
+            <<",\"totalSeconds\":"<<std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count()
+            <<",\"memoryBytes\":"<<engine->memoryUsage()
+            <<",\"seed\":"<<seed<<"}";
+        return response.str();
+    } catch(const std::exception &e){
+        return "{\"status\":\"error\",\"message\":" + jsonQuote(e.what()) + "}";
+    }
+}
@@ -0,0 +1,187 @@
+/**
+ * @file synthesisjob.hpp
+ * @author Letícia Freire Carvalho de Sousa
+ * @brief Header file of the synthesis jobs run by the daemon, with the caches shared by the jobs
+ * @version 0.1
+ * @date 2026-10-19
+ *
+ * @copyright Copyright (c) 2024
+ *
+ */
+#pragma once
+#include "imagetexture.hpp"
+#include "videotexture.hpp"
+#include "jsonline.hpp"
+#include <string>
+#include <memory>
+#include <mutex>
+#include <future>
+#include <list>
+#include <map>
+#include <vector>
+#include <cstdint>
+#include <atomic>
+
+/**
+ * @brief A texture to synthesize, read from a JSON object
+ *
+ * Members of the object: "input" (file name of the exemplar, or an array of file names used in turns
+ * by the iterations), "output" (file name of the texture),
+ * "width" and "height" (size of the texture), and the optional "iterations" (maximum number of
+ * iterations, 10000 by default), "seconds" (time budget), "convergence" (window of the convergence
+ * test), "seed" (seed of the random generator from 0 to 2^64 - 1, a number or a string of digits, random by default), "compression" (png level) and
+ * "candidates" (positions evaluated by each iteration, shared by the exemplars and their variants, which then
+ * places the best matching patch of all of them; 0 by default, the exemplars are used in turns at random positions),
+ * "dihedral" (true to add the rotations by 90 degrees and the mirrored exemplars to the candidates) and
+ * "angles" (array of other rotations of the exemplars, in degrees) and "levels" (levels of the pyramid of
+ * ImageTexture::patchFittingPyramid, 1 by default, the limits then apply to the coarsest level). With
+ * "dihedral", "angles" or "levels" and no "candidates", 16 candidates are evaluated. "tileable" (true to make
+ * the texture tileable with ImageTexture::makeTileable after the synthesis). "guide" (file name of a target
+ * image of the size of the texture, see ImageTexture::setGuide, 16 candidates by default) and "guideWeight"
+ * (weight of the guide cost, 0.5 by default).
+ *
+ * With "kind": "video" (the default kind is "image") the job synthesizes a video texture with VideoTexture: "input" is
+ * a directory of frames, or a raw stream of rgb frames with "inputWidth" and "inputHeight" (see RawFrameSource),
+ * "output" is the directory that gets the frames, "width", "height" and "frames" are the size of the video, and the
+ * optional "format" (extension of the frames, png by default), "blockSize", "blockFrames", "overlap",
+ * "temporalOverlap", "candidates" and "window" are the members of VideoTexture::Options with its defaults ("overlap"
+ * smaller than "blockSize"), with "seed" as above. The other members are ignored.
+ */
+struct SynthesisJob{
+    std::vector<std::string> inputs;
+    std::string output;
+    int width = 0;
+    int height = 0;
+    int iterations = 10000;
+    double seconds = 0;
+    int convergenceWindow = 0;
+    bool hasSeed = false;
+    uint64_t seed = 0;
+    int compressionLevel = 6;
+    int candidates = 0;
+    bool dihedral = false;
+    std::vector<double> angles;
+    int levels = 1;
+    bool tileable = false;
+    std::string guide;
+    double guideWeight = 0.5;
+    bool video = false;
+    VideoTexture::Options videoOptions;
+    std::string frameFormat = "png";
+    int inputWidth = 0; // size of the frames of a raw input stream, 0 for a directory of frames
+    int inputHeight = 0;
+};
+
+/**
+ * @brief Reads a job from the members of a JSON object
+ *
+ * @param object members of the object
+ * @return SynthesisJob the job, throws std::runtime_error if a member is missing or invalid
+ */
+SynthesisJob parseSynthesisJob(const JsonObject &object);
+
+/**
+ * @brief Decoded exemplars shared by the jobs
+ *
+ * An exemplar is decoded once and shared while its file isn't modified. The least recently used
+ * exemplars are evicted when the decoded pixels exceed maxBytes. Thread safe, concurrent requests
+ * of an exemplar being decoded wait for the same decoding.
+ */
+class ExemplarCache{
+public:
+    using Exemplar = std::shared_ptr<const png::image<png::rgb_pixel>>;
+
+    /**
+     * @brief Construct a new Exemplar Cache object
+     *
+     * @param _maxBytes maximum size of the decoded pixels kept in the cache
+     */
+    explicit ExemplarCache(size_t _maxBytes) : maxBytes(_maxBytes) {}
+
+    /**
+     * @brief Decoded exemplar of the file, decodes it on a miss
+     *
+     * Time Complexity: O(log(number of exemplars)) on a hit, linear on the number of pixels on a miss
+     *
+     * @param file_name file name of the exemplar (png, ppm, qoi or raw)
+     * @return Exemplar the decoded image, throws png::error if it can't be read
+     */
+    Exemplar get(const std::string &file_name);
+
+    /// number of requests answered without decoding
+    uint64_t hits() const { return hitCount; }
+    /// number of requests that decoded the file
+    uint64_t misses() const { return missCount; }
+private:
+    struct Entry{
+        std::shared_future<Exemplar> image;
+        long long modified;
+        long long fileSize;
+        size_t bytes;
+        std::list<std::string>::iterator lru;
+    };
+    const size_t maxBytes;
+    size_t usedBytes = 0;
+    std::atomic<uint64_t> hitCount{0}, missCount{0};
+    std::map<std::string, Entry> entries;
+    std::list<std::string> lruOrder; // most recently used first
+    std::mutex mtx;
+
+    void evict();
+};
+
+/**
+ * @brief Idle ImageTexture engines kept for reuse, by size of the output
+ *
+ * Reusing an engine skips the allocation of its grids and the page faults of its scratch tiles.
+ * The pool must outlive the engines it leases.
+ */
+class EnginePool{
+public:
+    /**
+     * @brief Construct a new Engine Pool object
+     *
+     * @param _maxIdlePerSize maximum number of idle engines kept for each size
+     */
+    explicit EnginePool(size_t _maxIdlePerSize) : maxIdlePerSize(_maxIdlePerSize) {}
+
+    /**
+     * @brief Leases an engine of this size, reset with the seed, it returns to the pool when released
+     *
+     * Time Complexity: O(width &times; height)
+     *
+     * @param width width of the texture
+     * @param height height of the texture
+     * @param seed seed of the random generator of the engine
+     * @return std::shared_ptr<ImageTexture>
+     */
+    std::shared_ptr<ImageTexture> acquire(int width, int height, uint64_t seed);
+
+    /// number of leases served by an idle engine
+    uint64_t reused() const { return reuseCount; }
+    /// number of engines constructed
+    uint64_t created() const { return createCount; }
+private:
+    const size_t maxIdlePerSize;
+    std::atomic<uint64_t> reuseCount{0}, createCount{0};
+    std::map<std::pair<int, int>, std::vector<std::unique_ptr<ImageTexture>>> idle;
+    std::mutex mtx;
+
+    void release(ImageTexture *engine, int width, int height);
+};
+
+/**
+ * @brief Runs a job: leases an engine, fits patches from the cached exemplar and renders the texture
+ *
+ * A video job reads its clip and writes its frames with a VideoTexture of its own, it uses neither the cache nor the pool.
+ *
+ * Time Complexity: O(iterations &times; (width &times; height &times; log<sup>2</sup>(width &times; height )))
+ *
+ * @param job job that will be run
+ * @param exemplars cache of the exemplars
+ * @param engines pool of the engines
+ * @return std::string a JSON object with "status" "ok", the progress of the synthesis, its total time (with decoding and rendering)
+ * and the memory of its engine (for a video the frames and blocks written, the seam energy and the peak of resident frames),
+ * or "status" "error" and a "message"
+ */
+std::string runSynthesisJob(const SynthesisJob &job, ExemplarCache &exemplars, EnginePool &engines);
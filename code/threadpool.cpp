@@ -0,0 +1,49 @@
+/**
+ * @file threadpool.cpp
+ * @author Letícia Freire Carvalho de Sousa
+ * @brief Implementation of threadpool.hpp
+ * @version 0.1
+ * @date 2026-10-19
+ *
+ * @copyright Copyright (c) 2024
+ *
+ */
+
+#include "threadpool.hpp"
+#include <algorithm>
+
+ThreadPool::ThreadPool(int threads){
+    if(threads <= 0)
+        threads = std::max(1, (int) std::thread::hardware_concurrency());
+    for(int i = 0; i < threads; i++)
+        workers.emplace_back(&ThreadPool::run, this);
+}
+ThreadPool::~ThreadPool(){
+    {
+        std::lock_guard<std::mutex> lock(mtx);
+        stopping = true;
+    }
+    cv.notify_all();
+    for(auto &worker : workers)
+        worker.join();
+}
+
+ThreadPool &ThreadPool::shared(){
+    static ThreadPool pool;
+    return pool;
+}
+
+void ThreadPool::run(){
+    while(true){
+        std::function<void()> task;
+        {
+            std::unique_lock<std::mutex> lock(mtx);
+            cv.wait(lock, [this]{ return stopping || !tasks.empty(); });
+            if(tasks.empty())
+                return;
+            task = std::move(tasks.front());
+            tasks.pop();
+        }
+        task();
+    }
+}
@@ -0,0 +1,79 @@
+/**
+ * @file threadpool.hpp
+ * @author Letícia Freire Carvalho de Sousa
+ * @brief Header file of the pool of worker threads
+ * @version 0.1
+ * @date 2026-10-19
+ *
+ * @copyright Copyright (c) 2024
+ *
+ */
+#pragma once
+#include <vector>
+#include <queue>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <functional>
+#include <future>
+#include <memory>
+
+/**
+ * @brief Fixed number of worker threads that run the submitted tasks in submission order
+ */
+class ThreadPool{
+public:
+    /**
+     * @brief Construct a new Thread Pool object
+     *
+     * @param threads number of worker threads (0 uses one per hardware thread)
+     */
+    explicit ThreadPool(int threads = 0);
+
+    /**
+     * @brief Waits for the submitted tasks and stops the worker threads
+     */
+    ~ThreadPool();
+
+    ThreadPool(const ThreadPool &) = delete;
+    ThreadPool &operator=(const ThreadPool &) = delete;
+
+    /**
+     * @brief Submits a task to be run by a worker thread
+     *
+     * @param task callable without parameters
+     * @return std::future with the result of the task
+     */
+    template<typename F>
+    auto submit(F task) -> std::future<decltype(task())>;
+
+    /// number of worker threads
+    int size() const { return (int) workers.size(); }
+
+    /**
+     * @brief Pool shared by the whole process, with one worker per hardware thread
+     *
+     * Tasks of the shared pool must not wait for other tasks of the shared pool
+     */
+    static ThreadPool &shared();
+private:
+    std::vector<std::thread> workers;
+    std::queue<std::function<void()>> tasks;
+    std::mutex mtx;
+    std::condition_variable cv;
+    bool stopping = false;
+
+    void run();
+};
+
+template<typename F>
+auto ThreadPool::submit(F task) -> std::future<decltype(task())>{
+    auto packaged = std::make_shared<std::packaged_task<decltype(task())()>>(std::move(task));
+    auto result = packaged->get_future();
+    {
+        std::lock_guard<std::mutex> lock(mtx);
+        tasks.emplace([packaged]{ (*packaged)(); });
+    }
+    cv.notify_one();
+    return result;
+}
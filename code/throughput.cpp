@@ -0,0 +1,97 @@
+/**
+ * @file throughput.cpp
+ * @author Letícia Freire Carvalho de Sousa
+ * @brief Measures the throughput of small textures of the server against a process per texture
+ * @version 0.1
+ * @date 2026-10-19
+ *
+ * @copyright Copyright (c) 2024
+ *
+ * Usage: ./throughput job [jobs]
+ *
+ * The job is a JSON object as described in synthesisjob.hpp, e.g.
+ *     '{"input": "../input_images/areia_input0.png", "output": "/tmp/t.png", "width": 64, "height": 64, "iterations": 20}'
+ * It runs jobs times (20 by default) in three ways, one job at a time:
+ *     process: a ./batch process per job with a manifest of that job (process start, decoding and allocation every time)
+ *     cold: in this process with a new exemplar cache and engine pool per job (decoding and allocation every time)
+ *     warm: in this process with the exemplar cache and the engine pool shared by the jobs, like ./daemon
+ * and prints the jobs per second of each one and the speedup of warm. ./batch must be built.
+ */
+
+#include "synthesisjob.hpp"
+#include <iostream>
+#include <fstream>
+#include <chrono>
+#include <functional>
+#include <cstdlib>
+#include <spawn.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <sys/wait.h>
+
+extern char **environ;
+
+namespace{
+
+// jobs per second of runs calls of job
+double jobsPerSecond(int runs, const std::function<void()> &job){
+    const auto start = std::chrono::steady_clock::now();
+    for(int k = 0; k < runs; k++)
+        job();
+    return runs / std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+}
+
+void check(const std::string &report){
+    if(report.compare(0, 17, "{\"status\":\"error\"") == 0)
+        throw std::runtime_error("The job failed: " + report);
+}
+
+// runs ./batch on the manifest with its output discarded
+void runBatch(const std::string &manifest){
+    posix_spawn_file_actions_t actions;
+    posix_spawn_file_actions_init(&actions);
+    posix_spawn_file_actions_addopen(&actions, STDOUT_FILENO, "/dev/null", O_WRONLY, 0);
+    posix_spawn_file_actions_addopen(&actions, STDERR_FILENO, "/dev/null", O_WRONLY, 0);
+    std::string program = "./batch", workers = "1";
+    char *argv[] = {program.data(), const_cast<char *>(manifest.c_str()), workers.data(), nullptr};
+    pid_t pid;
+    int status = 0;
+    const int error = posix_spawn(&pid, argv[0], &actions, nullptr, argv, environ);
+    posix_spawn_file_actions_destroy(&actions);
+    if(error != 0 || waitpid(pid, &status, 0) < 0 || !WIFEXITED(status) || WEXITSTATUS(status) != 0)
+        throw std::runtime_error("Can't run ./batch, build it with make batch");
+}
+
+} // namespace
+
+int main(int argc, char *argv[]){
+    if(argc < 2){
+        std::cerr<<"Usage: "<<argv[0]<<" job [jobs]"<<std::endl;
+        return 2;
+    }
+    const int runs = argc > 2 ? std::max(1, atoi(argv[2])) : 20;
+    try{
+        SynthesisJob job = parseSynthesisJob(parseJsonObject(argv[1]));
+        const std::string manifest = "/tmp/throughput." + std::to_string(getpid()) + ".jsonl";
+        std::ofstream(manifest)<<argv[1]<<"\n";
+
+        const double process = jobsPerSecond(runs, [&]{ runBatch(manifest); });
+        const double cold = jobsPerSecond(runs, [&]{
+            ExemplarCache exemplars(size_t(256) << 20);
+            EnginePool engines(1);
+            check(runSynthesisJob(job, exemplars, engines));
+        });
+        ExemplarCache exemplars(size_t(256) << 20);
+        EnginePool engines(1);
+        check(runSynthesisJob(job, exemplars, engines));
+        const double warm = jobsPerSecond(runs, [&]{ check(runSynthesisJob(job, exemplars, engines)); });
+        unlink(manifest.c_str());
+
+        std::cout<<"process: "<<process<<" jobs/s"<<std::endl;
+        std::cout<<"cold: "<<cold<<" jobs/s"<<std::endl;
+        std::cout<<"warm: "<<warm<<" jobs/s, "<<warm / process<<" times the process per job, "<<warm / cold<<" times cold"<<std::endl;
+    } catch(const std::exception &e){
+        std::cerr<<e.what()<<std::endl;
+        return 1;
+    }
+}
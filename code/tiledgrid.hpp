@@ -0,0 +1,229 @@
+/**
+ * @file tiledgrid.hpp
+ * @author Letícia Freire Carvalho de Sousa
+ * @brief Tiled grids used as storage of the output image and of the auxiliar variables
+ * @version 0.1
+ * @date 2026-10-19
+ *
+ * @copyright Copyright (c) 2024
+ *
+ */
+#pragma once
+#include <vector>
+#include <algorithm>
+#include <memory>
+#include <string>
+#include <stdexcept>
+#include <type_traits>
+#include <cstring>
+#include <cerrno>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+
+/// side of the square tiles of the grids (in cells), tiles have tileSide &times; tileSide cells
+constexpr int tileShift = 6;
+constexpr int tileSide = 1 << tileShift;
+constexpr int tileMask = tileSide - 1;
+
+/**
+ * @brief 2D grid whose tiles are allocated on the first access
+ *
+ * Cells of tiles that were never accessed hold defaultValue. Tiles can be released when
+ * all their cells are back to defaultValue, so the memory used is proportional to the
+ * area accessed since the last release, not to the area of the grid.
+ *
+ * @tparam T type of the cells
+ */
+template<typename T>
+class TiledGrid{
+public:
+    /**
+     * @brief Proxy of a row, so cells can be accessed as grid[i][j]
+     */
+    class Row{
+    public:
+        Row(TiledGrid *_grid, int _i) : grid(_grid), i(_i) {}
+        T &operator[](int j) const { return grid->at(i, j); }
+        size_t size() const { return grid->width; }
+    private:
+        TiledGrid *grid;
+        int i;
+    };
+
+    /**
+     * @brief Construct a new Tiled Grid object, no tile is allocated
+     *
+     * Time Complexity: O(height &times; width / tileSide<sup>2</sup>)
+     *
+     * @param _height number of rows
+     * @param _width number of columns
+     * @param _defaultValue value of the cells that were never accessed
+     */
+    TiledGrid(int _height, int _width, const T &_defaultValue = T())
+        :
+        height(_height),
+        width(_width),
+        tilesPerRowShift(0),
+        defaultValue(_defaultValue) {
+        // the number of tiles per row is rounded to a power of two, so a tile is found with shifts only
+        while((1 << tilesPerRowShift) < ((_width + tileMask) >> tileShift))
+            tilesPerRowShift++;
+        tiles.resize(size_t((_height + tileMask) >> tileShift) << tilesPerRowShift);
+    }
+
+    Row operator[](int i) { return Row(this, i); }
+    size_t size() const { return height; }
+
+    T &at(int i, int j){
+        size_t index = (size_t(i >> tileShift) << tilesPerRowShift) | size_t(j >> tileShift);
+        T *tile = tiles[index].get();
+        if(__builtin_expect(tile == nullptr, 0))
+            tile = allocate(index);
+        return tile[((i & tileMask) << tileShift) | (j & tileMask)];
+    }
+
+    /**
+     * @brief Releases every tile, all cells must be back to the default value
+     *
+     * Time Complexity: O(height &times; width / tileSide<sup>2</sup>)
+     */
+    void release(){
+        for(auto &tile : tiles)
+            tile.reset();
+        residentTiles = 0;
+    }
+
+    /// number of allocated tiles
+    size_t resident() const { return residentTiles; }
+    /// bytes of the allocated tiles
+    size_t residentBytes() const { return residentTiles * tileSide * tileSide * sizeof(T); }
+private:
+    int height;
+    int width;
+    int tilesPerRowShift;
+    T defaultValue;
+    std::vector<std::unique_ptr<T[]>> tiles;
+    size_t residentTiles = 0;
+
+    __attribute__((noinline)) T *allocate(size_t index){
+        tiles[index] = std::make_unique<T[]>(tileSide * tileSide);
+        std::fill(tiles[index].get(), tiles[index].get() + tileSide * tileSide, defaultValue);
+        residentTiles++;
+        return tiles[index].get();
+    }
+};
+
+/**
+ * @brief 2D grid stored tile by tile in a memory mapping
+ *
+ * The mapping is either anonymous or backed by a file, in both cases the pages are only
+ * loaded when touched and every cell starts zeroed. With a file the grid can be larger
+ * than the RAM, the kernel keeps resident only the tiles that are being used.
+ *
+ * @tparam T trivially copyable type of the cells, the zeroed value is the initial value
+ */
+template<typename T>
+class MappedGrid{
+    static_assert(std::is_trivially_copyable<T>::value, "cells of a MappedGrid are stored as raw bytes");
+public:
+    /**
+     * @brief Proxy of a row, so cells can be accessed as grid[i][j]
+     */
+    class Row{
+    public:
+        Row(T *_base, size_t _rowOffset) : base(_base), rowOffset(_rowOffset) {}
+        T &operator[](int j) const { return base[rowOffset + (size_t(j >> tileShift) << (2 * tileShift)) + (j & tileMask)]; }
+    private:
+        T *base;
+        size_t rowOffset;
+    };
+
+    /**
+     * @brief Construct a new Mapped Grid object
+     *
+     * Time Complexity: O(1)
+     *
+     * @param _height number of rows
+     * @param _width number of columns
+     * @param file_name file that backs the grid, an empty name creates an anonymous mapping
+     */
+    MappedGrid(int _height, int _width, const std::string &file_name = "")
+        :
+        height(_height),
+        width(_width),
+        fileBacked(!file_name.empty()),
+        tilesPerRow((_width + tileMask) >> tileShift),
+        bytes(size_t((_height + tileMask) >> tileShift) * tilesPerRow * tileSide * tileSide * sizeof(T)) {
+        void *mapping;
+        if(file_name.empty()){
+            mapping = mmap(nullptr, bytes, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS | MAP_NORESERVE, -1, 0);
+        } else{
+            int fd = open(file_name.c_str(), O_RDWR | O_CREAT | O_TRUNC, 0644);
+            if(fd < 0 || ftruncate(fd, (off_t) bytes) != 0){
+                if(fd >= 0)
+                    close(fd);
+                throw std::runtime_error("Invalid backing file " + file_name + ": " + std::strerror(errno));
+            }
+            mapping = mmap(nullptr, bytes, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+            close(fd);
+        }
+        if(mapping == MAP_FAILED)
+            throw std::runtime_error(std::string("Can't map grid: ") + std::strerror(errno));
+        base = static_cast<T *>(mapping);
+    }
+    ~MappedGrid(){
+        munmap(base, bytes);
+    }
+    MappedGrid(const MappedGrid &) = delete;
+    MappedGrid &operator=(const MappedGrid &) = delete;
+
+    Row operator[](int i) const { return Row(base, ((size_t(i >> tileShift) * tilesPerRow) << (2 * tileShift)) + (size_t(i & tileMask) << tileShift)); }
+
+    /**
+     * @brief Releases the memory of the tiles entirely inside rows [top, bottom)
+     *
+     * With an anonymous mapping the cells of released tiles are zeroed, with a file they keep their values
+     *
+     * @param top first row
+     * @param bottom one past the last row
+     */
+    void releaseRows(int top, int bottom){
+        size_t firstTileRow = size_t(top + tileMask) >> tileShift;
+        size_t lastTileRow = size_t(std::min(bottom, height) == height ? (height + tileMask) : bottom) >> tileShift;
+        if(firstTileRow >= lastTileRow)
+            return;
+        size_t tileRowBytes = (tilesPerRow << (2 * tileShift)) * sizeof(T);
+        madvise(reinterpret_cast<char *>(base) + firstTileRow * tileRowBytes, (lastTileRow - firstTileRow) * tileRowBytes, MADV_DONTNEED);
+    }
+    /**
+     * @brief Zeroes every cell without writing to the pages
+     *
+     * The pages are given back to the kernel, which zeroes them on their next touch, so only the pages that are
+     * touched again are zeroed. A file backed grid punches a hole in its file, or writes zeros when the file
+     * system can't punch holes.
+     *
+     * Time Complexity: linear on the number of resident pages
+     */
+    void clear(){
+        if(madvise(base, bytes, fileBacked ? MADV_REMOVE : MADV_DONTNEED) != 0)
+            std::fill_n(reinterpret_cast<char *>(base), bytes, 0);
+    }
+    size_t size() const { return height; }
+    int get_height() const { return height; }
+    int get_width() const { return width; }
+
+    /// raw storage of the grid, byteSize() bytes in the tile layout
+    T *data() { return base; }
+    const T *data() const { return base; }
+    size_t byteSize() const { return bytes; }
+    /// true when the mapping is shared with a backing file
+    bool shared() const { return fileBacked; }
+private:
+    int height;
+    int width;
+    bool fileBacked;
+    size_t tilesPerRow;
+    size_t bytes;
+    T *base;
+};
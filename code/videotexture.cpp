@@ -0,0 +1,397 @@
+/**
+ * @file videotexture.cpp
+ * @author Letícia Freire Carvalho de Sousa
+ * @brief Implementation of videotexture.hpp
+ * @version 0.1
+ * @date 2026-10-19
+ *
+ * @copyright Copyright (c) 2024
+ *
+ */
+
+#include "videotexture.hpp"
+#include "imagecodec.hpp"
+#include "pixeltraits.hpp"
+#include <algorithm>
+#include <array>
+#include <filesystem>
+#include <limits>
+#include <stdexcept>
+
+namespace{
+
+/**
+ * @brief Maximum flow of a graph by Dinic's algorithm, whose last search gives the minimum cut
+ */
+class MaxFlow{
+public:
+    explicit MaxFlow(int nodes) : head(nodes, -1), level(nodes, -1), current(nodes, -1) {}
+
+    // edge u -> v with capacity and v -> u with reverseCapacity
+    void addEdge(int u, int v, double capacity, double reverseCapacity){
+        arcs.push_back({v, head[u], capacity});
+        head[u] = (int) arcs.size() - 1;
+        arcs.push_back({u, head[v], reverseCapacity});
+        head[v] = (int) arcs.size() - 1;
+    }
+
+    double run(int source, int sink){
+        double flow = 0;
+        while(levels(source, sink))
+            flow += blockingFlow(source, sink);
+        return flow;
+    }
+
+    // after run, if the node is on the side of the source of the minimum cut
+    bool sourceSide(int v) const { return level[v] >= 0; }
+private:
+    struct Arc{
+        int to;
+        int next;
+        double capacity;
+    };
+    static constexpr double eps = 1e-9;
+    std::vector<Arc> arcs;
+    std::vector<int> head;
+    std::vector<int> level;
+    std::vector<int> current;
+
+    // breadth first levels of the residual graph, true if the sink is reached
+    bool levels(int source, int sink){
+        std::fill(level.begin(), level.end(), -1);
+        std::vector<int> queue = {source};
+        level[source] = 0;
+        for(size_t front = 0; front < queue.size(); front++){
+            const int u = queue[front];
+            for(int a = head[u]; a >= 0; a = arcs[a].next)
+                if(arcs[a].capacity > eps && level[arcs[a].to] < 0){
+                    level[arcs[a].to] = level[u] + 1;
+                    queue.push_back(arcs[a].to);
+                }
+        }
+        return level[sink] >= 0;
+    }
+
+    // augmenting paths of the level graph, the path is a stack of arcs so long paths need no recursion
+    double blockingFlow(int source, int sink){
+        current = head;
+        double flow = 0;
+        std::vector<int> path;
+        int u = source;
+        while(true){
+            if(u == sink){
+                // every path has a finite arc, the infinite ones are only from the source or to the sink
+                double pushed = std::numeric_limits<double>::infinity();
+                for(int a : path)
+                    pushed = std::min(pushed, arcs[a].capacity);
+                size_t saturated = path.size();
+                for(size_t k = 0; k < path.size(); k++){
+                    arcs[path[k]].capacity -= pushed;
+                    arcs[path[k] ^ 1].capacity += pushed;
+                    if(saturated == path.size() && arcs[path[k]].capacity <= eps)
+                        saturated = k;
+                }
+                flow += pushed;
+                path.resize(saturated);
+                u = saturated == 0 ? source : arcs[path.back()].to;
+                continue;
+            }
+            int &a = current[u];
+            while(a >= 0 && (arcs[a].capacity <= eps || level[arcs[a].to] != level[u] + 1))
+                a = arcs[a].next;
+            if(a >= 0){
+                path.push_back(a);
+                u = arcs[a].to;
+                continue;
+            }
+            if(u == source)
+                break;
+            // dead end, no later path goes through u
+            level[u] = -1;
+            const int back = path.back();
+            path.pop_back();
+            u = arcs[back ^ 1].to;
+            current[u] = arcs[current[u]].next;
+        }
+        return flow;
+    }
+};
+
+int noClose(FILE *){
+    return 0;
+}
+
+} // namespace
+
+DirectoryFrameSource::DirectoryFrameSource(const std::string &directory){
+    std::error_code error;
+    for(const auto &entry : std::filesystem::directory_iterator(directory, error)){
+        const std::string name = entry.path().filename().string();
+        // other files of the directory (a readme, a list of the frames) aren't frames
+        if(entry.is_regular_file() && !name.empty() && name[0] != '.' && hasImageCodec(name))
+            files.push_back(entry.path().string());
+    }
+    if(error)
+        throw std::runtime_error("Can't list the frames of " + directory);
+    std::sort(files.begin(), files.end());
+}
+bool DirectoryFrameSource::next(png::image<png::rgb_pixel> &frame){
+    if(position >= files.size())
+        return false;
+    frame = readImage(files[position++]);
+    return true;
+}
+
+RawFrameSource::RawFrameSource(const std::string &file_name, int _width, int _height)
+    :
+    file(file_name == "-" ? stdin : fopen(file_name.c_str(), "rb"), file_name == "-" ? noClose : fclose),
+    width(_width),
+    height(_height),
+    buffer((size_t) std::max(0, _width) * std::max(0, _height) * 3) {
+    if(!file)
+        throw std::runtime_error("Invalid name for raw stream " + file_name);
+    if(width <= 0 || height <= 0)
+        throw std::runtime_error("Invalid size of the frames of " + file_name);
+}
+bool RawFrameSource::next(png::image<png::rgb_pixel> &frame){
+    // a partial frame at the end of the stream is dropped
+    if(fread(buffer.data(), 1, buffer.size(), file.get()) != buffer.size())
+        return false;
+    frame = png::image<png::rgb_pixel>(width, height);
+    for(int i = 0; i < height; i++)
+        for(int j = 0; j < width; j++){
+            const png::byte *p = buffer.data() + ((size_t) i * width + j) * 3;
+            frame[i][j] = png::rgb_pixel(p[0], p[1], p[2]);
+        }
+    return true;
+}
+void RawFrameSource::rewind(){
+    if(file.get() == stdin || fseek(file.get(), 0, SEEK_SET) != 0)
+        throw std::runtime_error("The raw stream can't be rewound");
+}
+
+VideoTexture::VideoTexture(const Options &_options, uint64_t seed) : options(_options), rng(seed){
+    if(options.width <= 0 || options.height <= 0 || options.frames < 0)
+        throw std::runtime_error("Invalid size of the video texture");
+    options.blockSize = std::max(2, options.blockSize);
+    options.blockFrames = std::max(1, options.blockFrames);
+    options.temporalOverlap = std::clamp(options.temporalOverlap, 0, options.blockFrames - 1);
+    options.candidates = std::max(1, options.candidates);
+    options.inputWindow = std::max(options.inputWindow, options.blockFrames);
+}
+
+int VideoTexture::synthesize(FrameSource &input, const FrameSink &output){
+    outputFrames.clear();
+    inputFrames.clear();
+    firstOutputFrame = 0;
+    clipPosition = 0;
+    while((int) inputFrames.size() < options.inputWindow)
+        readInput(input);
+    const int side = std::min({options.blockSize, (int) inputFrames[0].image.get_height(), (int) inputFrames[0].image.get_width()});
+    const int overlap = std::clamp(options.overlap, 0, side - 1);
+    const int step = side - overlap, temporalStep = options.blockFrames - options.temporalOverlap;
+    // horizontal jitter of the blocks, so the seams don't line up in columns, less than a step so a block never
+    // starts left of the column 0 or of the previous block
+    const int maxJitter = std::min(overlap / 4, step - 1);
+    std::uniform_int_distribution<int> jitter(-maxJitter, maxJitter);
+    int written = 0;
+    for(int frame = 0; written < options.frames; frame += temporalStep){
+        const int frames = std::min(options.blockFrames, options.frames - frame);
+        while(firstOutputFrame + (int) outputFrames.size() < frame + frames)
+            outputFrames.push_back({png::image<png::rgb_pixel>(options.width, options.height), std::vector<uint8_t>((size_t) options.width * options.height, 0)});
+        peakFrames = std::max(peakFrames, outputFrames.size() + inputFrames.size());
+        for(int row = 0; row < options.height; row += step)
+            for(int col = 0; col < options.width; col += step){
+                const int jittered = col == 0 ? 0 : std::clamp(col + jitter(rng), 0, options.width - 1);
+                placeBlock(matching(frame, row, jittered, frames, side), frame, row, jittered, frames, side);
+            }
+        // later slabs start at the next temporal step, the frames before it are final
+        const int finalFrames = frame + options.blockFrames >= options.frames ? options.frames : frame + temporalStep;
+        for(; firstOutputFrame < finalFrames; firstOutputFrame++, written++){
+            output(firstOutputFrame, outputFrames.front().image);
+            outputFrames.pop_front();
+        }
+        // the input window moves with the output
+        for(int k = 0; k < temporalStep && written < options.frames; k++){
+            inputFrames.pop_front();
+            readInput(input);
+        }
+    }
+    return written;
+}
+
+VideoTexture::FrameSink VideoTexture::directorySink(const std::string &directory, const std::string &extension){
+    return [directory, extension](int index, const png::image<png::rgb_pixel> &frame){
+        char name[32];
+        snprintf(name, sizeof(name), "frame_%06d.", index);
+        writeImage(directory + "/" + name + extension, frame);
+    };
+}
+
+/**
+ * @brief reads the next input frame to the end of the window, the clip loops when it ends
+ *
+ * @param input frames of the input clip
+ */
+void VideoTexture::readInput(FrameSource &input){
+    InputFrame frame;
+    if(!input.next(frame.image)){
+        input.rewind();
+        clipPosition = 0;
+        if(!input.next(frame.image))
+            throw std::runtime_error("The input clip has no frames");
+    }
+    if(!inputFrames.empty() && (frame.image.get_width() != inputFrames[0].image.get_width() || frame.image.get_height() != inputFrames[0].image.get_height()))
+        throw std::runtime_error("The frames of the input clip must have the same size");
+    frame.clipIndex = clipPosition++;
+    inputFrames.push_back(std::move(frame));
+}
+
+/**
+ * @brief if the output pixel (i, j) of the frame has a color, the frames given to the sink have
+ *
+ * @param frame output frame
+ * @param i row of the pixel
+ * @param j column of the pixel
+ * @return bool
+ */
+bool VideoTexture::colored(int frame, int i, int j) const{
+    if(frame < firstOutputFrame)
+        return true;
+    if(frame >= firstOutputFrame + (int) outputFrames.size())
+        return false;
+    return outputFrames[frame - firstOutputFrame].colored[(size_t) i * options.width + j] != 0;
+}
+
+/**
+ * @brief chooses the block with the lowest mean squared difference over the colored voxels under it among random candidates
+ *
+ * The difference is sampled on every other pixel of the rows and columns of each frame.
+ *
+ * @param frame first output frame of the block
+ * @param row first output row of the block
+ * @param col first output column of the block
+ * @param frames number of frames of the block
+ * @param side side of the block
+ * @return Candidate
+ */
+VideoTexture::Candidate VideoTexture::matching(int frame, int row, int col, int frames, int side){
+    // the first frames of the candidates, which don't cross the loop of the clip if the window allows it
+    std::vector<int> starts;
+    for(int s = 0; s + frames <= (int) inputFrames.size(); s++){
+        bool consecutive = true;
+        for(int k = 1; k < frames && consecutive; k++)
+            consecutive = inputFrames[s + k].clipIndex == inputFrames[s + k - 1].clipIndex + 1;
+        if(consecutive)
+            starts.push_back(s);
+    }
+    if(starts.empty())
+        for(int s = 0; s + frames <= (int) inputFrames.size(); s++)
+            starts.push_back(s);
+    const int inputHeight = inputFrames[0].image.get_height(), inputWidth = inputFrames[0].image.get_width();
+    std::uniform_int_distribution<size_t> nextStart(0, starts.size() - 1);
+    std::uniform_int_distribution<int> nextRow(0, inputHeight - side);
+    std::uniform_int_distribution<int> nextCol(0, inputWidth - side);
+    const int lastRow = std::min(options.height, row + side), lastCol = std::min(options.width, col + side);
+    Candidate best = {0, 0, 0};
+    double bestCost = 0;
+    for(int c = 0; c < options.candidates; c++){
+        const int start = starts[nextStart(rng)];
+        const int inputRow = nextRow(rng);
+        const Candidate candidate = {start, inputRow, nextCol(rng)};
+        uint64_t sum = 0, overlap = 0;
+        for(int f = 0; f < frames; f++){
+            const OutputFrame &out = outputFrames[frame + f - firstOutputFrame];
+            const png::image<png::rgb_pixel> &in = inputFrames[candidate.frame + f].image;
+            for(int i = row; i < lastRow; i += 2)
+                for(int j = col; j < lastCol; j += 2){
+                    if(!out.colored[(size_t) i * options.width + j])
+                        continue;
+                    const png::rgb_pixel &p = out.image[i][j], &q = in[candidate.row + i - row][candidate.col + j - col];
+                    const int dr = p.red - q.red, dg = p.green - q.green, db = p.blue - q.blue;
+                    sum += (uint64_t) (dr * dr + dg * dg + db * db);
+                    overlap++;
+                }
+        }
+        const double cost = overlap == 0 ? 0 : (double) sum / (double) overlap;
+        if(c == 0 || cost < bestCost)
+            best = candidate, bestCost = cost;
+    }
+    return best;
+}
+
+/**
+ * @brief copies the block to the output, its colored voxels on the side of the block of the minimum cut
+ *
+ * The nodes are the colored voxels of the block, with edges between 6-neighbors of cost
+ * |old(p) - new(p)| + |old(q) - new(q)|. A voxel next to a colored voxel out of the block is tied to the
+ * old side, a voxel next to a voxel that only the block covers to the new side.
+ *
+ * Time Complexity: O(V &times; E) on the voxels of the block in the worst case, near linear on the grids of the blocks
+ *
+ * @param candidate position of the block in the input window
+ * @param frame first output frame of the block
+ * @param row first output row of the block
+ * @param col first output column of the block
+ * @param frames number of frames of the block
+ * @param side side of the block
+ */
+void VideoTexture::placeBlock(const Candidate &candidate, int frame, int row, int col, int frames, int side){
+    static constexpr std::array<std::array<int, 3>, 6> neighbors = {{
+        {-1, 0, 0}, {1, 0, 0}, {0, -1, 0}, {0, 1, 0}, {0, 0, -1}, {0, 0, 1}
+    }};
+    const int height = std::min(options.height, row + side) - row, width = std::min(options.width, col + side) - col;
+    auto voxel = [&](int f, int i, int j){ return ((size_t) f * height + i) * width + j; };
+    auto oldColor = [&](int f, int i, int j) -> const png::rgb_pixel & { return outputFrames[frame + f - firstOutputFrame].image[row + i][col + j]; };
+    auto newColor = [&](int f, int i, int j) -> const png::rgb_pixel & { return inputFrames[candidate.frame + f].image[candidate.row + i][candidate.col + j]; };
+    std::vector<int> node((size_t) frames * height * width, -1);
+    int nodes = 0;
+    for(int f = 0; f < frames; f++)
+        for(int i = 0; i < height; i++)
+            for(int j = 0; j < width; j++)
+                if(colored(frame + f, row + i, col + j))
+                    node[voxel(f, i, j)] = nodes++;
+    MaxFlow graph(nodes + 2);
+    const int source = nodes, sink = nodes + 1;
+    const double infinity = std::numeric_limits<double>::infinity();
+    for(int f = 0; f < frames; f++)
+        for(int i = 0; i < height; i++)
+            for(int j = 0; j < width; j++){
+                const int v = node[voxel(f, i, j)];
+                if(v < 0)
+                    continue;
+                bool toOld = false, toNew = false;
+                for(const auto &[df, di, dj] : neighbors){
+                    const int nf = f + df, ni = i + di, nj = j + dj;
+                    if(0 <= nf && nf < frames && 0 <= ni && ni < height && 0 <= nj && nj < width){
+                        const int u = node[voxel(nf, ni, nj)];
+                        if(u < 0)
+                            toNew = true;
+                        else if(u > v){
+                            const double cost = (double) (colorDistance(oldColor(f, i, j), newColor(f, i, j)) + colorDistance(oldColor(nf, ni, nj), newColor(nf, ni, nj)));
+                            graph.addEdge(v, u, cost, cost);
+                        }
+                    } else if(frame + nf >= 0 && 0 <= row + ni && row + ni < options.height && 0 <= col + nj && col + nj < options.width
+                        && colored(frame + nf, row + ni, col + nj))
+                        toOld = true;
+                }
+                // a voxel tied to both sides keeps its color, so every path from the source to the sink has a finite edge
+                if(toOld)
+                    graph.addEdge(source, v, infinity, 0);
+                else if(toNew)
+                    graph.addEdge(v, sink, infinity, 0);
+            }
+    cutEnergy += graph.run(source, sink);
+    for(int f = 0; f < frames; f++){
+        OutputFrame &out = outputFrames[frame + f - firstOutputFrame];
+        for(int i = 0; i < height; i++)
+            for(int j = 0; j < width; j++){
+                const int v = node[voxel(f, i, j)];
+                if(v >= 0 && graph.sourceSide(v))
+                    continue;
+                out.image[row + i][col + j] = newColor(f, i, j);
+                out.colored[(size_t) (row + i) * options.width + col + j] = 1;
+            }
+    }
+    blockCount++;
+}
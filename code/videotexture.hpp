@@ -0,0 +1,195 @@
+/**
+ * @file videotexture.hpp
+ * @author Letícia Freire Carvalho de Sousa
+ * @brief Header file of the synthesis of video textures with spatio-temporal blocks and 3D graph cuts
+ * @version 0.1
+ * @date 2026-10-19
+ *
+ * @copyright Copyright (c) 2024
+ *
+ */
+#pragma once
+#include <png++/png.hpp>
+#include <cstdio>
+#include <deque>
+#include <functional>
+#include <memory>
+#include <random>
+#include <string>
+#include <vector>
+
+/**
+ * @brief Frames of an input clip, read one at a time so the clip is never held whole
+ */
+class FrameSource{
+public:
+    virtual ~FrameSource() = default;
+
+    /**
+     * @brief Reads the next frame
+     *
+     * @param frame image that gets the frame
+     * @return false at the end of the clip
+     */
+    virtual bool next(png::image<png::rgb_pixel> &frame) = 0;
+
+    /// goes back to the first frame, throws std::runtime_error if the source can't
+    virtual void rewind() = 0;
+};
+
+/**
+ * @brief Frames of the image files of a directory, in the order of their names
+ *
+ * Each file is read with the codec of its extension (see imagecodec.hpp), hidden files and files whose extension has
+ * no codec are skipped.
+ */
+class DirectoryFrameSource : public FrameSource{
+public:
+    /**
+     * @brief Construct a new Directory Frame Source object
+     *
+     * Time Complexity: O(f log f), f is the number of files of the directory
+     *
+     * @param directory directory of the frames, throws std::runtime_error if it can't be listed
+     */
+    explicit DirectoryFrameSource(const std::string &directory);
+    bool next(png::image<png::rgb_pixel> &frame) override;
+    void rewind() override { position = 0; }
+
+    /// number of frames of the clip
+    size_t size() const { return files.size(); }
+private:
+    std::vector<std::string> files;
+    size_t position = 0;
+};
+
+/**
+ * @brief Frames of a stream of raw rgb bytes, width &times; height &times; 3 bytes per frame with no header
+ *
+ * The stream is a file, or the standard input for "-" (which can't be rewound).
+ */
+class RawFrameSource : public FrameSource{
+public:
+    /**
+     * @brief Construct a new Raw Frame Source object
+     *
+     * @param file_name file name of the stream, "-" for the standard input, throws std::runtime_error if it can't be opened
+     * @param width width of the frames
+     * @param height height of the frames
+     */
+    RawFrameSource(const std::string &file_name, int width, int height);
+    bool next(png::image<png::rgb_pixel> &frame) override;
+    void rewind() override;
+private:
+    std::unique_ptr<FILE, int (*)(FILE *)> file;
+    int width;
+    int height;
+    std::vector<png::byte> buffer;
+};
+
+/**
+ * @brief Synthesizes a video texture of any length from an input clip
+ *
+ * The patches are spatio-temporal blocks of the input clip: blockSize &times; blockSize pixels of blockFrames consecutive
+ * frames. They are placed in slabs of blockFrames output frames, each slab shares temporalOverlap frames with the
+ * previous one, and in scanline order inside a slab, overlapping overlap pixels. Each block is the best of random
+ * candidates (input frames of the window and positions) by the mean squared difference over the colored voxels under
+ * it. Its seam is a surface, the 3D minimum cut of the graph of its colored voxels with the costs of Kwatra et al.:
+ * the voxels next to colored voxels out of the block keep their color, the voxels next to voxels only the block
+ * covers get the block, which also covers the voxels between them where the cut is the cheapest. The cut is a max flow
+ * (the dual of a 3D grid isn't planar, so the shortest paths of ImageTexture don't apply) and the old seams aren't
+ * kept as in ImageTexture.
+ *
+ * Only a sliding window of inputWindow input frames and the frames of the slab being synthesized are resident, a frame
+ * is given to the sink as soon as no later block can change it, so clips and outputs longer than the memory work.
+ * The input clip loops when it ends, the candidates don't cross the loop when the window has other positions.
+ */
+class VideoTexture{
+public:
+    /// sizes of the output and of the blocks
+    struct Options{
+        int width = 0; /// width of the output frames
+        int height = 0; /// height of the output frames
+        int frames = 0; /// number of output frames
+        int blockSize = 64; /// side of the blocks (at most the size of the input frames)
+        int blockFrames = 8; /// number of frames of the blocks
+        int overlap = 16; /// pixels shared by neighbor blocks of a slab
+        int temporalOverlap = 3; /// frames shared by consecutive slabs
+        int candidates = 8; /// random blocks evaluated for each placement
+        int inputWindow = 24; /// input frames kept resident (at least blockFrames)
+    };
+
+    /// receives the output frame index, in order
+    using FrameSink = std::function<void(int, const png::image<png::rgb_pixel> &)>;
+
+    /**
+     * @brief Construct a new Video Texture object
+     *
+     * @param options sizes of the output and of the blocks, throws std::runtime_error if they are invalid
+     * @param seed seed of the random generator
+     */
+    VideoTexture(const Options &options, uint64_t seed);
+
+    /**
+     * @brief Synthesizes the output frames from the input clip
+     *
+     * Time Complexity: O(frames / (blockFrames - temporalOverlap) &times; blocks per slab &times; (candidates + cut) &times; blockSize<sup>2</sup> &times; blockFrames)
+     *
+     * @param input frames of the input clip, all of the same size, throws std::runtime_error if it has none or they differ
+     * @param output receives each output frame once it is final
+     * @return int number of frames given to output
+     */
+    int synthesize(FrameSource &input, const FrameSink &output);
+
+    /**
+     * @brief Sink that writes the frames to image files
+     *
+     * @param directory directory of the files, which are named frame_000000, frame_000001...
+     * @param extension extension of the files, which chooses their format (see imagecodec.hpp)
+     * @return FrameSink
+     */
+    static FrameSink directorySink(const std::string &directory, const std::string &extension = "png");
+
+    /// number of blocks placed
+    uint64_t blocks() const { return blockCount; }
+
+    /// sum of the costs of the cuts of the blocks
+    long double seamEnergy() const { return cutEnergy; }
+
+    /// largest number of output and input frames resident at once
+    size_t peakResidentFrames() const { return peakFrames; }
+private:
+    // an output frame of the window and which of its pixels have a color
+    struct OutputFrame{
+        png::image<png::rgb_pixel> image;
+        std::vector<uint8_t> colored;
+    };
+    // an input frame of the window and its index in the clip
+    struct InputFrame{
+        png::image<png::rgb_pixel> image;
+        uint64_t clipIndex;
+    };
+    // position of a block in the input window
+    struct Candidate{
+        int frame;
+        int row;
+        int col;
+    };
+
+    Options options;
+    std::mt19937_64 rng;
+    std::deque<OutputFrame> outputFrames;
+    // output frame of outputFrames[0], the frames before it were given to the sink
+    int firstOutputFrame = 0;
+    std::deque<InputFrame> inputFrames;
+    // index in the clip of the next input frame
+    uint64_t clipPosition = 0;
+    uint64_t blockCount = 0;
+    long double cutEnergy = 0;
+    size_t peakFrames = 0;
+
+    void readInput(FrameSource &input);
+    bool colored(int frame, int i, int j) const;
+    Candidate matching(int frame, int row, int col, int frames, int side);
+    void placeBlock(const Candidate &candidate, int frame, int row, int col, int frames, int side);
+};